@@ -0,0 +1,393 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "batchprocessor.hh"
+#include "pcmfile.hh"
+#include "logreader.hh"
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QAtomicInt>
+#include <QScopedPointer>
+#include <cstring>
+#include <functional>
+
+// random access to the frames, one instance per thread
+class BatchProcessor::Source
+{
+public:
+    virtual ~Source() {}
+    virtual Source *clone() const = 0; // nullptr if the recording can't be opened again
+    virtual bool seek(qint64 frame) = 0;
+    virtual qint64 read(char *data, qint64 frames) = 0;
+};
+
+class BatchProcessor::FileSource : public BatchProcessor::Source
+{
+public:
+    FileSource(const QString &fileName, const QAudioFormat &rawFormat) :
+        _fileName(fileName), _rawFormat(rawFormat) {}
+
+    bool open()
+    {
+        if (_rawFormat.isValid())
+            return _file.openRaw(_fileName, _rawFormat);
+        return _file.open(_fileName);
+    }
+
+    Source *clone() const override
+    {
+        FileSource *copy = new FileSource(_fileName, _rawFormat);
+        if (!copy->open()) {
+            delete copy;
+            return nullptr;
+        }
+        return copy;
+    }
+
+    bool seek(qint64 frame) override { return _file.seek(frame); }
+    qint64 read(char *data, qint64 frames) override { return _file.read(data, frames); }
+
+    PcmFile _file;
+
+private:
+    QString _fileName;
+    QAudioFormat _rawFormat;
+};
+
+class BatchProcessor::LogSource : public BatchProcessor::Source
+{
+public:
+    LogSource(const QString &fileName) : _fileName(fileName), _position(0) {}
+
+    bool open() { return _reader.open(_fileName); }
+
+    Source *clone() const override
+    {
+        // each clone maps the file, the pages are shared by the system
+        LogSource *copy = new LogSource(_fileName);
+        if (!copy->open()) {
+            delete copy;
+            return nullptr;
+        }
+        return copy;
+    }
+
+    bool seek(qint64 frame) override
+    {
+        _position = qBound<qint64>(0, frame, _reader.endFrame() - _reader.firstFrame());
+        return true;
+    }
+
+    qint64 read(char *data, qint64 frames) override
+    {
+        frames = _reader.readFrames(_reader.firstFrame() + _position, data, frames);
+        _position += frames;
+        return frames;
+    }
+
+    LogReader _reader;
+
+private:
+    QString _fileName;
+    qint64 _position;
+};
+
+class BatchProcessor::MemorySource : public BatchProcessor::Source
+{
+public:
+    MemorySource(const char *data, qint64 frames, int frameSize) :
+        _data(data), _frames(frames), _frameSize(frameSize), _position(0) {}
+
+    Source *clone() const override { return new MemorySource(_data, _frames, _frameSize); }
+
+    bool seek(qint64 frame) override
+    {
+        _position = qBound<qint64>(0, frame, _frames);
+        return true;
+    }
+
+    qint64 read(char *data, qint64 frames) override
+    {
+        frames = qMin(frames, _frames - _position);
+        memcpy(data, _data + _position * _frameSize, frames * _frameSize);
+        _position += frames;
+        return frames;
+    }
+
+private:
+    const char *_data;
+    qint64 _frames;
+    int _frameSize;
+    qint64 _position;
+};
+
+namespace {
+class Task : public QRunnable
+{
+public:
+    explicit Task(const std::function<void()> &f) : _f(f) {}
+    void run() override { _f(); }
+
+private:
+    std::function<void()> _f;
+};
+} // namespace
+
+BatchProcessor::BatchProcessor() :
+    _blockFrames(48000), _integrationTime(3.0), _filter(LowPassFilter::Boxcar), _decimatedRate(0.0), _invertLR(false), _referenceChannel(1), _referenceFrequency(0.0), _precision(LockinEngine::Double), _threads(0)
+{
+    _harmonics << 1;
+}
+
+void BatchProcessor::setBlockFrames(qint64 blockFrames)
+{
+    _blockFrames = qMax<qint64>(1, blockFrames);
+}
+
+void BatchProcessor::setIntegrationTime(qreal integrationTime)
+{
+    _integrationTime = integrationTime;
+}
+
+void BatchProcessor::setFilter(LowPassFilter::Type filter)
+{
+    _filter = filter;
+}
+
+void BatchProcessor::setDecimatedRate(qreal rate)
+{
+    _decimatedRate = rate;
+}
+
+void BatchProcessor::setHarmonics(const QVector<int> &harmonics)
+{
+    _harmonics = harmonics;
+}
+
+void BatchProcessor::setInvertLR(bool on)
+{
+    _invertLR = on;
+}
+
+void BatchProcessor::setReferenceChannel(int channel)
+{
+    _referenceChannel = channel;
+}
+
+void BatchProcessor::setReferenceFrequency(qreal frequency)
+{
+    _referenceFrequency = frequency;
+}
+
+void BatchProcessor::setPrecision(LockinEngine::Precision precision)
+{
+    _precision = precision;
+}
+
+void BatchProcessor::setThreadCount(int threads)
+{
+    _threads = qMax(0, threads);
+}
+
+bool BatchProcessor::isBitIdentical(LowPassFilter::Type filter)
+{
+    return LowPassFilter::order(filter) == 0;
+}
+
+bool BatchProcessor::processFile(const QString &fileName, const QAudioFormat &rawFormat)
+{
+    if (!rawFormat.isValid() && LogReader::isLogFile(fileName)) {
+        LogSource source(fileName);
+        if (!source.open()) {
+            _error = fileName + ": " + source._reader.errorString();
+            return false;
+        }
+        if (source._reader.rawChunks().isEmpty()) {
+            _error = fileName + ": the recording holds no raw sound";
+            return false;
+        }
+
+        return run(&source, source._reader.endFrame() - source._reader.firstFrame(), source._reader.format());
+    }
+
+    FileSource source(fileName, rawFormat);
+    if (!source.open()) {
+        _error = fileName + ": " + source._file.errorString();
+        return false;
+    }
+
+    return run(&source, source._file.frameCount(), source._file.format());
+}
+
+bool BatchProcessor::processMemory(const char *data, qint64 frames, const QAudioFormat &format)
+{
+    MemorySource source(data, frames, format.bytesPerFrame());
+    return run(&source, frames, format);
+}
+
+const QVector<LockinOutput> &BatchProcessor::outputs() const
+{
+    return _outputs;
+}
+
+QString BatchProcessor::errorString() const
+{
+    return _error;
+}
+
+bool BatchProcessor::run(Source *source, qint64 frames, const QAudioFormat &format)
+{
+    _outputs.clear();
+
+    LockinEngine engine;
+    if (!engine.setFormat(format)) {
+        _error = "format not supported";
+        return false;
+    }
+    if (_referenceFrequency <= 0.0 && (_referenceChannel < 0 || _referenceChannel >= format.channelCount())) {
+        _error = "no such reference channel";
+        return false;
+    }
+    if (_referenceFrequency >= 0.5 * format.sampleRate()) {
+        _error = "the reference frequency must be below the half of the sample rate";
+        return false;
+    }
+    if (!engine.setHarmonics(_harmonics)) {
+        _error = "the harmonics must be 1 or more";
+        return false;
+    }
+    const int threads = _threads > 0 ? _threads : (isBitIdentical(_filter) ? QThread::idealThreadCount() : 1);
+    if (threads > 1 && !isBitIdentical(_filter)) {
+        _error = "the " + LowPassFilter::name(_filter) + " filter runs on one thread only";
+        return false;
+    }
+    engine.setIntegrationTime(_integrationTime);
+    engine.setFilter(_filter);
+    engine.setDecimatedRate(_decimatedRate);
+
+    const qint64 blocks = (frames + _blockFrames - 1) / _blockFrames;
+
+    // a chunk must be much longer than its warm up to scale
+    const qint64 warmup = engine.memoryFrames() / _blockFrames + 2;
+    const int chunks = int(qBound<qint64>(1, blocks / (4 * warmup), threads));
+
+    QVector<QVector<LockinOutput>> results(chunks);
+    QAtomicInt failures(0);
+
+    if (chunks == 1) {
+        if (!processChunk(source, format, 0, blocks, frames, &results[0]))
+            failures.ref();
+    } else {
+        QThreadPool pool;
+        pool.setMaxThreadCount(chunks);
+
+        for (int c = 0; c < chunks; ++c) {
+            const qint64 begin = blocks * c / chunks;
+            const qint64 end = blocks * (c + 1) / chunks;
+            QVector<LockinOutput> *result = &results[c];
+
+            pool.start(new Task([this, source, &format, begin, end, frames, result, &failures]() {
+                QScopedPointer<Source> own(source->clone());
+                if (own.isNull() || !processChunk(own.data(), format, begin, end, frames, result))
+                    failures.ref();
+            }));
+        }
+
+        pool.waitForDone();
+    }
+
+    if (failures.loadAcquire() != 0) {
+        _error = "read error";
+        return false;
+    }
+
+    // deterministic merge : chunks in order
+    for (int c = 0; c < chunks; ++c)
+        _outputs += results[c];
+
+    return true;
+}
+
+bool BatchProcessor::processChunk(Source *source, const QAudioFormat &format, qint64 firstBlock, qint64 endBlock,
+                                  qint64 totalFrames, QVector<LockinOutput> *outputs)
+{
+    LockinEngine engine;
+    if (!engine.setFormat(format))
+        return false;
+    engine.setIntegrationTime(_integrationTime);
+    engine.setFilter(_filter);
+    engine.setDecimatedRate(_decimatedRate);
+    engine.setHarmonics(_harmonics);
+    engine.setInvertLR(_invertLR);
+    engine.setReferenceChannel(_referenceChannel);
+    engine.setReferenceFrequency(_referenceFrequency);
+    engine.setPrecision(_precision);
+    // the reads are aligned on the blocks, so one value at the end of each block, the last one included
+    engine.setOutputPeriod(0);
+
+    QByteArray buffer(_blockFrames * format.bytesPerFrame(), Qt::Uninitialized);
+    LockinOutput output;
+
+    // the memory of the filter plus one block
+    qint64 warmup = (engine.memoryFrames() + _blockFrames - 1) / _blockFrames + 1;
+
+    forever {
+        const qint64 start = qMax<qint64>(0, firstBlock - warmup);
+
+        engine.reset(start * _blockFrames);
+        if (!source->seek(start * _blockFrames))
+            return false;
+
+        for (qint64 b = start; b < firstBlock; ++b) {
+            qint64 n = source->read(buffer.data(), _blockFrames);
+            if (n <= 0)
+                return false;
+            engine.readFrames(buffer.constData(), n);
+            engine.parseChopperSignal();
+            engine.demodulate();
+        }
+
+        // otherwise the memory of the filter in the serial run would hold older values, or values
+        // computed with a reference tracker that has a longer history
+        if (start == 0 || engine.isSettled())
+            break;
+
+        warmup *= 2;
+    }
+
+    outputs->clear();
+    for (qint64 b = firstBlock; b < endBlock; ++b) {
+        qint64 n = source->read(buffer.data(), qMin(_blockFrames, totalFrames - b * _blockFrames));
+        if (n <= 0)
+            return false;
+
+        engine.readFrames(buffer.constData(), n);
+        engine.parseChopperSignal();
+        engine.demodulate();
+
+        while (engine.integrate(&output))
+            *outputs << output;
+    }
+
+    return true;
+}
@@ -0,0 +1,97 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef BATCHPROCESSOR_HPP
+#define BATCHPROCESSOR_HPP
+
+#include "lockin_engine.hh"
+#include <QString>
+
+/* Processes a whole recording on several threads
+ *
+ * The recording is cut in blocks of blockFrames (one output per block) and
+ * the blocks are distributed in contiguous chunks, one per thread.
+ * Each chunk starts earlier by a warm up of the memory of the filter plus one block
+ * (for the memory of the reference tracker) and drops the outputs of the warm up.
+ * The warm up is extended until the memory of the filter is full of values computed
+ * with a settled reference tracker (LockinEngine::isSettled()), so every output
+ * sees exactly the same values as in a serial run : with Boxcar and Fir the result
+ * is bit-identical whatever the number of threads.
+ * The chunks are merged in order.
+ * The IIR filters never forget, their memory is where the older values weigh less
+ * than 1e-16. Once the step of a stage is below the rounding of its state, a one ulp
+ * difference at the end of the warm up is never absorbed, so they run on one thread :
+ * the processing fails if more are asked.
+ */
+
+class BatchProcessor
+{
+public:
+    BatchProcessor();
+
+    void setBlockFrames(qint64 blockFrames);
+    void setIntegrationTime(qreal integrationTime);
+    void setFilter(LowPassFilter::Type filter); // Boxcar by default
+    void setDecimatedRate(qreal rate); // see LockinEngine::setDecimatedRate(), 0 by default
+    void setHarmonics(const QVector<int> &harmonics); // checked by the process functions, see LockinEngine::setHarmonics()
+    void setInvertLR(bool on);
+    void setReferenceChannel(int channel); // channel of the chopper, 1 by default
+    void setReferenceFrequency(qreal frequency); // see LockinEngine::setReferenceFrequency(), 0 by default
+    void setPrecision(LockinEngine::Precision precision); // see LockinEngine::setPrecision(), Double by default
+    // 0 : QThread::idealThreadCount() with Boxcar and Fir, 1 with the IIR filters (default)
+    void setThreadCount(int threads);
+
+    // rawFormat is used for raw PCM files, an invalid one means WAV or a recording of DataLogger
+    bool processFile(const QString &fileName, const QAudioFormat &rawFormat = QAudioFormat());
+    // interleaved frames in memory
+    bool processMemory(const char *data, qint64 frames, const QAudioFormat &format);
+
+    const QVector<LockinOutput> &outputs() const;
+    QString errorString() const;
+
+private:
+    class Source;
+    class FileSource;
+    class LogSource;
+    class MemorySource;
+
+    bool run(Source *source, qint64 frames, const QAudioFormat &format);
+    static bool isBitIdentical(LowPassFilter::Type filter); // same output whatever the number of threads
+    bool processChunk(Source *source, const QAudioFormat &format, qint64 firstBlock, qint64 endBlock,
+                      qint64 totalFrames, QVector<LockinOutput> *outputs);
+
+    qint64 _blockFrames;
+    qreal _integrationTime;
+    LowPassFilter::Type _filter;
+    qreal _decimatedRate;
+    QVector<int> _harmonics;
+    bool _invertLR;
+    int _referenceChannel;
+    qreal _referenceFrequency;
+    LockinEngine::Precision _precision;
+    int _threads;
+
+    QVector<LockinOutput> _outputs;
+    QString _error;
+};
+
+#endif // BATCHPROCESSOR_HPP
@@ -0,0 +1,109 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+/* Micro-benchmark of PcmDecoder
+ * Decodes one second of stereo 192 kHz audio many times for each sample size
+ * the GUI can select (8, 16, 24 and 32 bits) and prints the throughput
+ */
+
+#include "pcmdecoder.hh"
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QVector>
+
+namespace {
+
+const int frames = 192000;
+const int repeat = 50;
+
+template <typename Real>
+double bench(const QAudioFormat &format)
+{
+    PcmDecoder<Real> decoder;
+    if (!decoder.setFormat(format))
+        return -1.0;
+
+    QByteArray input(frames * decoder.frameSize(), Qt::Uninitialized);
+    for (int i = 0; i < input.size(); ++i)
+        input[i] = char(i * 7919 >> 3);
+
+    QVector<Real> left(frames), right(frames);
+    Real *out[2] = { left.data(), right.data() };
+
+    decoder.decode(input.constData(), frames, out); // warm up
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int r = 0; r < repeat; ++r)
+        decoder.decode(input.constData(), frames, out);
+    qint64 ns = timer.nsecsElapsed();
+
+    // samples per second (one sample = one channel of one frame)
+    return 2.0 * frames * repeat / (ns * 1e-9);
+}
+
+QString typeName(QAudioFormat::SampleType type)
+{
+    switch (type) {
+    case QAudioFormat::SignedInt: return "SignedInt";
+    case QAudioFormat::UnSignedInt: return "UnSignedInt";
+    case QAudioFormat::Float: return "Float";
+    case QAudioFormat::Unknown: break;
+    }
+    return "Unknown";
+}
+
+} // namespace
+
+int main()
+{
+    QTextStream out(stdout);
+    out << "size\ttype\torder\tfloat [MS/s]\tdouble [MS/s]\n";
+
+    const QAudioFormat::SampleType types[] = { QAudioFormat::SignedInt, QAudioFormat::UnSignedInt, QAudioFormat::Float };
+    const QAudioFormat::Endian orders[] = { QAudioFormat::LittleEndian, QAudioFormat::BigEndian };
+
+    foreach (int size, QList<int>() << 8 << 16 << 24 << 32) {
+        for (QAudioFormat::SampleType type : types) {
+            for (QAudioFormat::Endian order : orders) {
+                QAudioFormat format;
+                format.setCodec("audio/pcm");
+                format.setSampleRate(192000);
+                format.setChannelCount(2);
+                format.setSampleSize(size);
+                format.setSampleType(type);
+                format.setByteOrder(order);
+
+                if (!PcmDecoder<qreal>::isFormatSupported(format))
+                    continue;
+
+                out << size << "\t" << typeName(type) << "\t"
+                    << (order == QAudioFormat::LittleEndian ? "LE" : "BE") << "\t"
+                    << bench<float>(format) / 1e6 << "\t"
+                    << bench<double>(format) / 1e6 << "\n";
+                out.flush();
+            }
+        }
+    }
+
+    return 0;
+}
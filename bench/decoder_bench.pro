@@ -0,0 +1,13 @@
+QT += multimedia
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = decoder_bench
+
+INCLUDEPATH += $$PWD/..
+
+SOURCES += $$PWD/decoder_bench.cc \
+    $$PWD/../pcmdecoder.cc
+
+HEADERS += $$PWD/../pcmdecoder.hh
@@ -0,0 +1,121 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+/* Cost of the filter after the demodulation at full rate and behind the CicDecimator
+ * on a synthetic 192 kHz recording kept in memory (chopper on the right, sine on the left)
+ *
+ * filter_bench [seconds] [decimated rate]
+ */
+
+#include "lockin_engine.hh"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QTextStream>
+#include <QtEndian>
+#include <cmath>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    const QStringList args = app.arguments();
+    const qreal seconds = args.size() > 1 ? args[1].toDouble() : 60.0;
+    const qreal decimatedRate = args.size() > 2 ? args[2].toDouble() : 2000.0;
+
+    QAudioFormat format;
+    format.setCodec("audio/pcm");
+    format.setChannelCount(2);
+    format.setSampleRate(192000);
+    format.setSampleSize(16);
+    format.setSampleType(QAudioFormat::SignedInt);
+    format.setByteOrder(QAudioFormat::LittleEndian);
+
+    const qint64 frames = qint64(seconds * format.sampleRate());
+    QByteArray data(frames * format.bytesPerFrame(), Qt::Uninitialized);
+    qint16 *samples = reinterpret_cast<qint16 *>(data.data());
+
+    quint32 noise = 1;
+    for (qint64 i = 0; i < frames; ++i) {
+        qreal t = qreal(i) / format.sampleRate();
+        noise = noise * 1664525u + 1013904223u;
+        qreal signal = 0.3 * std::cos(2.0 * M_PI * 437.0 * t + 0.5) + 0.2 * (qreal(noise >> 8) / 16777216.0 - 0.5);
+        qreal chopper = std::sin(2.0 * M_PI * 437.0 * t) >= 0.0 ? 0.8 : -0.8;
+        qToLittleEndian<qint16>(qint16(signal * 32767.0), reinterpret_cast<uchar *>(samples + 2 * i));
+        qToLittleEndian<qint16>(qint16(chopper * 32767.0), reinterpret_cast<uchar *>(samples + 2 * i + 1));
+    }
+
+    // like the GUI : a block and a value every 100 ms
+    const int blockFrames = format.sampleRate() / 10;
+
+    out << "# " << seconds << " s of 192 kHz stereo, blocks of 100 ms, integration 1 s, harmonics 1,2,3\n";
+    out << "filter\trate [Hz]\tx real time\tfilter [ns/frame]\tmean r\tstd r\n";
+
+    const LowPassFilter::Type filters[] = { LowPassFilter::Boxcar, LowPassFilter::Rc24dB, LowPassFilter::Fir };
+    for (LowPassFilter::Type filter : filters) {
+        for (int decimate = 0; decimate < 2; ++decimate) {
+            LockinEngine engine;
+            engine.setFormat(format);
+            engine.setIntegrationTime(1.0);
+            engine.setFilter(filter);
+            engine.setDecimatedRate(decimate ? decimatedRate : 0.0);
+            engine.setHarmonics(QVector<int>() << 1 << 2 << 3);
+            engine.setOutputPeriod(blockFrames);
+            engine.reset();
+
+            QVector<qreal> r;
+            LockinOutput output;
+            qint64 demodulate = 0;
+
+            QElapsedTimer timer, step;
+            timer.start();
+            for (qint64 i = 0; i < frames; i += blockFrames) {
+                engine.readFrames(data.constData() + i * format.bytesPerFrame(), int(qMin<qint64>(blockFrames, frames - i)));
+                engine.parseChopperSignal();
+                step.start();
+                engine.demodulate();
+                demodulate += step.nsecsElapsed();
+                while (engine.integrate(&output))
+                    r << output.value.r;
+            }
+            const qreal elapsed = timer.nsecsElapsed() * 1e-9;
+
+            // statistics of the second half, settled
+            qreal mean = 0.0, var = 0.0;
+            const int begin = r.size() / 2;
+            for (int i = begin; i < r.size(); ++i)
+                mean += r[i];
+            mean /= qMax(1, r.size() - begin);
+            for (int i = begin; i < r.size(); ++i)
+                var += (r[i] - mean) * (r[i] - mean);
+            var /= qMax(1, r.size() - begin);
+
+            out << LowPassFilter::name(filter) << "\t"
+                << (decimate ? qreal(format.sampleRate()) / engine.decimation() : qreal(format.sampleRate())) << "\t"
+                << seconds / elapsed << "\t" << qreal(demodulate) / frames << "\t"
+                << mean << "\t" << std::sqrt(var) << "\n";
+            out.flush();
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,12 @@
+QT += multimedia
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = filter_bench
+
+INCLUDEPATH += $$PWD/..
+
+include($$PWD/../lockin_core.pri)
+
+SOURCES += $$PWD/filter_bench.cc
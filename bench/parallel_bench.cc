@@ -0,0 +1,163 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+/* Scaling of BatchProcessor from 1 to N threads
+ * on a synthetic recording kept in memory (chopper on the right, sine on the left),
+ * for every filter and precision
+ *
+ * parallel_bench [minutes] [max threads]
+ *
+ * The IIR filters run on one thread only.
+ * Returns 1 if Boxcar or Fir is not bit-identical to one thread
+ * or if BatchProcessor accepts several threads with an IIR filter.
+ */
+
+#include "batchprocessor.hh"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+#include <QtEndian>
+#include <cmath>
+
+// largest difference of x, y and r relative to r, 0 if bit-identical, infinite if the outputs don't match
+static qreal difference(const QVector<LockinOutput> &a, const QVector<LockinOutput> &b)
+{
+    if (a.size() != b.size())
+        return INFINITY;
+
+    qreal max = 0.0;
+    for (int i = 0; i < a.size(); ++i) {
+        if (a[i].time != b[i].time || a[i].values.size() != b[i].values.size())
+            return INFINITY;
+        for (int k = 0; k < a[i].values.size(); ++k) {
+            const LockinValue &u = a[i].values[k];
+            const LockinValue &v = b[i].values[k];
+            if (u.x == v.x && u.y == v.y && u.r == v.r && u.theta == v.theta)
+                continue;
+            const qreal d = qMax(qMax(std::fabs(u.x - v.x), std::fabs(u.y - v.y)), std::fabs(u.r - v.r));
+            max = qMax(max, u.r > 0.0 ? d / u.r : INFINITY);
+        }
+    }
+    return max;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    const QStringList args = app.arguments();
+    const qreal minutes = args.size() > 1 ? args[1].toDouble() : 10.0;
+    const int maxThreads = args.size() > 2 ? args[2].toInt() : QThread::idealThreadCount();
+
+    QAudioFormat format;
+    format.setCodec("audio/pcm");
+    format.setChannelCount(2);
+    format.setSampleRate(48000);
+    format.setSampleSize(16);
+    format.setSampleType(QAudioFormat::SignedInt);
+    format.setByteOrder(QAudioFormat::LittleEndian);
+
+    const qint64 frames = qint64(minutes * 60.0 * format.sampleRate());
+    QByteArray data(frames * format.bytesPerFrame(), Qt::Uninitialized);
+    qint16 *samples = reinterpret_cast<qint16 *>(data.data());
+
+    quint32 noise = 1;
+    for (qint64 i = 0; i < frames; ++i) {
+        qreal t = qreal(i) / format.sampleRate();
+        noise = noise * 1664525u + 1013904223u;
+        qreal signal = 0.3 * std::cos(2.0 * M_PI * 437.0 * t + 0.5) + 0.2 * (qreal(noise >> 8) / 16777216.0 - 0.5);
+        qreal chopper = std::sin(2.0 * M_PI * 437.0 * t) >= 0.0 ? 0.8 : -0.8;
+        qToLittleEndian<qint16>(qint16(signal * 32767.0), reinterpret_cast<uchar *>(samples + 2 * i));
+        qToLittleEndian<qint16>(qint16(chopper * 32767.0), reinterpret_cast<uchar *>(samples + 2 * i + 1));
+    }
+
+    out << "# " << minutes << " min of 48 kHz stereo, output period 1 s, integration 3 s, harmonics 1,2,3\n";
+    out << "# identical : yes if bit-identical to one thread, else the largest difference relative to r\n";
+    out << "filter\tprecision\tthreads\tseconds\tx real time\tspeedup\tidentical\n";
+
+    QList<int> counts;
+    for (int threads = 1; threads < maxThreads; threads *= 2)
+        counts << threads;
+    counts << maxThreads;
+
+    bool ok = true;
+    for (int f = 0; f <= LowPassFilter::Fir; ++f) {
+        const LowPassFilter::Type filter = LowPassFilter::Type(f);
+        const bool parallel = LowPassFilter::order(filter) == 0;
+        for (int p = LockinEngine::Double; p <= LockinEngine::Float; ++p) {
+            const LockinEngine::Precision precision = LockinEngine::Precision(p);
+            QVector<LockinOutput> reference;
+            qreal serial = 0.0;
+
+            foreach (int threads, counts) {
+                BatchProcessor processor;
+                processor.setBlockFrames(format.sampleRate());
+                processor.setIntegrationTime(3.0);
+                processor.setFilter(filter);
+                processor.setPrecision(precision);
+                processor.setHarmonics(QVector<int>() << 1 << 2 << 3);
+                processor.setThreadCount(threads);
+
+                QElapsedTimer timer;
+                timer.start();
+                const bool done = processor.processMemory(data.constData(), frames, format);
+                const qreal seconds = timer.nsecsElapsed() * 1e-9;
+
+                if (!parallel && threads > 1) {
+                    if (done)
+                        ok = false;
+                    out << LowPassFilter::name(filter) << "\t" << LockinEngine::precisionName(precision) << "\t"
+                        << threads << "\t" << (done ? "accepted NO" : "refused") << "\n";
+                    continue;
+                }
+                if (!done) {
+                    ok = false;
+                    out << LowPassFilter::name(filter) << "\t" << LockinEngine::precisionName(precision) << "\t"
+                        << threads << "\t" << processor.errorString() << " NO\n";
+                    continue;
+                }
+
+                if (threads == 1) {
+                    reference = processor.outputs();
+                    serial = seconds;
+                }
+
+                const qreal d = difference(reference, processor.outputs());
+                if (d != 0.0)
+                    ok = false;
+
+                out << LowPassFilter::name(filter) << "\t" << LockinEngine::precisionName(precision) << "\t"
+                    << threads << "\t" << seconds << "\t" << minutes * 60.0 / seconds << "\t" << serial / seconds << "\t";
+                if (d == 0.0)
+                    out << "yes\n";
+                else
+                    out << d << " NO\n";
+                out.flush();
+            }
+        }
+    }
+
+    return ok ? 0 : 1;
+}
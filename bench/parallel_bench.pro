@@ -0,0 +1,17 @@
+QT += multimedia
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = parallel_bench
+
+INCLUDEPATH += $$PWD/..
+
+include($$PWD/../lockin_core.pri)
+
+SOURCES += $$PWD/parallel_bench.cc \
+    $$PWD/../pcmfile.cc \
+    $$PWD/../batchprocessor.cc
+
+HEADERS += $$PWD/../pcmfile.hh \
+    $$PWD/../batchprocessor.hh
@@ -0,0 +1,122 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+/* Latency of the shared memory between ShmPublisher and ShmReader in another process
+ *
+ * The writer publishes values carrying the time of their publication (CLOCK_MONOTONIC),
+ * a forked reader spins on the ring and measures when it sees them.
+ *
+ * shm_bench [values] [interval in us]
+ */
+
+#include "shmpublisher.hh"
+#include "shmreader.hh"
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+#include <algorithm>
+#include <ctime>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static double now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int reader(const QString &name, int count)
+{
+    QTextStream out(stdout);
+    ShmReader reader;
+    while (!reader.open(name) || !reader.updateLayout())
+        usleep(100);
+
+    QVector<double> latencies;
+    latencies.reserve(count);
+    quint64 next = 0;
+    qint64 lost = 0;
+
+    while (latencies.size() + lost < count) {
+        const quint64 end = reader.valuesWritten();
+        if (end - next > reader.layout().valueCapacity) {
+            lost += end - reader.layout().valueCapacity - next;
+            next = end - reader.layout().valueCapacity;
+        }
+
+        for (; next < end; ++next) {
+            const double seen = now();
+            const double stamp = reader.valueRecord(next)[1];
+            if (reader.isValueValid(next))
+                latencies << seen - stamp;
+            else
+                lost++;
+        }
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    const int n = latencies.size();
+    out << "values\tlost\tmin [ns]\tmedian [ns]\t99% [ns]\t99.9% [ns]\tmax [ns]\n";
+    out << n << "\t" << lost << "\t" << latencies[0] << "\t" << latencies[n / 2] << "\t"
+        << latencies[n * 99 / 100] << "\t" << latencies[n * 999 / 1000] << "\t" << latencies[n - 1] << "\n";
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream err(stderr);
+
+    const QStringList args = app.arguments();
+    const int count = args.size() > 1 ? args[1].toInt() : 100000;
+    const int interval = args.size() > 2 ? args[2].toInt() : 20;
+    const QString name = QString("/lockin-bench-%1").arg(getpid());
+
+    ShmPublisher publisher;
+    if (!publisher.open(name)) {
+        err << name << ": " << publisher.errorString() << "\n";
+        return 1;
+    }
+    // like a stereo lockin with 3 harmonics
+    publisher.configure(192000, 2, QVector<int>() << 0 << 0 << 0, QVector<int>() << 1 << 2 << 3);
+
+    pid_t child = fork();
+    if (child == 0)
+        return reader(name, count);
+
+    usleep(200000);
+
+    LockinOutput output;
+    output.values.resize(3);
+    for (int i = 0; i < count; ++i) {
+        const double start = now();
+        while (now() - start < interval * 1e3) {
+        }
+
+        output.time = i;
+        output.values[0].x = now();
+        publisher.appendValue(output);
+    }
+
+    waitpid(child, nullptr, 0);
+    return 0;
+}
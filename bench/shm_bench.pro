@@ -0,0 +1,12 @@
+QT += multimedia
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = shm_bench
+
+INCLUDEPATH += $$PWD/..
+
+include($$PWD/../lockin_core.pri)
+
+SOURCES += $$PWD/shm_bench.cc
@@ -0,0 +1,236 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+#include "cicdecimator.hh"
+#include <QVarLengthArray>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+CicDecimator::CicDecimator() :
+    _factor(1), _span(0), _next(0), _lastNaN(-1)
+{
+}
+
+void CicDecimator::reset(int factor, qint64 firstFrame)
+{
+    Q_ASSERT(factor >= 1 && (factor & (factor - 1)) == 0);
+    _factor = factor;
+    _span = factor > 1 ? memoryFrames(factor) - factor : 0;
+    _next = firstFrame;
+    _lastNaN = firstFrame - 1; // nothing before the first frame
+    _stages.clear();
+
+    if (factor == 1)
+        return;
+
+    const int ratio = factor / 2; // of the CIC
+    for (int r = 1; r < factor; r <<= 1) {
+        Stage stage;
+        if (r == ratio)
+            stage.taps.resize(CompensatorTaps);
+        stage.count = 0;
+        stage.next = firstFrame / r;
+        _stages << stage;
+    }
+
+    /* compensator, frequencies relative to the output rate of the CIC :
+     * flat up to 0.2 (inverse of the CIC response), nothing above 0.3 that would fold under 0.2
+     * designed by sampling the frequency response and windowed by a Blackman window
+     */
+    QVector<qreal> &taps = _stages.last().taps;
+    const qreal pass = 0.2, stop = 0.3;
+    const int points = 1024;
+    const qreal center = (CompensatorTaps - 1) / 2.0;
+    qreal sum = 0.0;
+
+    for (int n = 0; n < CompensatorTaps; ++n) {
+        qreal h = 0.0;
+        for (int q = 0; q < points; ++q) {
+            const qreal f = 0.5 * (q + 0.5) / points;
+            if (f >= stop)
+                break;
+
+            qreal cic = 1.0;
+            if (ratio > 1)
+                cic = std::pow(std::sin(M_PI * f) / (ratio * std::sin(M_PI * f / ratio)), int(Order));
+            qreal gain = 1.0 / cic;
+            if (f > pass)
+                gain *= (stop - f) / (stop - pass);
+
+            h += gain * std::cos(2.0 * M_PI * f * (n - center));
+        }
+
+        const qreal u = 2.0 * M_PI * n / (CompensatorTaps - 1);
+        taps[n] = h * (0.42 - 0.5 * std::cos(u) + 0.08 * std::cos(2.0 * u));
+        sum += taps[n];
+    }
+    for (int n = 0; n < CompensatorTaps; ++n)
+        taps[n] /= sum;
+
+    for (int k = 0; k < _stages.size(); ++k) {
+        _stages[k].x.fill(0.0, history(_stages[k]));
+        _stages[k].y.fill(0.0, history(_stages[k]));
+    }
+}
+
+int CicDecimator::factor() const
+{
+    return _factor;
+}
+
+template <typename Real>
+int CicDecimator::process(qint64 frame, const Real *x, const Real *y, int size, qreal *outX, qreal *outY, qint64 *first)
+{
+    Q_ASSERT(frame == _next);
+    _next = frame + size;
+
+    if (_stages.isEmpty()) {
+        std::copy(x, x + size, outX);
+        std::copy(y, y + size, outY);
+        *first = frame;
+        return size;
+    }
+
+    // the NaN become zero, their runs [begin, end) are kept to invalidate the outputs
+    QVarLengthArray<qint64, 16> runs;
+    Stage &input = _stages[0];
+    reserve(input, size);
+    qreal *ix = input.x.data() + history(input);
+    qreal *iy = input.y.data() + history(input);
+    for (int i = 0; i < size; ++i) {
+        if (std::isnan(x[i]) || std::isnan(y[i])) {
+            if (runs.isEmpty() || runs.last() != frame + i) {
+                runs.append(frame + i);
+                runs.append(frame + i + 1);
+            } else {
+                runs.last()++;
+            }
+            ix[i] = iy[i] = 0.0;
+        } else {
+            ix[i] = x[i];
+            iy[i] = y[i];
+        }
+    }
+    input.count = size;
+
+    for (int k = 0; k + 1 < _stages.size(); ++k) {
+        Stage &next = _stages[k + 1];
+        reserve(next, _stages[k].count / 2 + 1);
+        next.count = run(_stages[k], next.x.data() + history(next), next.y.data() + history(next));
+    }
+
+    Stage &last = _stages.last();
+    *first = last.next >> 1;
+    const int count = run(last, outX, outY);
+
+    // the decimated value j depends on the frames [end - _span, end]
+    int r = 0;
+    for (int j = 0; j < count; ++j) {
+        const qint64 end = (*first + j + 1) * _factor - 1;
+        while (r < runs.size() && runs[r] <= end) {
+            _lastNaN = qMin(runs[r + 1] - 1, end);
+            if (runs[r + 1] - 1 > end)
+                break;
+            r += 2;
+        }
+
+        if (_lastNaN >= end - _span)
+            outX[j] = outY[j] = NAN;
+    }
+    if (!runs.isEmpty())
+        _lastNaN = runs.last() - 1;
+
+    return count;
+}
+
+template int CicDecimator::process<float>(qint64 frame, const float *x, const float *y, int size, qreal *outX, qreal *outY, qint64 *first);
+template int CicDecimator::process<double>(qint64 frame, const double *x, const double *y, int size, qreal *outX, qreal *outY, qint64 *first);
+
+int CicDecimator::history(const Stage &stage) const
+{
+    return stage.taps.isEmpty() ? int(Order) : stage.taps.size() - 1;
+}
+
+void CicDecimator::reserve(Stage &stage, int count)
+{
+    const int size = history(stage) + count;
+    if (stage.x.size() < size) {
+        stage.x.resize(size);
+        stage.y.resize(size);
+    }
+}
+
+int CicDecimator::run(Stage &stage, qreal *outX, qreal *outY)
+{
+    const int h = history(stage);
+    const int begin = (stage.next & 1) ? 0 : 1; // an output for each odd index
+    qreal *channels[2] = { stage.x.data(), stage.y.data() };
+    qreal *outputs[2] = { outX, outY };
+    int n = 0;
+
+    for (int c = 0; c < 2; ++c) {
+        const qreal *x = channels[c] + h;
+        qreal *out = outputs[c];
+        n = 0;
+
+        if (stage.taps.isEmpty()) {
+            // (1 + z^-1)^4 / 16, Order == 4
+            for (int i = begin; i < stage.count; i += 2)
+                out[n++] = (x[i] + x[i - 4] + 4.0 * (x[i - 1] + x[i - 3]) + 6.0 * x[i - 2]) * (1.0 / 16.0);
+        } else {
+            const qreal *t = stage.taps.constData();
+            const int taps = stage.taps.size();
+            for (int i = begin; i < stage.count; i += 2) {
+                qreal sum = 0.0;
+                for (int m = 0; m < taps; ++m)
+                    sum += t[m] * x[i - m];
+                out[n++] = sum;
+            }
+        }
+
+        // the last values become the history
+        memmove(channels[c], channels[c] + stage.count, h * sizeof(qreal));
+    }
+
+    stage.next += stage.count;
+    stage.count = 0;
+
+    return n;
+}
+
+int CicDecimator::factorFor(qreal sampleRate, qreal minRate)
+{
+    int factor = 1;
+    while (minRate > 0.0 && sampleRate / (2 * factor) >= minRate)
+        factor *= 2;
+    return factor;
+}
+
+qint64 CicDecimator::memoryFrames(int factor)
+{
+    if (factor == 1)
+        return 0;
+
+    // a (1 + z^-1)^Order stage spans Order input values, the compensator CompensatorTaps - 1
+    const qint64 ratio = factor / 2;
+    return Order * (ratio - 1) + (CompensatorTaps - 1) * ratio + factor;
+}
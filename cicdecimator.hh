@@ -0,0 +1,78 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+#ifndef CICDECIMATOR_HPP
+#define CICDECIMATOR_HPP
+
+#include <QVector>
+
+/* Decimation of the demodulated values x + iy by a power of two, before the low pass filter
+ *
+ * A CIC of order Order decimating by factor / 2, then a FIR compensating the droop of the CIC
+ * decimating by 2. The CIC is done in its non recursive form : a (1 + z^-1)^Order stage per
+ * octave, in floating point and without the drift of the integrators.
+ * The NaN are replaced by zero and their frames are remembered,
+ * a decimated value is NaN unless all the values under its impulse response were valid.
+ *
+ * The decimated value j covers the frames before (j + 1) * factor, the phases are taken from
+ * the absolute frame index so the output doesn't depend on the way the frames are pushed.
+ * The input is float or double (Real), the stages and the output are double.
+ */
+
+class CicDecimator
+{
+public:
+    enum { Order = 4, CompensatorTaps = 31 }; // the CIC stages are written for Order == 4
+
+    CicDecimator();
+
+    void reset(int factor, qint64 firstFrame); // factor is a power of two, 1 passes the values through
+    int factor() const;
+
+    // the frames must follow each other since reset(), outX and outY have room for size / factor + 1 values
+    // return the number of decimated values, the first one has the index *first (in decimated frames)
+    template <typename Real>
+    int process(qint64 frame, const Real *x, const Real *y, int size, qreal *outX, qreal *outY, qint64 *first);
+
+    static int factorFor(qreal sampleRate, qreal minRate); // largest power of two that keeps sampleRate / factor >= minRate
+    static qint64 memoryFrames(int factor); // length of the impulse response
+
+private:
+    // FIR decimating by 2, the buffers hold the history then the new values
+    struct Stage {
+        QVector<qreal> taps; // empty for a CIC stage
+        QVector<qreal> x, y;
+        int count; // new values
+        qint64 next; // index of the first new value, at the rate of the stage
+    };
+
+    void reserve(Stage &stage, int count);
+    int run(Stage &stage, qreal *outX, qreal *outY);
+    int history(const Stage &stage) const;
+
+    int _factor;
+    qint64 _span; // frames under the impulse response, minus one
+    qint64 _next; // next frame
+    qint64 _lastNaN; // frame of the last NaN before _next
+    QVector<Stage> _stages;
+};
+
+#endif // CICDECIMATOR_HPP
@@ -0,0 +1,317 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "datalogger.hh"
+#include <QThread>
+#include <QDateTime>
+#include <QDebug>
+#include <QVarLengthArray>
+#include <cstring>
+
+static const int valuesPerChunk = 256;
+static const int rawBytesPerChunk = 1 << 20;
+static const int maxChunkAge = 1000; // ms
+
+class DataLoggerThread : public QThread
+{
+public:
+    DataLoggerThread(DataLogger *logger) : _logger(logger) {}
+
+protected:
+    void run() override { _logger->writeLoop(); }
+
+private:
+    DataLogger *_logger;
+};
+
+static qint64 padded(qint64 size)
+{
+    return (size + 7) & ~qint64(7);
+}
+
+DataLogger::DataLogger() :
+    _raw(false), _valueCount(0), _frameSize(0), _maxPending(64 << 20),
+    _valueIndex(0), _pendingBytes(0), _closing(false), _thread(nullptr)
+{
+}
+
+DataLogger::~DataLogger()
+{
+    close();
+}
+
+bool DataLogger::open(const QString &fileName, const QAudioFormat &format, qreal integrationTime,
+                      const QVector<int> &harmonics, bool raw, int referenceChannel)
+{
+    close();
+
+    _file.setFileName(fileName);
+    if (!_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        _error = _file.errorString();
+        return false;
+    }
+
+    _error.clear();
+    _raw = raw;
+    const int signalCount = referenceChannel < 0 ? format.channelCount() : format.channelCount() - 1;
+    _valueCount = harmonics.size() * signalCount;
+    _frameSize = format.bytesPerFrame();
+    _valueIndex = 0;
+    _writtenBytes.storeRelease(0);
+    _droppedChunks.storeRelease(0);
+
+    QByteArray header(padded(sizeof(LogFileHeader) + harmonics.size() * sizeof(qint32)), 0);
+    LogFileHeader *h = reinterpret_cast<LogFileHeader *>(header.data());
+    memcpy(h->magic, "LOCKINLG", 8);
+    h->version = 2;
+    h->headerSize = header.size();
+    h->startTime = QDateTime::currentMSecsSinceEpoch();
+    h->integrationTime = integrationTime;
+    h->sampleRate = format.sampleRate();
+    h->channelCount = format.channelCount();
+    h->sampleSize = format.sampleSize();
+    h->sampleType = format.sampleType();
+    h->byteOrder = format.byteOrder();
+    h->harmonicCount = harmonics.size();
+    h->signalCount = signalCount;
+    h->referenceChannel = referenceChannel;
+
+    qint32 *list = reinterpret_cast<qint32 *>(header.data() + sizeof(LogFileHeader));
+    for (int k = 0; k < harmonics.size(); ++k)
+        list[k] = harmonics[k];
+
+    if (_file.write(header) != header.size()) {
+        _error = _file.errorString();
+        _file.close();
+        return false;
+    }
+    _writtenBytes.storeRelease(header.size());
+
+    _closing = false;
+    _pendingBytes = 0;
+    begin(&_values, 0);
+    begin(&_frames, 0);
+
+    _thread = new DataLoggerThread(this);
+    _thread->start(QThread::LowPriority);
+    return true;
+}
+
+void DataLogger::close()
+{
+    if (_thread == nullptr)
+        return;
+
+    flush();
+
+    {
+        QMutexLocker locker(&_mutex);
+        _closing = true;
+        _wake.wakeAll();
+    }
+    _thread->wait();
+    delete _thread;
+    _thread = nullptr;
+
+    _file.close();
+    _queue.clear();
+    _free.clear();
+
+    if (droppedChunks() > 0)
+        qDebug() << __FUNCTION__ << ":" << droppedChunks() << "chunks dropped, the disk was too slow";
+}
+
+bool DataLogger::isOpen() const
+{
+    return _thread != nullptr;
+}
+
+bool DataLogger::logsRaw() const
+{
+    return _raw;
+}
+
+QString DataLogger::errorString() const
+{
+    QMutexLocker locker(&_mutex);
+    return _error;
+}
+
+void DataLogger::setMaxPending(qint64 bytes)
+{
+    Q_ASSERT(!isOpen());
+    _maxPending = bytes;
+}
+
+qint64 DataLogger::maxPending() const
+{
+    return _maxPending;
+}
+
+void DataLogger::appendValue(const LockinOutput &output)
+{
+    if (!isOpen())
+        return;
+
+    // the channels and the harmonics are fixed by the header
+    QVarLengthArray<double, 64> record(1 + 4 * _valueCount);
+    record[0] = output.time;
+    for (int k = 0; k < _valueCount; ++k) {
+        const LockinValue &v = output.values.value(k);
+        record[1 + 4*k] = v.x;
+        record[2 + 4*k] = v.y;
+        record[3 + 4*k] = v.r;
+        record[4 + 4*k] = v.theta;
+    }
+
+    _values.data.append(reinterpret_cast<const char *>(record.constData()), record.size() * sizeof(double));
+    _values.count++;
+    _valueIndex++;
+
+    if (_values.count >= valuesPerChunk || _values.age.elapsed() >= maxChunkAge) {
+        handOver(&_values, LogChunkHeader::Values);
+        begin(&_values, _valueIndex);
+    }
+}
+
+void DataLogger::appendRaw(qint64 firstFrame, const char *first, qint64 firstSize, const char *second, qint64 secondSize)
+{
+    if (!isOpen() || !_raw)
+        return;
+
+    // a chunk only holds consecutive frames
+    if (_frames.count > 0 && firstFrame != _frames.first + _frames.count) {
+        handOver(&_frames, LogChunkHeader::Raw);
+        begin(&_frames, firstFrame);
+    }
+    if (_frames.count == 0)
+        _frames.first = firstFrame;
+
+    _frames.data.append(first, firstSize);
+    if (secondSize > 0)
+        _frames.data.append(second, secondSize);
+    _frames.count += (firstSize + secondSize) / _frameSize;
+
+    if (_frames.data.size() >= rawBytesPerChunk || _frames.age.elapsed() >= maxChunkAge) {
+        qint64 next = _frames.first + _frames.count;
+        handOver(&_frames, LogChunkHeader::Raw);
+        begin(&_frames, next);
+    }
+}
+
+void DataLogger::flush()
+{
+    if (!isOpen())
+        return;
+
+    if (_values.count > 0) {
+        handOver(&_values, LogChunkHeader::Values);
+        begin(&_values, _valueIndex);
+    }
+    if (_frames.count > 0) {
+        qint64 next = _frames.first + _frames.count;
+        handOver(&_frames, LogChunkHeader::Raw);
+        begin(&_frames, next);
+    }
+}
+
+qint64 DataLogger::writtenBytes() const
+{
+    return _writtenBytes.loadAcquire();
+}
+
+qint64 DataLogger::droppedChunks() const
+{
+    return _droppedChunks.loadAcquire();
+}
+
+void DataLogger::begin(Chunk *chunk, qint64 first)
+{
+    {
+        // reuse the memory of a chunk already written
+        QMutexLocker locker(&_mutex);
+        if (!_free.isEmpty())
+            chunk->data = _free.takeLast();
+    }
+
+    chunk->data.reserve(rawBytesPerChunk + sizeof(LogChunkHeader) + 8);
+    chunk->data.resize(sizeof(LogChunkHeader));
+    chunk->first = first;
+    chunk->count = 0;
+    chunk->age.start();
+}
+
+void DataLogger::handOver(Chunk *chunk, LogChunkHeader::Type type)
+{
+    if (chunk->count == 0)
+        return;
+
+    LogChunkHeader *h = reinterpret_cast<LogChunkHeader *>(chunk->data.data());
+    h->type = type;
+    h->reserved = 0;
+    h->size = chunk->data.size() - sizeof(LogChunkHeader);
+    h->first = chunk->first;
+    h->count = chunk->count;
+
+    const int size = chunk->data.size();
+    chunk->data.resize(padded(size));
+    memset(chunk->data.data() + size, 0, chunk->data.size() - size);
+
+    QMutexLocker locker(&_mutex);
+    if (_pendingBytes + chunk->data.size() > _maxPending) {
+        _droppedChunks.fetchAndAddRelaxed(1);
+        chunk->data.resize(0);
+        _free << chunk->data;
+    } else {
+        _pendingBytes += chunk->data.size();
+        _queue << chunk->data;
+        _wake.wakeOne();
+    }
+    chunk->data = QByteArray();
+}
+
+void DataLogger::writeLoop()
+{
+    forever {
+        QByteArray chunk;
+        {
+            QMutexLocker locker(&_mutex);
+            while (_queue.isEmpty() && !_closing)
+                _wake.wait(&_mutex);
+            if (_queue.isEmpty())
+                return;
+            chunk = _queue.takeFirst();
+        }
+
+        // without the lock, the producer is never blocked by the disk
+        bool ok = _file.write(chunk) == chunk.size() && _file.flush();
+        if (ok)
+            _writtenBytes.fetchAndAddRelaxed(chunk.size());
+
+        QMutexLocker locker(&_mutex);
+        if (!ok && _error.isEmpty())
+            _error = _file.errorString();
+        _pendingBytes -= chunk.size();
+        chunk.resize(0);
+        _free << chunk;
+    }
+}
@@ -0,0 +1,153 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef DATALOGGER_HPP
+#define DATALOGGER_HPP
+
+#include <QAudioFormat>
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QAtomicInteger>
+#include <QList>
+#include "lockin_engine.hh"
+
+/* File format, append-only, in the byte order of the writer (the reader checks version)
+ *
+ *   LogFileHeader, followed by harmonicCount qint32 padded to 8 bytes (headerSize in total)
+ *   then chunks : LogChunkHeader followed by size bytes of payload padded to 8 bytes
+ *
+ * A values chunk holds count records of (1 + 4 * signalCount * harmonicCount) doubles :
+ * time, then x, y, r, theta of each harmonic of each signal channel. A raw chunk holds count frames
+ * of the sound card, in the format of the header, the first one being the
+ * frame number first since the start. Everything is aligned on 8 bytes so the
+ * file can be mapped and read in place, an incomplete chunk at the end
+ * (the program has been killed) is simply ignored.
+ */
+
+struct LogFileHeader
+{
+    char magic[8]; // "LOCKINLG"
+    quint32 version;
+    quint32 headerSize;
+    qint64 startTime; // ms since epoch, UTC
+    double integrationTime; // seconds
+    qint32 sampleRate;
+    qint32 channelCount;
+    qint32 sampleSize;
+    qint32 sampleType; // QAudioFormat::SampleType
+    qint32 byteOrder; // QAudioFormat::Endian
+    qint32 harmonicCount;
+    qint32 signalCount; // channelCount - 1 (channelCount with the internal reference), since version 2
+    qint32 referenceChannel; // since version 2, the version 1 has 1 signal and the reference on channel 1, -1 : internal reference
+};
+
+struct LogChunkHeader
+{
+    enum Type { Values = 1, Raw = 2 };
+
+    quint32 type;
+    quint32 reserved;
+    qint64 size; // payload bytes, without the padding
+    qint64 first; // index of the first record or frame
+    qint64 count; // number of records or frames
+};
+
+class DataLoggerThread;
+
+/* Writes the values and optionally the raw sound into a file
+ *
+ * The producer fills chunks in memory and hands them over to a background
+ * thread that does the writing, so it never waits for the disk. The chunks
+ * are recycled. If the disk cannot keep up and more than maxPending bytes
+ * are waiting, the new chunks are dropped and counted.
+ * The producer functions must be called from one thread at a time.
+ */
+
+class DataLogger
+{
+public:
+    DataLogger();
+    ~DataLogger();
+
+    bool open(const QString &fileName, const QAudioFormat &format, qreal integrationTime,
+              const QVector<int> &harmonics, bool raw, int referenceChannel = 1); // referenceChannel -1 : internal reference
+    void close(); // writes everything and waits for the background thread
+    bool isOpen() const;
+    bool logsRaw() const;
+    QString errorString() const;
+
+    void setMaxPending(qint64 bytes); // only while closed, 64 MB by default
+    qint64 maxPending() const;
+
+    // producer side
+    void appendValue(const LockinOutput &output);
+    void appendRaw(qint64 firstFrame, const char *first, qint64 firstSize,
+                   const char *second = nullptr, qint64 secondSize = 0); // whole frames
+    void flush(); // hands over the incomplete chunks
+
+    // statistics, from any thread
+    qint64 writtenBytes() const;
+    qint64 droppedChunks() const;
+
+private:
+    friend class DataLoggerThread;
+
+    struct Chunk
+    {
+        QByteArray data; // header followed by the payload
+        qint64 first;
+        qint64 count;
+        QElapsedTimer age;
+    };
+
+    void begin(Chunk *chunk, qint64 first);
+    void handOver(Chunk *chunk, LogChunkHeader::Type type);
+    void writeLoop(); // background thread
+
+    QFile _file;
+    QString _error;
+    bool _raw;
+    int _valueCount; // per record
+    int _frameSize;
+    qint64 _maxPending;
+
+    // producer side
+    Chunk _values;
+    Chunk _frames;
+    qint64 _valueIndex;
+
+    // shared with the background thread
+    mutable QMutex _mutex;
+    QWaitCondition _wake;
+    QList<QByteArray> _queue;
+    QList<QByteArray> _free;
+    qint64 _pendingBytes;
+    bool _closing;
+    DataLoggerThread *_thread;
+
+    QAtomicInteger<qint64> _writtenBytes;
+    QAtomicInteger<qint64> _droppedChunks;
+};
+
+#endif // DATALOGGER_HPP
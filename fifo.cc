@@ -1,18 +1,48 @@
 #include "fifo.hh"
+#include <cstring>
 
 Fifo::Fifo(QObject *parent) :
-    QIODevice(parent)
+    QIODevice(parent),
+    _mask(0), _head(0), _tail(0),
+    _highWaterMark(0), _overruns(0), _overrunBytes(0)
 {
+    setCapacity(1 << 20);
+}
+
+void Fifo::setCapacity(qint64 capacity)
+{
+    qint64 size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    if (size == _data.size()) {
+        clear();
+        return;
+    }
+
+    _data = QByteArray(int(size), Qt::Uninitialized);
+    _mask = size - 1;
+    clear();
+}
+
+qint64 Fifo::capacity() const
+{
+    return _data.size();
+}
+
+void Fifo::clear()
+{
+    _tail.storeRelease(_head.loadAcquire());
 }
 
 bool Fifo::atEnd() const
 {
-    return (_data.isEmpty() && QIODevice::atEnd());
+    return (bytesAvailable() == 0);
 }
 
 qint64 Fifo::bytesAvailable() const
 {
-    return _data.size() + QIODevice::bytesAvailable();
+    return (_head.loadAcquire() - _tail.loadAcquire()) + QIODevice::bytesAvailable();
 }
 
 bool Fifo::isSequential() const
@@ -20,18 +50,99 @@ bool Fifo::isSequential() const
     return true;
 }
 
+int Fifo::readSpans(Span spans[2], qint64 maxlen) const
+{
+    qint64 tail = _tail.loadAcquire();
+    qint64 len = _head.loadAcquire() - tail;
+    if (maxlen >= 0)
+        len = qMin(len, maxlen);
+
+    if (len <= 0)
+        return 0;
+
+    qint64 begin = tail & _mask;
+    qint64 first = qMin(len, _data.size() - begin);
+
+    spans[0].data = _data.constData() + begin;
+    spans[0].size = first;
+
+    if (first == len)
+        return 1;
+
+    spans[1].data = _data.constData();
+    spans[1].size = len - first;
+    return 2;
+}
+
+void Fifo::consume(qint64 len)
+{
+    qint64 tail = _tail.loadAcquire();
+    len = qMin(len, _head.loadAcquire() - tail);
+    if (len > 0)
+        _tail.storeRelease(tail + len);
+}
+
+qint64 Fifo::highWaterMark() const
+{
+    return _highWaterMark.loadAcquire();
+}
+
+qint64 Fifo::overruns() const
+{
+    return _overruns.loadAcquire();
+}
+
+qint64 Fifo::overrunBytes() const
+{
+    return _overrunBytes.loadAcquire();
+}
+
+void Fifo::resetStatistics()
+{
+    _highWaterMark.storeRelease(0);
+    _overruns.storeRelease(0);
+    _overrunBytes.storeRelease(0);
+}
+
 qint64 Fifo::readData(char *data, qint64 len)
 {
-    if ((len = qMin(len, qint64(_data.size()))) <= 0)
-        return qint64(0);
+    Span spans[2];
+    int n = readSpans(spans, len);
 
-    memcpy(data, _data.constData(), len);
-    _data = _data.right(_data.size() - len); // Main difference with QBuffer
-    return len;
+    qint64 read = 0;
+    for (int i = 0; i < n; ++i) {
+        memcpy(data + read, spans[i].data, spans[i].size);
+        read += spans[i].size;
+    }
+
+    consume(read);
+    return read;
 }
 
 qint64 Fifo::writeData(const char *data, qint64 len)
 {
-    _data.append(data, len);
+    qint64 head = _head.loadAcquire();
+    qint64 used = head - _tail.loadAcquire();
+
+    if (len > _data.size() - used) {
+        // drop the whole block rather than a part of a frame
+        _overruns.fetchAndAddRelaxed(1);
+        _overrunBytes.fetchAndAddRelaxed(len);
+        return len;
+    }
+
+    qint64 begin = head & _mask;
+    qint64 first = qMin(len, _data.size() - begin);
+    char *buffer = _data.data();
+
+    memcpy(buffer + begin, data, first);
+    memcpy(buffer, data + first, len - first);
+
+    _head.storeRelease(head + len);
+
+    used += len;
+    if (used > _highWaterMark.loadAcquire())
+        _highWaterMark.storeRelease(used);
+
     return len;
 }
@@ -25,29 +25,65 @@
 
 #include <QIODevice>
 #include <QByteArray>
+#include <QAtomicInteger>
 
-/* This class is similar to QBuffer
- * Except that it always read at the begining of the ByteArray
- * and free the memory after reading it
+/* Fixed capacity ring buffer behind a QIODevice interface
+ * It always writes at the end and reads at the begining
  *
- * Also it always write at the end
+ * Safe for exactly one producer (writeData) and one consumer
+ * (readData, readSpans, consume) running in different threads.
+ * The device must be opened with QIODevice::Unbuffered, otherwise
+ * QIODevice keeps its own copy of the data and the spans are wrong.
+ *
+ * A write that does not fit entirely is dropped and counted as an overrun,
+ * that way the stream stays aligned on the frames written by the producer.
  */
 
 class Fifo : public QIODevice
 {
     Q_OBJECT
 public:
+    struct Span {
+        const char *data;
+        qint64 size;
+    };
+
     explicit Fifo(QObject *parent = 0);
-    
+
+    // Cannot be called while a producer is writing, rounded up to a power of two
+    void setCapacity(qint64 capacity);
+    qint64 capacity() const;
+    void clear();
+
     bool atEnd() const override;
     qint64 bytesAvailable() const override;
     bool isSequential() const override;
 
+    // Zero copy read : up to two contiguous spans (the second when the data wraps)
+    // returns the number of spans filled, the data stays valid until consume()
+    int readSpans(Span spans[2], qint64 maxlen = -1) const;
+    void consume(qint64 len);
+
+    // Statistics to size the buffer
+    qint64 highWaterMark() const; // maximum number of bytes stored at the same time
+    qint64 overruns() const; // number of writes dropped because the buffer was full
+    qint64 overrunBytes() const;
+    void resetStatistics();
+
 private:
     qint64 readData(char *data, qint64 len) override;
     qint64 writeData(const char *data, qint64 len) override;
 
     QByteArray _data;
+    qint64 _mask;
+
+    // monotonic counters, position in _data is (counter & _mask)
+    QAtomicInteger<qint64> _head; // written by the producer
+    QAtomicInteger<qint64> _tail; // written by the consumer
+
+    QAtomicInteger<qint64> _highWaterMark;
+    QAtomicInteger<qint64> _overruns;
+    QAtomicInteger<qint64> _overrunBytes;
 };
 
 #endif // FIFO_HPP
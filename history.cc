@@ -0,0 +1,220 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "history.hh"
+#include "scopedecimator.hh"
+
+History::History(qint64 memoryLimit) :
+    _count(0)
+{
+    setMemoryLimit(memoryLimit);
+}
+
+void History::setMemoryLimit(qint64 bytes)
+{
+    // one raw value and one bucket per level for each entry of the rings
+    const qint64 entry = sizeof(QPointF) + Levels * sizeof(HistoryBucket);
+
+    _memoryLimit = bytes;
+    _capacity = int(qBound<qint64>(Factor, bytes / entry, 1 << 28));
+    clear();
+}
+
+qint64 History::memoryLimit() const
+{
+    return _memoryLimit;
+}
+
+void History::clear()
+{
+    // the rings grow up to _capacity, a short run doesn't take the whole memory limit
+    _raw.clear();
+    _count = 0;
+
+    for (int k = 0; k < Levels; ++k) {
+        _levels[k].ring.clear();
+        _levels[k].written = 0;
+        _levels[k].pendingCount = 0;
+    }
+}
+
+void History::append(qreal time, qreal value)
+{
+    if (_raw.size() < _capacity)
+        _raw.append(QPointF(time, value));
+    else
+        _raw[_count % _capacity] = QPointF(time, value);
+    _count++;
+
+    // sum up Factor entries of a level into one bucket of the level above
+    HistoryBucket bucket = { time, time, value, value, value };
+
+    for (int k = 0; k < Levels; ++k) {
+        Level &level = _levels[k];
+
+        if (level.pendingCount == 0) {
+            level.pending = bucket;
+        } else {
+            level.pending.end = bucket.end;
+            level.pending.min = qMin(level.pending.min, bucket.min);
+            level.pending.max = qMax(level.pending.max, bucket.max);
+            level.pending.mean += bucket.mean; // sum until the bucket is complete
+        }
+
+        if (++level.pendingCount < Factor)
+            break;
+
+        // all the buckets of a level hold the same number of values, the mean of the means is exact
+        level.pending.mean /= qreal(Factor);
+        level.pendingCount = 0;
+        bucket = level.pending;
+        push(k + 1, bucket);
+    }
+}
+
+qint64 History::count() const
+{
+    return _count;
+}
+
+bool History::isEmpty() const
+{
+    return _count == 0;
+}
+
+qreal History::firstTime() const
+{
+    qreal first = isEmpty() ? 0.0 : at(0, 0).begin;
+    for (int level = 1; level <= Levels; ++level) {
+        if (size(level) > 0)
+            first = qMin(first, at(level, 0).begin);
+    }
+    return first;
+}
+
+qreal History::lastTime() const
+{
+    return isEmpty() ? 0.0 : at(0, size(0) - 1).end;
+}
+
+void History::query(qreal tmin, qreal tmax, int maxBuckets, QVector<HistoryBucket> *buckets) const
+{
+    buckets->clear();
+
+    if (isEmpty() || tmax < tmin)
+        return;
+
+    // the finest level that still holds tmin and has few enough entries in the range
+    int level = 0;
+    for (; level < Levels; ++level) {
+        const qint64 written = level == 0 ? _count : _levels[level - 1].written;
+        const bool covers = size(level) > 0 && (written <= _capacity || at(level, 0).begin <= tmin);
+
+        if (covers && upperBound(level, tmax) - lowerBound(level, tmin) <= maxBuckets)
+            break;
+    }
+
+    // then the recent values that are not summed up yet, they come from the finer levels
+    for (int l = level; l >= 0; --l) {
+        int begin = lowerBound(l, tmin);
+        if (l < level && size(l + 1) > 0)
+            begin = qMax(begin, upperBound(l, at(l + 1, size(l + 1) - 1).end));
+        const int end = upperBound(l, tmax);
+
+        for (int i = begin; i < end; ++i)
+            buckets->append(at(l, i));
+    }
+}
+
+void History::trace(qreal tmin, qreal tmax, int columns, QList<QPointF> *points) const
+{
+    query(tmin, tmax, qMax(1, columns), &_buckets);
+
+    PointWriter out(points);
+    for (int i = 0; i < _buckets.size(); ++i) {
+        const HistoryBucket &bucket = _buckets[i];
+
+        if (bucket.begin == bucket.end) {
+            // raw value
+            out.put(bucket.begin, bucket.mean);
+        } else {
+            qreal t = 0.5 * (bucket.begin + bucket.end);
+            out.put(t, bucket.min);
+            if (bucket.max != bucket.min)
+                out.put(t, bucket.max);
+        }
+    }
+}
+
+int History::size(int level) const
+{
+    return level == 0 ? _raw.size() : _levels[level - 1].ring.size();
+}
+
+HistoryBucket History::at(int level, int index) const
+{
+    if (level == 0) {
+        const QPointF &p = _raw[(_count - _raw.size() + index) % _capacity];
+        HistoryBucket bucket = { p.x(), p.x(), p.y(), p.y(), p.y() };
+        return bucket;
+    }
+
+    const Level &l = _levels[level - 1];
+    return l.ring[(l.written - l.ring.size() + index) % _capacity];
+}
+
+int History::lowerBound(int level, qreal time) const
+{
+    int lo = 0, hi = size(level);
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (at(level, mid).end < time)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+int History::upperBound(int level, qreal time) const
+{
+    int lo = 0, hi = size(level);
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (at(level, mid).begin <= time)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+void History::push(int level, const HistoryBucket &bucket)
+{
+    Level &l = _levels[level - 1];
+
+    if (l.ring.size() < _capacity)
+        l.ring.append(bucket);
+    else
+        l.ring[l.written % _capacity] = bucket;
+    l.written++;
+}
@@ -0,0 +1,99 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef HISTORY_HPP
+#define HISTORY_HPP
+
+#include <QVector>
+#include <QList>
+#include <QPointF>
+
+struct HistoryBucket
+{
+    qreal begin; // time of the first value
+    qreal end; // time of the last value
+    qreal min;
+    qreal mean;
+    qreal max;
+};
+
+/* Bounded history of the measures
+ *
+ * The recent values are kept as they are in a ring. Older values survive in
+ * Levels rings of buckets, each bucket of level k sums up Factor buckets of
+ * level k-1 (min, mean and max). All the rings have the same number of
+ * entries, chosen from the memory limit, so the memory doesn't grow with
+ * the duration of the run while the whole run stays visible at low resolution.
+ * The times must be appended in increasing order.
+ */
+
+class History
+{
+public:
+    History(qint64 memoryLimit = 64 << 20);
+
+    void setMemoryLimit(qint64 bytes); // clears the history
+    qint64 memoryLimit() const;
+
+    void clear();
+    void append(qreal time, qreal value);
+
+    qint64 count() const; // number of values appended since clear()
+    bool isEmpty() const;
+    qreal firstTime() const; // oldest time still in the history
+    qreal lastTime() const;
+
+    // the range [tmin, tmax] at the finest resolution with at most about maxBuckets buckets
+    void query(qreal tmin, qreal tmax, int maxBuckets, QVector<HistoryBucket> *buckets) const;
+
+    // same for a plot of columns pixels : min and max of the buckets, the points are written in place
+    void trace(qreal tmin, qreal tmax, int columns, QList<QPointF> *points) const;
+
+private:
+    enum { Levels = 6, Factor = 16 };
+
+    struct Level
+    {
+        QVector<HistoryBucket> ring;
+        qint64 written; // number of buckets pushed in the ring
+        HistoryBucket pending; // bucket being filled by the level below
+        int pendingCount;
+    };
+
+    // level 0 is the raw ring, the others are in _levels[level - 1]
+    int size(int level) const;
+    HistoryBucket at(int level, int index) const; // index 0 is the oldest
+    int lowerBound(int level, qreal time) const; // first entry that ends at or after time
+    int upperBound(int level, qreal time) const; // first entry that begins after time
+    void push(int level, const HistoryBucket &bucket);
+
+    qint64 _memoryLimit;
+    int _capacity; // entries per ring
+
+    QVector<QPointF> _raw;
+    qint64 _count;
+    Level _levels[Levels];
+
+    mutable QVector<HistoryBucket> _buckets; // for trace()
+};
+
+#endif // HISTORY_HPP
@@ -0,0 +1,23 @@
+QT += multimedia
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = lockin-bench
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include($$PWD/lockin_core.pri)
+
+SOURCES += $$PWD/lockin_worker.cc \
+    $$PWD/lockin.cc \
+    $$PWD/lockinmanager.cc \
+    $$PWD/syntheticsource.cc \
+    $$PWD/lockin_bench.cc
+
+HEADERS += $$PWD/triplebuffer.hh \
+    $$PWD/spscqueue.hh \
+    $$PWD/lockin_worker.hh \
+    $$PWD/lockin.hh \
+    $$PWD/lockinmanager.hh \
+    $$PWD/syntheticsource.hh
@@ -0,0 +1,17 @@
+QT += multimedia
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = lockin-cli
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include($$PWD/lockin_core.pri)
+
+SOURCES += $$PWD/pcmfile.cc \
+    $$PWD/batchprocessor.cc \
+    $$PWD/lockin_cli.cc
+
+HEADERS += $$PWD/pcmfile.hh \
+    $$PWD/batchprocessor.hh
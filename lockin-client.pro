@@ -0,0 +1,14 @@
+QT += multimedia
+QT += network
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = lockin-client
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += $$PWD/lockinprotocol.cc \
+    $$PWD/lockin_client.cc
+
+HEADERS += $$PWD/lockinprotocol.hh
@@ -0,0 +1,24 @@
+QT += multimedia
+QT += network
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = lockin-daemon
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include($$PWD/lockin_core.pri)
+
+SOURCES += $$PWD/lockin_worker.cc \
+    $$PWD/lockin.cc \
+    $$PWD/lockinprotocol.cc \
+    $$PWD/lockinserver.cc \
+    $$PWD/lockin_daemon.cc
+
+HEADERS += $$PWD/triplebuffer.hh \
+    $$PWD/spscqueue.hh \
+    $$PWD/lockin_worker.hh \
+    $$PWD/lockin.hh \
+    $$PWD/lockinprotocol.hh \
+    $$PWD/lockinserver.hh
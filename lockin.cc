@@ -21,50 +21,110 @@
 ****************************************************************************/
 
 #include "lockin.hh"
+#include "lockin_worker.hh"
 #include "fifo.hh"
-#include <cmath>
+#include "pcmdecoder.hh"
 #include <QDebug>
-#include <QDataStream>
 
 Lockin::Lockin(QObject *parent) :
     QObject(parent)
 {
-    _fifo = new Fifo(this);
-    _fifo->open(QIODevice::ReadWrite);
+    init(&_thread, nullptr);
+    connect(&_thread, SIGNAL(finished()), _worker, SLOT(deleteLater()));
+    _thread.start(QThread::TimeCriticalPriority);
+}
 
-    _audioInput = nullptr;
+Lockin::Lockin(QThread *acquisition, WorkStealingPool *pool, QObject *parent) :
+    QObject(parent)
+{
+    init(acquisition, pool);
+}
 
-    _invertLR = false;
+void Lockin::init(QThread *acquisition, WorkStealingPool *pool)
+{
+    _worker = new LockinWorker;
+    _worker->setPool(pool);
+    _worker->moveToThread(acquisition);
+    connect(_worker, SIGNAL(ready()), this, SLOT(collect()));
+    connect(_worker, SIGNAL(finished()), this, SLOT(replayFinished()));
+    connect(_worker, SIGNAL(phasesChanged(QVector<qreal>)), this, SLOT(updatePhases(QVector<qreal>)));
+
+    qRegisterMetaType<LockinValue>();
+    qRegisterMetaType<QVector<LockinValue>>();
+    qRegisterMetaType<QVector<qreal>>();
+
+    _running = false;
+    _priority = WorkStealingPool::Normal;
+    _referenceChannel = 1;
+    _referenceFrequency = 0.0;
+    _measuredFrequency = 0.0;
     setIntegrationTime(3.0);
+    _filter = LowPassFilter::Boxcar;
+    _decimatedRate = 0.0;
+    _precision = LockinEngine::Double;
+    _harmonics << 1;
 }
 
 Lockin::~Lockin()
 {
     if (isRunning())
         stop();
+
+    if (_thread.isRunning()) {
+        _thread.quit();
+        _thread.wait();
+    } else {
+        // in the shared thread, deleted at the latest when it finishes
+        _worker->deleteLater();
+    }
 }
 
 bool Lockin::isRunning() const
 {
-    return _audioInput != nullptr;
+    return _running;
 }
 
 bool Lockin::isFormatSupported(const QAudioFormat &format)
 {
-    if (format.codec() != "audio/pcm") {
+    if (_referenceFrequency > 0.0) {
+        // no chopper channel
+        if (format.channelCount() < 1 || _referenceFrequency >= 0.5 * format.sampleRate())
+            return false;
+    } else if (format.channelCount() < 2 || _referenceChannel >= format.channelCount()) {
         return false;
     }
 
-    if (format.channelCount() != 2) {
+    return PcmDecoder<qreal>::isFormatSupported(format);
+}
+
+bool Lockin::start(const QAudioDeviceInfo &audioDevice, const QAudioFormat &format, int output_period)
+{
+    if (!canStart(format))
+        return false;
+
+    _worker->setReplaySource(nullptr, true);
+    _worker->configure(audioDevice, format, output_period, _integrationTime, _filter, _decimatedRate, _harmonics, _referenceChannel, _referenceFrequency, _precision);
+    return startWorker(format);
+}
+
+bool Lockin::start(QIODevice *source, const QAudioFormat &format, int output_period, bool realTime)
+{
+    if (!canStart(format))
+        return false;
+
+    if (source == nullptr || !source->isReadable()) {
+        qDebug() << __FUNCTION__ << ": replay source not readable";
         return false;
     }
 
-    return true;
+    _worker->setReplaySource(source, realTime);
+    _worker->configure(QAudioDeviceInfo(), format, output_period, _integrationTime, _filter, _decimatedRate, _harmonics, _referenceChannel, _referenceFrequency, _precision);
+    return startWorker(format);
 }
 
-bool Lockin::start(const QAudioDeviceInfo &audioDevice, const QAudioFormat &format, int output_period)
+bool Lockin::canStart(const QAudioFormat &format)
 {
-    if (_audioInput != 0) {
+    if (_running) {
         qDebug() << __FUNCTION__ << ": lockin is already running, please stop is before start";
         return false;
     }
@@ -79,31 +139,24 @@ bool Lockin::start(const QAudioDeviceInfo &audioDevice, const QAudioFormat &form
         return false;
     }
 
-    _audioInput = new QAudioInput(audioDevice, format, this);
-    _audioInput->setNotifyInterval(output_period);
-
-    connect(_audioInput, SIGNAL(notify()), this, SLOT(interpretInput()));
-
-    // pour être au millieu avec le temps
-    _timeValue = 0;
-
-    // nombre d'échantillons pour le temps d'integration
-    _sampleIntegration = format.sampleRate() * _integrationTime;
-
-    // nettoyage des variables
-    _fifo->readAll(); // vide le fifo
-    _measures.clear(); // vide <x,y>
+    return true;
+}
 
+bool Lockin::startWorker(const QAudioFormat &format)
+{
     _format = format;
+    _measuredFrequency = 0.0;
 
-    _audioInput->start(_fifo);
+    bool ok = false;
+    QMetaObject::invokeMethod(_worker, "start", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, ok));
+    _running = ok;
 
-    return true;
+    return ok;
 }
 
 void Lockin::setIntegrationTime(qreal integrationTime)
 {
-    Q_ASSERT(_audioInput == 0);
+    Q_ASSERT(!_running);
     _integrationTime = integrationTime;
 }
 
@@ -112,261 +165,243 @@ qreal Lockin::integrationTime() const
     return _integrationTime;
 }
 
+void Lockin::setFilter(LowPassFilter::Type filter)
+{
+    Q_ASSERT(!_running);
+    _filter = filter;
+}
+
+LowPassFilter::Type Lockin::filter() const
+{
+    return _filter;
+}
+
+void Lockin::setDecimatedRate(qreal rate)
+{
+    Q_ASSERT(!_running);
+    _decimatedRate = rate;
+}
+
+qreal Lockin::decimatedRate() const
+{
+    return _decimatedRate;
+}
+
+void Lockin::setPrecision(LockinEngine::Precision precision)
+{
+    Q_ASSERT(!_running);
+    _precision = precision;
+}
+
+LockinEngine::Precision Lockin::precision() const
+{
+    return _precision;
+}
+
 void Lockin::setInvertLR(bool on)
 {
-    _invertLR = on;
+    _worker->setInvertLR(on);
 }
 
-const QVector<QPair<qreal, qreal>> &Lockin::raw_signals() const
+void Lockin::setPriority(WorkStealingPool::Priority priority)
 {
-    return _left_right;
+    _priority = priority;
+    _worker->setPriority(priority);
 }
 
-const QVector<std::complex<qreal> > &Lockin::complex_exp_signal() const
+WorkStealingPool::Priority Lockin::priority() const
 {
-    return _complex_exp;
+    return _priority;
 }
 
-const QAudioFormat &Lockin::format() const
+bool Lockin::setHarmonics(const QVector<int> &harmonics)
 {
-    return _format;
+    Q_ASSERT(!_running);
+    if (!LockinEngine::isValidHarmonics(harmonics))
+        return false;
+    _harmonics = harmonics;
+    return true;
 }
 
-void Lockin::stop()
+const QVector<int> &Lockin::harmonics() const
 {
-    if (_audioInput != nullptr) {
-        _audioInput->stop();
-        delete _audioInput;
-        _audioInput = nullptr;
-    } else {
-        qDebug() << __FUNCTION__ << ": lockin is not running";
-    }
+    return _harmonics;
 }
 
-void Lockin::interpretInput()
+void Lockin::setReferenceChannel(int channel)
 {
-    // récupère les nouvelles valeurs
-    /*
-     * le nombre de nouvelle valeurs = outputPeriod * sampleRate / 1000
-     * outputPeriod (~0.1 s) étant beaucoup plus grand que la periode du chopper (~1/500 s)
-     * meme dans le cas d'un chopper lent et d'un temps de sortie rapide le nombre de periodes
-     * du chopper reste elevé. (~50)
-     * On peut donc garder uniquement les periodes entières
-     * On a donc une perte de présision de l'ordre de 2/50 = 4%
-     * Plus outputPeriod et grand et plus le chopper est rapide plus la perte diminue.
-     * 0.5s 500Hz -> 0.8%
-     * 1.0s 500Hz -> 0.4%
-     */
+    Q_ASSERT(!_running);
+    Q_ASSERT(channel >= 0);
+    _referenceChannel = channel;
+}
 
-    _left_right.clear();
+int Lockin::referenceChannel() const
+{
+    return _referenceChannel;
+}
 
-    // load audio channels and cast them in the interval (-1, 1)
-    readSoudCard();
+void Lockin::setReferenceFrequency(qreal frequency)
+{
+    Q_ASSERT(!_running);
+    _referenceFrequency = qMax<qreal>(0.0, frequency);
+}
 
-    if (_left_right.empty()) {
-        qDebug() << __FUNCTION__ << ": empty channels";
-        return;
-    }
+qreal Lockin::referenceFrequency() const
+{
+    return _referenceFrequency;
+}
+
+qreal Lockin::measuredFrequency() const
+{
+    return _measuredFrequency;
+}
 
-    qreal delta_t = qreal(_left_right.size()) / qreal(_format.sampleRate());
-    _timeValue += delta_t;
+int Lockin::signalCount() const
+{
+    return _referenceFrequency > 0.0 ? channelCount() : channelCount() - 1;
+}
 
-	parseChopperSignal();
-    emit newRawData();
+void Lockin::setLogger(DataLogger *logger)
+{
+    Q_ASSERT(!_running);
+    _worker->setLogger(logger);
+}
 
-    for (int i = 0; i < _left_right.size(); ++i) {
-        std::complex<qreal> x = _complex_exp[i] * _left_right[i].first;
+void Lockin::setPublisher(ShmPublisher *publisher)
+{
+    Q_ASSERT(!_running);
+    _worker->setPublisher(publisher);
+}
 
-        if (!std::isnan(x.real()) && !std::isnan(x.imag())) {
-            _measures << x;
-        }
-    }
+void Lockin::setPhases(const QVector<qreal> &phases)
+{
+    // the engine belongs to the acquisition thread
+    QMetaObject::invokeMethod(_worker, "setPhases", Qt::QueuedConnection, Q_ARG(QVector<qreal>, phases));
+}
 
-    // stop if there is not enough values into data xy
-    if (_measures.size() < _sampleIntegration) {
+const QVector<qreal> &Lockin::phases() const
+{
+    return _phases;
+}
+
+void Lockin::autoPhase()
+{
+    if (!_running) {
+        qDebug() << __FUNCTION__ << ": lockin is not running";
         return;
     }
+    QMetaObject::invokeMethod(_worker, "autoPhase", Qt::QueuedConnection);
+}
 
-    // remove the old unneeded values
-    while (_measures.size() > _sampleIntegration)
-        _measures.removeFirst();
+const QVector<qreal> &Lockin::raw_channel(int channel) const
+{
+    static const QVector<qreal> empty;
 
-    std::complex<qreal> x = 0.0;
+    // the scope is empty until the first block
+    const QVector<QVector<qreal>> &channels = _worker->scope().front().channels;
+    return channel >= 0 && channel < channels.size() ? channels[channel] : empty;
+}
 
-    for (int i = 0; i < _measures.size(); ++i) {
-        x += _measures[i];
-    }
+const QVector<qreal> &Lockin::raw_left() const
+{
+    return raw_channel(_referenceFrequency <= 0.0 && _referenceChannel == 0 ? 1 : 0);
+}
 
-    x /= qreal(_sampleIntegration);
+const QVector<qreal> &Lockin::raw_right() const
+{
+    return raw_channel(_referenceFrequency > 0.0 ? -1 : _referenceChannel);
+}
 
-    emit newValue(_timeValue, std::abs(x));
+const QVector<qreal> &Lockin::reference_cos() const
+{
+    return _worker->scope().front().cos;
 }
 
-void Lockin::readSoudCard()
+const QVector<qreal> &Lockin::reference_sin() const
 {
-    qreal middle = 0;
+    return _worker->scope().front().sin;
+}
 
-    switch (_format.sampleSize()) {
-    case 8:
-        middle = 128;
-        Q_ASSERT(_fifo->bytesAvailable() % 2 == 0);
-        break;
-    case 16:
-        middle = 32768;
-        Q_ASSERT((_fifo->bytesAvailable() / 2) % 2 == 0);
-        break;
-    case 32:
-        middle = 2147483648;
-        Q_ASSERT((_fifo->bytesAvailable() / 4) % 2 == 0);
-        break;
-    }
+const QAudioFormat &Lockin::format() const
+{
+    return _format;
+}
 
-    QDataStream in(_fifo);
-    in.setByteOrder(QDataStream::ByteOrder(_format.byteOrder()));
-
-    float _float;
-    qint8 _int8;
-    qint16 _int16;
-    qint32 _int32;
-    quint8 _uint8;
-    quint16 _uint16;
-    quint32 _uint32;
-    QPair<qreal,qreal> pair;
-
-    switch (_format.sampleType()) {
-    case QAudioFormat::Float:
-        while (!in.atEnd()) {
-            in >> _float;
-            pair.first = _float;
-            in >> _float;
-            pair.second = _float;
-            if (_invertLR) {
-                std::swap(pair.first, pair.second);
-            }
-            _left_right.append(pair);
-        }
-        break;
-    case QAudioFormat::SignedInt:
-        switch (_format.sampleSize()) {
-        case 8:
-            while (!in.atEnd()) {
-                in >> _int8;
-                pair.first = qreal(_int8) / middle;
-                in >> _int8;
-                pair.second = qreal(_int8) / middle;
-                if (_invertLR) {
-                    std::swap(pair.first, pair.second);
-                }
-                _left_right.append(pair);
-            }
-            break;
-        case 16:
-            while (!in.atEnd()) {
-                in >> _int16;
-                pair.first = qreal(_int16) / middle;
-                in >> _int16;
-                pair.second = qreal(_int16) / middle;
-                if (_invertLR) {
-                    std::swap(pair.first, pair.second);
-                }
-                _left_right.append(pair);
-            }
-            break;
-        case 32:
-            while (!in.atEnd()) {
-                in >> _int32;
-                pair.first = qreal(_int32) / middle;
-                in >> _int32;
-                pair.second = qreal(_int32) / middle;
-                if (_invertLR) {
-                    std::swap(pair.first, pair.second);
-                }
-                _left_right.append(pair);
-            }
-            break;
-        }
-        break;
-    case QAudioFormat::UnSignedInt:
-        switch (_format.sampleSize()) {
-        case 8:
-            while (!in.atEnd()) {
-                in >> _uint8;
-                pair.first = (qreal(_uint8) / middle) - 1.0;
-                in >> _uint8;
-                pair.second = (qreal(_uint8) / middle) - 1.0;
-                if (_invertLR) {
-                    std::swap(pair.first, pair.second);
-                }
-                _left_right.append(pair);
-            }
-            break;
-        case 16:
-            while (!in.atEnd()) {
-                in >> _uint16;
-                pair.first = (qreal(_uint16) / middle) - 1.0;
-                in >> _uint16;
-                pair.second = (qreal(_uint16) / middle) - 1.0;
-                if (_invertLR) {
-                    std::swap(pair.first, pair.second);
-                }
-                _left_right.append(pair);
-            }
-            break;
-        case 32:
-            while (!in.atEnd()) {
-                in >> _uint32;
-                pair.first = (qreal(_uint32) / middle) - 1.0;
-                in >> _uint32;
-                pair.second = (qreal(_uint32) / middle) - 1.0;
-                if (_invertLR) {
-                    std::swap(pair.first, pair.second);
-                }
-                _left_right.append(pair);
-            }
-            break;
-        }
-        break;
-    case QAudioFormat::Unknown:
-        break;
-    }
+int Lockin::channelCount() const
+{
+    return _format.channelCount();
 }
 
-void Lockin::parseChopperSignal()
+const Fifo *Lockin::fifo() const
 {
-    _complex_exp.clear();
+    return _worker->fifo();
+}
 
-    int i = 0;
+qint64 Lockin::droppedBlocks() const
+{
+    return _worker->fifo()->overruns();
+}
+
+qint64 Lockin::lateBlocks() const
+{
+    return _worker->lateBlocks();
+}
+
+qint64 Lockin::droppedValues() const
+{
+    return _worker->droppedValues();
+}
 
-    // set the first value as ignored
-    _complex_exp << NAN;
-    i++;
+const LockinStats &Lockin::stats() const
+{
+    return _worker->stats();
+}
 
-    for (; i < _left_right.size(); ++i) {
-        if (_left_right[i-1].second < 0.0 && _left_right[i].second >= 0.0) {
-            // first rising edge
-            break;
-        }
-        _complex_exp << NAN;
+void Lockin::stop()
+{
+    if (_running) {
+        QMetaObject::invokeMethod(_worker, "stop", Qt::BlockingQueuedConnection);
+        _running = false;
+    } else {
+        qDebug() << __FUNCTION__ << ": lockin is not running";
     }
+}
 
-    int periodSize = 0;
-    for (; i < _left_right.size(); ++i) {
-        periodSize++;
-        if (_left_right[i-1].second < 0.0 && _left_right[i].second >= 0.0) {
-            // rising edge
+void Lockin::collect()
+{
+    StageClock clock;
+    clock.start();
 
-            for (int j = 0; j < periodSize; ++j) {
-                qreal angle = 2.0 * M_PI * qreal(j) / qreal(periodSize);
-                _complex_exp << std::exp(std::complex<qreal>(0.0, 1.0) * angle);
-            }
+    // acknowledge first, so results published while collecting trigger a new call
+    _worker->acknowledge();
 
-            periodSize = 0;
-        }
+    LockinOutput output;
+    while (_worker->outputs().pop(&output)) {
+        _measuredFrequency = output.frequency;
+        emit newValue(output.time, output.value);
+        emit newValues(output.time, output.values);
+
+        const int harmonics = _harmonics.size();
+        for (int m = 0; m < output.values.size(); m += harmonics)
+            emit newChannelValue(output.values[m].channel, output.time, output.values[m]);
     }
 
-    for (int j = 0; j < periodSize; ++j) {
-        _complex_exp << NAN;
+    if (_worker->scope().update()) {
+        emit newRawData();
     }
 
-    Q_ASSERT(_complex_exp.size() == _left_right.size());
+    _worker->stats().add(LockinStats::Gui, clock.lap());
+}
+
+void Lockin::updatePhases(const QVector<qreal> &phases)
+{
+    _phases = phases;
+    emit phasesChanged(_phases);
+}
+
+void Lockin::replayFinished()
+{
+    // queued after the last ready(), all the values are already collected
+    _running = false;
+    emit finished();
 }
@@ -24,15 +24,30 @@
 #define LOCKIN_HPP
 
 #include <QAudioInput>
+#include <QThread>
 #include <QVector>
-#include <complex>
+#include "lockin_engine.hh"
+#include "lockinstats.hh"
+#include "workstealingpool.hh"
 
 class Fifo;
+class LockinWorker;
+class DataLogger;
+class ShmPublisher;
+
+/* The acquisition and the signal processing run in a dedicated thread (LockinWorker)
+ * the signals of this class are emitted in the thread of the Lockin object
+ *
+ * Several lockins can share the acquisition thread and process in a pool instead,
+ * see LockinManager.
+ */
 
 class Lockin : public QObject {
     Q_OBJECT
 public:
     explicit Lockin(QObject *parent = 0);
+    // the acquisition thread is started by the caller and outlives the Lockin, the processing runs in pool
+    Lockin(QThread *acquisition, WorkStealingPool *pool, QObject *parent = 0);
     ~Lockin();
 
     bool isRunning() const;
@@ -40,43 +55,89 @@ public:
 
     // Cannot be called when running
     bool start(const QAudioDeviceInfo &audioDevice, const QAudioFormat &format, int output_period = 500);
+    // replay of recorded frames (e.g. LogReplayDevice) instead of the sound card, from the current position,
+    // the source is read by the acquisition thread until finished() or stop()
+    bool start(QIODevice *source, const QAudioFormat &format, int output_period = 500, bool realTime = true);
     void setOutputPeriod(qreal outputPeriod);
     qreal outputPeriod() const;
     void setIntegrationTime(qreal integrationTime);
     qreal integrationTime() const;
+    void setFilter(LowPassFilter::Type filter); // low pass after the demodulation, Boxcar by default
+    LowPassFilter::Type filter() const;
+    void setDecimatedRate(qreal rate); // the demodulated values are decimated down to rate before the filter, 0 : full rate
+    qreal decimatedRate() const;
+    void setPrecision(LockinEngine::Precision precision); // of the processing, see LockinEngine, Double by default
+    LockinEngine::Precision precision() const;
     void setInvertLR(bool on);
-
-    const QVector<QPair<qreal, qreal>> &raw_signals() const;
-    const QVector<std::complex<qreal> > &complex_exp_signal() const;
+    void setPriority(WorkStealingPool::Priority priority); // in the pool, at any time, no effect without pool
+    WorkStealingPool::Priority priority() const;
+    bool setHarmonics(const QVector<int> &harmonics); // harmonics of the chopper to demodulate, {1} by default, false unless LockinEngine::isValidHarmonics()
+    const QVector<int> &harmonics() const;
+    void setReferenceChannel(int channel); // channel of the chopper, 1 by default, the other ones are signals
+    int referenceChannel() const;
+    // > 0 : internal reference at this frequency in Hz instead of the chopper, all the channels are signals
+    // 0 : chopper on referenceChannel() (default)
+    void setReferenceFrequency(qreal frequency);
+    qreal referenceFrequency() const;
+    qreal measuredFrequency() const; // of the reference as of the last value, 0 if the chopper is not locked
+    int signalCount() const; // channels demodulated
+    void setLogger(DataLogger *logger); // opened by the caller, written from the acquisition thread, null to log nothing
+    void setPublisher(ShmPublisher *publisher); // same for the shared memory
+    // rotation of the reference of each value of newValues() in radians, at any time, effective for the next values
+    void setPhases(const QVector<qreal> &phases);
+    const QVector<qreal> &phases() const; // as of the last phasesChanged()
+    void autoPhase(); // while running, rotates each reference so that its last value is in x (theta = 0)
+
+    // snapshot of the begining of the last block, valid until the next newRawData()
+    const QVector<qreal> &raw_channel(int channel) const;
+    const QVector<qreal> &raw_left() const; // first signal channel
+    const QVector<qreal> &raw_right() const; // chopper, empty with the internal reference
+    const QVector<qreal> &reference_cos() const; // NaN where the chopper phase is unknown
+    const QVector<qreal> &reference_sin() const;
     const QAudioFormat &format() const;
+    int channelCount() const;
+    const Fifo *fifo() const; // buffer statistics
+    qint64 droppedBlocks() const; // audio blocks lost because the fifo was full
+    qint64 lateBlocks() const; // blocks processed late
+    qint64 droppedValues() const; // values computed but lost because this thread was too slow to collect them
+    const LockinStats &stats() const; // timings of the hot path, empty without LOCKIN_STATS
     void stop();
 
 signals:
     void newRawData();
-    void newValue(qreal time, qreal measure);
+    void newValue(qreal time, const LockinValue &value); // first signal channel at the first harmonic
+    void newChannelValue(int channel, qreal time, const LockinValue &value); // each signal channel at the first harmonic
+    void newValues(qreal time, const QVector<LockinValue> &values); // one per signal channel and harmonic
+    void finished(); // end of the replay source
+    void phasesChanged(const QVector<qreal> &phases);
 
 private slots:
-    void interpretInput();
+    void collect();
+    void updatePhases(const QVector<qreal> &phases);
+    void replayFinished();
 
 private:
-	void readSoudCard(); // write into _left_right
-    void parseChopperSignal(); // write into _complex_exp
+    void init(QThread *acquisition, WorkStealingPool *pool);
+    bool canStart(const QAudioFormat &format);
+    bool startWorker(const QAudioFormat &format);
 
-
-    QAudioInput *_audioInput; // is null when lockin stoped
-    Fifo *_fifo; // feeded by _audioInput
+    QThread _thread; // not started when the acquisition thread is shared
+    LockinWorker *_worker; // lives in _thread or in the shared one
+    bool _running;
+    WorkStealingPool::Priority _priority;
 
     QAudioFormat _format; // don't change it during running
-
-    bool _invertLR;
     qreal _integrationTime; // don't change it during running
-    int _sampleIntegration; // don't change it during running
-
-    QVector<QPair<qreal, qreal>> _left_right; // raw signal
-    QVector<std::complex<qreal>> _complex_exp; // sin/cos constructed from right signal
-    QList<std::complex<qreal>> _measures; // product of left signal with sin/cos
-
-    qreal _timeValue;
+    LowPassFilter::Type _filter; // don't change it during running
+    qreal _decimatedRate; // don't change it during running
+    LockinEngine::Precision _precision; // don't change it during running
+    QVector<int> _harmonics; // don't change it during running
+    int _referenceChannel; // don't change it during running
+    qreal _referenceFrequency; // don't change it during running
+    qreal _measuredFrequency;
+    QVector<qreal> _phases;
 };
 
+Q_DECLARE_METATYPE(LockinValue)
+
 #endif // LOCKIN_HPP
@@ -1,11 +1,20 @@
 include($$PWD/xygraph/xygraph.pri)
+include($$PWD/lockin_core.pri)
 
-SOURCES += $$PWD/fifo.cc \
+SOURCES += $$PWD/lockin_worker.cc \
+    $$PWD/scopedecimator.cc \
+    $$PWD/history.cc \
     $$PWD/lockin_gui.cc \
-    $$PWD/lockin.cc
+    $$PWD/lockin.cc \
+    $$PWD/lockinmanager.cc
 
-HEADERS += $$PWD/fifo.hh \
+HEADERS += $$PWD/triplebuffer.hh \
+    $$PWD/spscqueue.hh \
+    $$PWD/lockin_worker.hh \
+    $$PWD/scopedecimator.hh \
+    $$PWD/history.hh \
     $$PWD/lockin_gui.hh \
-    $$PWD/lockin.hh
+    $$PWD/lockin.hh \
+    $$PWD/lockinmanager.hh
 
 FORMS += $$PWD/lockin_gui.ui
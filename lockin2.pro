@@ -0,0 +1,12 @@
+# the GUI, the command line tools and the tests : qmake lockin2.pro && make && make check
+TEMPLATE = subdirs
+
+# the projects of this directory share their object files, one after the other
+CONFIG += ordered
+
+SUBDIRS += lockin.pro \
+    lockin-cli.pro \
+    lockin-daemon.pro \
+    lockin-client.pro \
+    lockin-bench.pro \
+    tests
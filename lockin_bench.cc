@@ -0,0 +1,402 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+/* Benchmark of the whole processing on a synthetic source (see syntheticsource.hh)
+ *
+ * Each stage of LockinWorker::interpretInput() is timed on its own (decode = readSoudCard(),
+ * reference = parseChopperSignal(), demodulate, integrate) then the whole pipeline through
+ * a Lockin, acquisition thread included, or through --instances lockins at the same time in a
+ * LockinManager. The recording is generated in memory before the
+ * timings. Best of --repeat runs, in ns per sample and MSamples/s (a sample is one channel
+ * of one frame). The table is tab separated, --json writes the same into a file to compare
+ * two builds.
+ */
+
+#include "lockin.hh"
+#include "lockinmanager.hh"
+#include "fifo.hh"
+#include "syntheticsource.hh"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QBuffer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <cmath>
+
+namespace {
+
+enum Stage { Decode, Reference, Demodulate, Integrate, Engine, Pipeline, StageCount };
+
+const char *const stageNames[StageCount] = { "decode", "reference", "demodulate", "integrate", "engine", "pipeline" };
+
+struct Settings {
+    QAudioFormat format;
+    qint64 frames;
+    int blockFrames;
+    qreal integrationTime;
+    LowPassFilter::Type filter;
+    qreal decimatedRate;
+    QVector<int> harmonics;
+    qreal referenceFrequency; // 0 : chopper
+    LockinEngine::Precision precision;
+};
+
+// the stages of interpretInput(), one block at a time through a Fifo like the sound card
+void runEngine(const Settings &settings, const QByteArray &data, qint64 *ns, QVector<qreal> *r)
+{
+    LockinEngine engine;
+    engine.setFormat(settings.format);
+    engine.setIntegrationTime(settings.integrationTime);
+    engine.setFilter(settings.filter);
+    engine.setDecimatedRate(settings.decimatedRate);
+    engine.setHarmonics(settings.harmonics);
+    engine.setReferenceFrequency(settings.referenceFrequency);
+    engine.setPrecision(settings.precision);
+    engine.setOutputPeriod(settings.blockFrames);
+    engine.reset();
+
+    const int frameSize = settings.format.bytesPerFrame();
+    Fifo fifo;
+    fifo.setCapacity(2 * qint64(settings.blockFrames) * frameSize);
+    fifo.open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+
+    LockinOutput output;
+    QElapsedTimer timer;
+    qint64 t[Integrate + 2];
+
+    for (qint64 i = 0; i < settings.frames; i += settings.blockFrames) {
+        const qint64 frames = qMin<qint64>(settings.blockFrames, settings.frames - i);
+        fifo.write(data.constData() + i * frameSize, frames * frameSize);
+
+        timer.start();
+        t[0] = 0;
+        engine.readSoudCard(&fifo);
+        t[1] = timer.nsecsElapsed();
+        engine.parseChopperSignal();
+        t[2] = timer.nsecsElapsed();
+        engine.demodulate();
+        t[3] = timer.nsecsElapsed();
+        while (engine.integrate(&output))
+            *r << output.value.r;
+        t[4] = timer.nsecsElapsed();
+
+        for (int s = Decode; s <= Integrate; ++s)
+            ns[s] += t[s + 1] - t[s];
+        ns[Engine] += t[4];
+    }
+}
+
+// the same through a Lockin : acquisition thread, queue of the values and signals
+void configure(Lockin *lockin, const Settings &settings)
+{
+    lockin->setIntegrationTime(settings.integrationTime);
+    lockin->setFilter(settings.filter);
+    lockin->setDecimatedRate(settings.decimatedRate);
+    lockin->setHarmonics(settings.harmonics);
+    lockin->setReferenceFrequency(settings.referenceFrequency);
+    lockin->setPrecision(settings.precision);
+}
+
+qint64 runLockin(const Settings &settings, QByteArray *data)
+{
+    QBuffer buffer(data);
+    buffer.open(QIODevice::ReadOnly);
+
+    Lockin lockin;
+    configure(&lockin, settings);
+    QObject::connect(&lockin, SIGNAL(finished()), QCoreApplication::instance(), SLOT(quit()));
+
+    const int period = qMax(1, qRound(1000.0 * settings.blockFrames / settings.format.sampleRate()));
+    QElapsedTimer timer;
+    timer.start();
+    if (!lockin.start(&buffer, settings.format, period, false))
+        return -1;
+    QCoreApplication::exec();
+    return timer.nsecsElapsed();
+}
+
+// instances lockins on the same recording in a LockinManager, the time of all of them
+qint64 runManager(const Settings &settings, QByteArray *data, int instances, int threads)
+{
+    LockinManager manager(threads);
+    QList<QBuffer *> buffers;
+    int running = instances;
+
+    const int period = qMax(1, qRound(1000.0 * settings.blockFrames / settings.format.sampleRate()));
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < instances; ++i) {
+        QBuffer *buffer = new QBuffer(data);
+        buffer->open(QIODevice::ReadOnly);
+        buffers << buffer;
+
+        Lockin *lockin = manager.create(QString::number(i));
+        configure(lockin, settings);
+        QObject::connect(lockin, &Lockin::finished, [&running]() {
+            if (--running == 0)
+                QCoreApplication::quit();
+        });
+        if (!lockin->start(buffer, settings.format, period, false))
+            return -1;
+    }
+    QCoreApplication::exec();
+    const qint64 ns = timer.nsecsElapsed();
+
+    // the buffers are read until the lockins are deleted
+    while (manager.count() > 0)
+        manager.destroy(manager.lockin(0));
+    qDeleteAll(buffers);
+    return ns;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("lockin-bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmark of the lockin on a synthetic chopper and signal");
+    parser.addHelpOption();
+
+    QCommandLineOption secondsOption(QStringList() << "s" << "seconds", "Duration of the synthetic recording.", "seconds", "20");
+    QCommandLineOption rateOption("rate", "Sample rate.", "Hz", "192000");
+    QCommandLineOption bitsOption("bits", "Sample size.", "bits", "16");
+    QCommandLineOption typeOption("sample-type", "Sample type : signed, unsigned or float.", "type", "signed");
+    QCommandLineOption bigEndianOption("big-endian", "Big endian samples.");
+    QCommandLineOption channelsOption("channels", "Number of channels, the chopper is on the channel 1.", "n", "2");
+    QCommandLineOption snrOption("snr", "Signal to noise ratio of the signal channels.", "dB", "20");
+    QCommandLineOption chopperOption("chopper", "Frequency of the chopper.", "Hz", "437");
+    QCommandLineOption periodOption(QStringList() << "p" << "output-period", "Block and output period.", "seconds", "0.1");
+    QCommandLineOption integrationOption(QStringList() << "i" << "integration-time", "Integration time.", "seconds", "1.0");
+    QCommandLineOption filterOption(QStringList() << "f" << "filter", "Low pass filter (see lockin-cli).", "filter", "boxcar");
+    QCommandLineOption decimateOption("decimate", "Decimated rate of the filter, 0 for none.", "Hz", "0");
+    QCommandLineOption harmonicsOption(QStringList() << "H" << "harmonics", "Comma separated harmonics.", "list", "1");
+    QCommandLineOption internalOption("internal", "Internal reference at the chopper frequency instead of the chopper.");
+    QCommandLineOption precisionOption("precision", "Processing in double or float.", "precision", "double");
+    QCommandLineOption repeatOption(QStringList() << "n" << "repeat", "Runs, the best one is kept.", "n", "3");
+    QCommandLineOption jsonOption("json", "Write the results into this JSON file too.", "file");
+    QCommandLineOption instancesOption("instances", "Lockins in the pipeline at the same time, in a LockinManager when more than one.", "n", "1");
+    QCommandLineOption threadsOption(QStringList() << "j" << "threads", "Processing threads of the LockinManager.", "n", QString::number(QThread::idealThreadCount()));
+
+    parser.addOption(secondsOption);
+    parser.addOption(rateOption);
+    parser.addOption(bitsOption);
+    parser.addOption(typeOption);
+    parser.addOption(bigEndianOption);
+    parser.addOption(channelsOption);
+    parser.addOption(snrOption);
+    parser.addOption(chopperOption);
+    parser.addOption(periodOption);
+    parser.addOption(integrationOption);
+    parser.addOption(filterOption);
+    parser.addOption(decimateOption);
+    parser.addOption(harmonicsOption);
+    parser.addOption(internalOption);
+    parser.addOption(precisionOption);
+    parser.addOption(repeatOption);
+    parser.addOption(jsonOption);
+    parser.addOption(instancesOption);
+    parser.addOption(threadsOption);
+
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    Settings settings;
+    QAudioFormat &format = settings.format;
+    format.setCodec("audio/pcm");
+    format.setChannelCount(parser.value(channelsOption).toInt());
+    format.setSampleRate(parser.value(rateOption).toInt());
+    format.setSampleSize(parser.value(bitsOption).toInt());
+    format.setByteOrder(parser.isSet(bigEndianOption) ? QAudioFormat::BigEndian : QAudioFormat::LittleEndian);
+    const QString type = parser.value(typeOption);
+    if (type == "float")
+        format.setSampleType(QAudioFormat::Float);
+    else if (type == "unsigned")
+        format.setSampleType(QAudioFormat::UnSignedInt);
+    else
+        format.setSampleType(QAudioFormat::SignedInt);
+
+    const qreal chopper = parser.value(chopperOption).toDouble();
+    SyntheticSource source;
+    source.setFrequency(chopper);
+    source.setSnr(parser.value(snrOption).toDouble());
+    // the internal reference also works on a single channel
+    if (format.channelCount() < (parser.isSet(internalOption) ? 1 : 2) || !source.setFormat(format)) {
+        err << "format not supported\n";
+        return 1;
+    }
+
+    settings.frames = qint64(parser.value(secondsOption).toDouble() * format.sampleRate());
+    settings.blockFrames = qMax(1, qRound(parser.value(periodOption).toDouble() * format.sampleRate()));
+    settings.integrationTime = parser.value(integrationOption).toDouble();
+    settings.decimatedRate = parser.value(decimateOption).toDouble();
+    settings.referenceFrequency = parser.isSet(internalOption) ? chopper : 0.0;
+    if (!LockinEngine::precisionFromName(parser.value(precisionOption), &settings.precision)) {
+        err << parser.value(precisionOption) << ": unknown precision\n";
+        return 1;
+    }
+    if (!LowPassFilter::fromName(parser.value(filterOption), &settings.filter)) {
+        err << parser.value(filterOption) << ": unknown filter\n";
+        return 1;
+    }
+    foreach (const QString &h, parser.value(harmonicsOption).split(',', QString::SkipEmptyParts)) {
+        int n = h.trimmed().toInt();
+        if (n > 0 && !settings.harmonics.contains(n))
+            settings.harmonics << n;
+    }
+    if (settings.harmonics.isEmpty())
+        settings.harmonics << 1;
+    const int repeat = qMax(1, parser.value(repeatOption).toInt());
+    const int instances = qMax(1, parser.value(instancesOption).toInt());
+    const int threads = qMax(1, parser.value(threadsOption).toInt());
+
+    // generated once, out of the timings
+    QElapsedTimer timer;
+    timer.start();
+    QByteArray data(settings.frames * format.bytesPerFrame(), Qt::Uninitialized);
+    for (qint64 i = 0; i < settings.frames; i += 65536)
+        source.generate(i, int(qMin<qint64>(65536, settings.frames - i)), data.data() + i * format.bytesPerFrame());
+    const qreal generation = qreal(timer.nsecsElapsed()) / settings.frames;
+
+    qint64 best[StageCount];
+    for (int s = 0; s < StageCount; ++s)
+        best[s] = -1;
+    QVector<qreal> r;
+
+    for (int run = 0; run < repeat; ++run) {
+        qint64 ns[StageCount] = { 0, 0, 0, 0, 0, 0 };
+        r.clear();
+        runEngine(settings, data, ns, &r);
+        ns[Pipeline] = instances > 1 ? runManager(settings, &data, instances, threads) : runLockin(settings, &data);
+        if (ns[Pipeline] < 0) {
+            err << "cannot start the lockin\n";
+            return 1;
+        }
+        // per instance, the throughput of all of them
+        ns[Pipeline] /= instances;
+
+        for (int s = 0; s < StageCount; ++s)
+            best[s] = best[s] < 0 ? ns[s] : qMin(best[s], ns[s]);
+    }
+
+    // statistics of the second half, settled
+    qreal mean = 0.0, var = 0.0;
+    const int begin = r.size() / 2;
+    for (int i = begin; i < r.size(); ++i)
+        mean += r[i];
+    mean /= qMax(1, r.size() - begin);
+    for (int i = begin; i < r.size(); ++i)
+        var += (r[i] - mean) * (r[i] - mean);
+    var /= qMax(1, r.size() - begin);
+
+    // the same values in the other precision : float against double
+    Settings other = settings;
+    other.precision = settings.precision == LockinEngine::Double ? LockinEngine::Float : LockinEngine::Double;
+    qint64 ignored[StageCount] = { 0, 0, 0, 0, 0, 0 };
+    QVector<qreal> otherR;
+    runEngine(other, data, ignored, &otherR);
+    const QVector<qreal> &doubleR = settings.precision == LockinEngine::Double ? r : otherR;
+    const QVector<qreal> &floatR = settings.precision == LockinEngine::Double ? otherR : r;
+    qreal maxRelative = 0.0, meanAbsolute = 0.0;
+    const int compared = qMin(doubleR.size(), floatR.size());
+    for (int i = 0; i < compared; ++i) {
+        const qreal d = std::fabs(floatR[i] - doubleR[i]);
+        meanAbsolute += d;
+        if (doubleR[i] != 0.0)
+            maxRelative = qMax(maxRelative, d / std::fabs(doubleR[i]));
+    }
+    meanAbsolute /= qMax(1, compared);
+
+    const qreal samples = qreal(settings.frames) * format.channelCount();
+    const qreal seconds = qreal(settings.frames) / format.sampleRate();
+
+    out << "# " << seconds << " s, " << format.sampleRate() << " Hz, " << format.channelCount() << " channels of "
+        << format.sampleSize() << " bits " << type << ", snr " << parser.value(snrOption) << " dB, "
+        << (settings.referenceFrequency > 0.0 ? "internal reference" : "chopper") << ", "
+        << LockinEngine::precisionName(settings.precision) << ", best of " << repeat << "\n";
+    if (instances > 1)
+        out << "# pipeline : " << instances << " lockins on " << threads << " threads, the time of all of them divided by " << instances << "\n";
+    out << "# generation " << generation << " ns/frame, mean r " << mean << " std r " << std::sqrt(var) << "\n";
+    out << "# float against double over " << compared << " values : max |dr|/r " << maxRelative << " mean |dr| " << meanAbsolute << "\n";
+    out << "stage\tns/sample\tMSamples/s\tx real time\n";
+
+    QJsonObject stages;
+    for (int s = 0; s < StageCount; ++s) {
+        const qreal nsPerSample = qreal(best[s]) / samples;
+        const qreal mps = 1e3 / nsPerSample;
+        const qreal realTime = seconds / (best[s] * 1e-9);
+        out << stageNames[s] << "\t" << nsPerSample << "\t" << mps << "\t" << realTime << "\n";
+
+        QJsonObject stage;
+        stage["ns_per_sample"] = nsPerSample;
+        stage["msamples_per_s"] = mps;
+        stage["real_time"] = realTime;
+        stages[stageNames[s]] = stage;
+    }
+
+    if (parser.isSet(jsonOption)) {
+        QJsonObject config;
+        config["seconds"] = seconds;
+        config["rate"] = format.sampleRate();
+        config["channels"] = format.channelCount();
+        config["bits"] = format.sampleSize();
+        config["sample_type"] = type;
+        config["big_endian"] = parser.isSet(bigEndianOption);
+        config["snr"] = parser.value(snrOption).toDouble();
+        config["block_frames"] = settings.blockFrames;
+        config["integration"] = settings.integrationTime;
+        config["filter"] = LowPassFilter::name(settings.filter);
+        config["decimate"] = settings.decimatedRate;
+        config["harmonics"] = settings.harmonics.size();
+        config["internal"] = settings.referenceFrequency > 0.0;
+        config["precision"] = LockinEngine::precisionName(settings.precision);
+        config["repeat"] = repeat;
+        config["instances"] = instances;
+        config["threads"] = instances > 1 ? threads : 1;
+
+        QJsonObject accuracy;
+        accuracy["mean_r"] = mean;
+        accuracy["std_r"] = std::sqrt(var);
+        accuracy["float_max_relative_r"] = maxRelative;
+        accuracy["float_mean_absolute_r"] = meanAbsolute;
+
+        QJsonObject root;
+        root["config"] = config;
+        root["stages"] = stages;
+        root["accuracy"] = accuracy;
+
+        QFile file(parser.value(jsonOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            err << file.fileName() << ": " << file.errorString() << "\n";
+            return 1;
+        }
+        file.write(QJsonDocument(root).toJson());
+    }
+
+    return 0;
+}
@@ -0,0 +1,245 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+/* Offline lockin : processes a recording as fast as possible
+ * and writes the time series of the values into a text file
+ *
+ * lockin-cli [options] input.wav output.txt
+ */
+
+#include "batchprocessor.hh"
+#include "pcmfile.hh"
+#include "logreader.hh"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QStringList>
+
+static void writeHeader(QTextStream &out, const LockinOutput &output)
+{
+    // with several signal channels the columns are suffixed with the channel
+    bool channels = false;
+    for (int k = 1; k < output.values.size(); ++k)
+        channels |= output.values[k].channel != output.values[0].channel;
+
+    out << "# time";
+    for (int k = 0; k < output.values.size(); ++k) {
+        QString h = QString::number(output.values[k].harmonic);
+        if (channels)
+            h += QString("_%1").arg(output.values[k].channel);
+        out << QString("\tx%1\ty%1\tr%1\ttheta%1").arg(h);
+    }
+    out << "\n";
+}
+
+static void writeOutput(QTextStream &out, const LockinOutput &output)
+{
+    out << output.time;
+    for (int k = 0; k < output.values.size(); ++k) {
+        const LockinValue &v = output.values[k];
+        out << "\t" << v.x << "\t" << v.y << "\t" << v.r << "\t" << v.theta;
+    }
+    out << "\n";
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("lockin-cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Offline lockin amplifier, the chopper is on the right channel (or --reference) and the signals on the others");
+    parser.addHelpOption();
+    parser.addPositionalArgument("input", "WAV file, recording of the GUI with raw sound, or raw PCM with --raw");
+    parser.addPositionalArgument("output", "text file of the values");
+
+    QCommandLineOption periodOption(QStringList() << "p" << "output-period", "Output period in seconds.", "seconds", "1.0");
+    QCommandLineOption integrationOption(QStringList() << "i" << "integration-time", "Integration time in seconds.", "seconds", "3.0");
+    QCommandLineOption filterOption(QStringList() << "f" << "filter", "Low pass filter : boxcar, 6db, 12db, 18db, 24db (tau = integration time) or fir.", "filter", "boxcar");
+    QCommandLineOption decimateOption("decimate", "Decimate the demodulated values down to this rate before the filter, 0 for none.", "Hz", "0");
+    QCommandLineOption harmonicsOption(QStringList() << "H" << "harmonics", "Comma separated harmonics.", "list", "1");
+    QCommandLineOption invertOption("invert", "Invert left and right channels.");
+    QCommandLineOption referenceOption(QStringList() << "r" << "reference", "Channel of the chopper, from 0.", "channel", "1");
+    QCommandLineOption frequencyOption("frequency", "Internal reference at this frequency instead of the chopper, all the channels are signals.", "Hz", "0");
+    QCommandLineOption precisionOption("precision", "Processing in double or float.", "precision", "double");
+    QCommandLineOption channelsOption("channels", "Number of channels of raw input.", "n", "2");
+    QCommandLineOption threadsOption(QStringList() << "j" << "threads",
+                                     "Number of threads, all the cores by default with boxcar and fir, "
+                                     "the IIR filters run on one thread only.", "n");
+    QCommandLineOption rawOption("raw", "The input is raw interleaved PCM.");
+    QCommandLineOption rateOption("rate", "Sample rate of raw input.", "Hz", "48000");
+    QCommandLineOption bitsOption("bits", "Sample size of raw input.", "bits", "16");
+    QCommandLineOption typeOption("sample-type", "Sample type of raw input : signed, unsigned or float.", "type", "signed");
+    QCommandLineOption bigEndianOption("big-endian", "Raw input is big endian.");
+
+    parser.addOption(periodOption);
+    parser.addOption(integrationOption);
+    parser.addOption(filterOption);
+    parser.addOption(decimateOption);
+    parser.addOption(harmonicsOption);
+    parser.addOption(invertOption);
+    parser.addOption(referenceOption);
+    parser.addOption(frequencyOption);
+    parser.addOption(precisionOption);
+    parser.addOption(channelsOption);
+    parser.addOption(threadsOption);
+    parser.addOption(rawOption);
+    parser.addOption(rateOption);
+    parser.addOption(bitsOption);
+    parser.addOption(typeOption);
+    parser.addOption(bigEndianOption);
+
+    parser.process(app);
+
+    QTextStream err(stderr);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() != 2) {
+        parser.showHelp(1);
+    }
+
+    QAudioFormat rawFormat;
+    PcmFile input;
+    LogReader recording;
+    const bool isRecording = !parser.isSet(rawOption) && LogReader::isLogFile(args[0]);
+    bool opened;
+
+    if (isRecording) {
+        opened = recording.open(args[0]);
+    } else if (parser.isSet(rawOption)) {
+        QAudioFormat &format = rawFormat;
+        format.setCodec("audio/pcm");
+        format.setChannelCount(parser.value(channelsOption).toInt());
+        format.setSampleRate(parser.value(rateOption).toInt());
+        format.setSampleSize(parser.value(bitsOption).toInt());
+        format.setByteOrder(parser.isSet(bigEndianOption) ? QAudioFormat::BigEndian : QAudioFormat::LittleEndian);
+
+        const QString type = parser.value(typeOption);
+        if (type == "float")
+            format.setSampleType(QAudioFormat::Float);
+        else if (type == "unsigned")
+            format.setSampleType(QAudioFormat::UnSignedInt);
+        else
+            format.setSampleType(QAudioFormat::SignedInt);
+
+        opened = input.openRaw(args[0], format);
+    } else {
+        opened = input.open(args[0]);
+    }
+
+    if (!opened) {
+        err << args[0] << ": " << (isRecording ? recording.errorString() : input.errorString()) << "\n";
+        return 1;
+    }
+
+    const QAudioFormat format = isRecording ? recording.format() : input.format();
+    const qint64 frameCount = isRecording ? recording.endFrame() - recording.firstFrame() : input.frameCount();
+    // a recording knows its reference channel
+    int reference = parser.value(referenceOption).toInt();
+    if (isRecording && !parser.isSet(referenceOption))
+        reference = recording.referenceChannel();
+
+    const qreal frequency = parser.value(frequencyOption).toDouble();
+    if (frequency < 0.0) {
+        err << "the reference frequency must be positive, or 0 for the chopper\n";
+        return 1;
+    } else if (frequency > 0.0) {
+        if (frequency >= 0.5 * format.sampleRate()) {
+            err << "the reference frequency must be below the half of the sample rate\n";
+            return 1;
+        }
+    } else if (isRecording && reference < 0) {
+        err << args[0] << ": recorded with an internal reference, give its --frequency\n";
+        return 1;
+    } else if (format.channelCount() < 2 || reference < 0 || reference >= format.channelCount()) {
+        err << args[0] << ": the input must have 2 channels or more, one of them being the reference\n";
+        return 1;
+    }
+
+    LowPassFilter::Type filter;
+    if (!LowPassFilter::fromName(parser.value(filterOption), &filter)) {
+        err << parser.value(filterOption) << ": unknown filter\n";
+        return 1;
+    }
+
+    LockinEngine::Precision precision;
+    if (!LockinEngine::precisionFromName(parser.value(precisionOption), &precision)) {
+        err << parser.value(precisionOption) << ": unknown precision\n";
+        return 1;
+    }
+
+    QVector<int> harmonics;
+    foreach (const QString &h, parser.value(harmonicsOption).split(',', QString::SkipEmptyParts)) {
+        int n = h.trimmed().toInt();
+        if (n > 0 && !harmonics.contains(n))
+            harmonics << n;
+    }
+    if (harmonics.isEmpty())
+        harmonics << 1;
+
+    // one block per output, like the notify period of the sound card
+    const qint64 blockFrames = qMax<qint64>(1, qRound64(parser.value(periodOption).toDouble() * format.sampleRate()));
+
+    BatchProcessor processor;
+    processor.setBlockFrames(blockFrames);
+    processor.setIntegrationTime(parser.value(integrationOption).toDouble());
+    processor.setFilter(filter);
+    processor.setDecimatedRate(parser.value(decimateOption).toDouble());
+    processor.setHarmonics(harmonics);
+    processor.setInvertLR(parser.isSet(invertOption));
+    processor.setReferenceChannel(reference);
+    processor.setReferenceFrequency(frequency);
+    processor.setPrecision(precision);
+    if (parser.isSet(threadsOption))
+        processor.setThreadCount(parser.value(threadsOption).toInt());
+
+    QFile outputFile(args[1]);
+    if (!outputFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        err << args[1] << ": " << outputFile.errorString() << "\n";
+        return 1;
+    }
+    QTextStream out(&outputFile);
+    out.setRealNumberPrecision(12);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!processor.processFile(args[0], rawFormat)) {
+        err << args[0] << ": " << processor.errorString() << "\n";
+        return 1;
+    }
+
+    const QVector<LockinOutput> &outputs = processor.outputs();
+    for (int i = 0; i < outputs.size(); ++i) {
+        if (i == 0)
+            writeHeader(out, outputs[i]);
+        writeOutput(out, outputs[i]);
+    }
+
+    const qreal seconds = timer.nsecsElapsed() * 1e-9;
+    const qreal duration = qreal(frameCount) / format.sampleRate();
+    err << frameCount << " frames (" << duration << " s) processed in " << seconds << " s, "
+        << duration / seconds << " x real time, " << outputs.size() << " values\n";
+
+    return 0;
+}
@@ -0,0 +1,152 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+/* Minimal client of lockin-daemon : sends the commands, prints the replies on stderr
+ * and, after "subscribe", the values on stdout until the end of the acquisition
+ *
+ * lockin-client [--local name | --tcp host:port] [--count n] command...
+ * e.g. lockin-client "configure replay=run.lockin realtime=0" subscribe start
+ */
+
+#include "lockinprotocol.hh"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QLocalSocket>
+#include <QTcpSocket>
+#include <QTextStream>
+#include <QScopedPointer>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("lockin-client");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Sends commands to lockin-daemon and prints the values it pushes");
+    parser.addHelpOption();
+    parser.addPositionalArgument("command", "Commands sent in order, e.g. \"configure integration=1\" subscribe start");
+
+    QCommandLineOption localOption("local", "Name of the local socket.", "name", "lockin");
+    QCommandLineOption tcpOption("tcp", "Address of the TCP socket.", "host:port");
+    QCommandLineOption countOption(QStringList() << "n" << "count", "Exit after n values.", "n", "0");
+    QCommandLineOption timeoutOption("timeout", "Exit after this time without any frame.", "seconds", "30");
+
+    parser.addOption(localOption);
+    parser.addOption(tcpOption);
+    parser.addOption(countOption);
+    parser.addOption(timeoutOption);
+
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QScopedPointer<QIODevice> socket;
+    bool connected;
+    if (parser.isSet(tcpOption)) {
+        const QString address = parser.value(tcpOption);
+        QTcpSocket *tcp = new QTcpSocket;
+        socket.reset(tcp);
+        tcp->connectToHost(address.section(':', 0, -2), address.section(':', -1).toUShort());
+        connected = tcp->waitForConnected();
+    } else {
+        QLocalSocket *local = new QLocalSocket;
+        socket.reset(local);
+        local->connectToServer(parser.value(localOption));
+        connected = local->waitForConnected();
+    }
+
+    if (!connected) {
+        err << "cannot connect: " << socket->errorString() << "\n";
+        return 1;
+    }
+
+    const QStringList commands = parser.positionalArguments();
+    bool subscribed = false;
+    foreach (const QString &command, commands) {
+        socket->write(LockinProtocol::frame(LockinProtocol::Command, command.toUtf8()));
+        subscribed |= command.trimmed() == "subscribe";
+    }
+
+    const qint64 count = parser.value(countOption).toLongLong();
+    const int timeout = qRound(parser.value(timeoutOption).toDouble() * 1000.0);
+    LockinProtocol::FrameReader reader;
+    int replies = 0;
+    qint64 values = 0;
+    qint64 expected = -1; // next sequence
+    int status = 0;
+
+    forever {
+        // done when all the replies arrived, unless the values are awaited
+        if (replies == commands.size() && (!subscribed || (count > 0 && values >= count)))
+            break;
+
+        if (socket->bytesToWrite() > 0)
+            socket->waitForBytesWritten(timeout);
+        if (socket->bytesAvailable() == 0 && !socket->waitForReadyRead(timeout)) {
+            err << "no more frames: " << socket->errorString() << "\n";
+            status = 1;
+            break;
+        }
+        reader.append(socket->readAll());
+
+        LockinProtocol::FrameType type;
+        QByteArray payload;
+        bool end = false;
+
+        while (reader.next(&type, &payload)) {
+            if (type == LockinProtocol::Reply) {
+                err << commands.value(replies) << ": " << QString::fromUtf8(payload) << "\n";
+                if (!payload.startsWith("ok"))
+                    status = 1;
+                replies++;
+            } else if (type == LockinProtocol::Event) {
+                err << "event: " << QString::fromUtf8(payload) << "\n";
+                if (payload == "started")
+                    expected = -1; // the sequence restarts
+                end |= payload == "finished" || payload == "stopped";
+            } else if (type == LockinProtocol::Values) {
+                quint32 sequence;
+                qreal time;
+                QVector<LockinValue> v;
+                if (!LockinProtocol::parseValues(payload, &sequence, &time, &v))
+                    continue;
+
+                if (expected >= 0 && sequence != expected)
+                    err << "dropped " << qint64(sequence) - expected << " values\n";
+                expected = qint64(sequence) + 1;
+
+                out << time;
+                for (int k = 0; k < v.size(); ++k)
+                    out << "\t" << v[k].x << "\t" << v[k].y << "\t" << v[k].r << "\t" << v[k].theta;
+                out << "\n";
+                values++;
+            }
+        }
+        out.flush();
+        err.flush();
+
+        if (end && replies == commands.size())
+            break;
+    }
+
+    return status;
+}
@@ -0,0 +1,36 @@
+SOURCES += $$PWD/fifo.cc \
+    $$PWD/pcmdecoder.cc \
+    $$PWD/referencetracker.cc \
+    $$PWD/referenceoscillator.cc \
+    $$PWD/lowpassfilter.cc \
+    $$PWD/cicdecimator.cc \
+    $$PWD/lockinstats.cc \
+    $$PWD/workstealingpool.cc \
+    $$PWD/lockin_engine.cc \
+    $$PWD/datalogger.cc \
+    $$PWD/logreader.cc \
+    $$PWD/logreplaydevice.cc \
+    $$PWD/shmpublisher.cc \
+    $$PWD/shmreader.cc
+
+HEADERS += $$PWD/fifo.hh \
+    $$PWD/pcmdecoder.hh \
+    $$PWD/slidingintegrator.hh \
+    $$PWD/lowpassfilter.hh \
+    $$PWD/cicdecimator.hh \
+    $$PWD/lockinstats.hh \
+    $$PWD/workstealingpool.hh \
+    $$PWD/referencetracker.hh \
+    $$PWD/referenceoscillator.hh \
+    $$PWD/lockin_engine.hh \
+    $$PWD/datalogger.hh \
+    $$PWD/logreader.hh \
+    $$PWD/logreplaydevice.hh \
+    $$PWD/shmpublisher.hh \
+    $$PWD/shmreader.hh
+
+# timings of the hot path (lockinstats.hh), qmake CONFIG+=nostats compiles them out
+!nostats: DEFINES += LOCKIN_STATS
+
+# shm_open
+unix:!macx: LIBS += -lrt
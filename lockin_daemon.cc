@@ -0,0 +1,95 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+/* Headless lockin : the Lockin driven through a socket (see lockinserver.hh)
+ *
+ * lockin-daemon [--local name] [--tcp port [--listen address]] [--shm name] [--exec command]...
+ */
+
+#include "lockinserver.hh"
+#include "shmpublisher.hh"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("lockin-daemon");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Lockin amplifier without GUI, controlled through a local or TCP socket");
+    parser.addHelpOption();
+
+    QCommandLineOption localOption("local", "Name of the local socket (\"lockin\" when no TCP port is given).", "name");
+    QCommandLineOption tcpOption("tcp", "TCP port.", "port");
+    QCommandLineOption listenOption("listen", "Address of the TCP socket.", "address", "127.0.0.1");
+    QCommandLineOption pendingOption("max-pending", "Bytes waiting for a slow client before its values are dropped.", "bytes", "1048576");
+    QCommandLineOption shmOption("shm", "Publish the values and the raw frames into this POSIX shared memory too.", "name");
+    QCommandLineOption execOption("exec", "Command run at startup, e.g. \"configure replay=run.lockin\" then \"start\".", "command");
+
+    parser.addOption(localOption);
+    parser.addOption(tcpOption);
+    parser.addOption(listenOption);
+    parser.addOption(pendingOption);
+    parser.addOption(shmOption);
+    parser.addOption(execOption);
+
+    parser.process(app);
+
+    QTextStream err(stderr);
+    ShmPublisher publisher; // outlives the acquisition
+    LockinServer server;
+    server.setMaxPending(parser.value(pendingOption).toLongLong());
+
+    if (parser.isSet(tcpOption)) {
+        if (!server.listenTcp(QHostAddress(parser.value(listenOption)), parser.value(tcpOption).toUShort())) {
+            err << "tcp: " << server.errorString() << "\n";
+            return 1;
+        }
+    }
+
+    if (parser.isSet(localOption) || !parser.isSet(tcpOption)) {
+        const QString name = parser.isSet(localOption) ? parser.value(localOption) : QString("lockin");
+        if (!server.listenLocal(name)) {
+            err << name << ": " << server.errorString() << "\n";
+            return 1;
+        }
+    }
+
+    if (parser.isSet(shmOption)) {
+        if (!publisher.open(parser.value(shmOption))) {
+            err << parser.value(shmOption) << ": " << publisher.errorString() << "\n";
+            return 1;
+        }
+        server.setPublisher(&publisher);
+    }
+
+    foreach (const QString &command, parser.values(execOption)) {
+        const QString reply = server.execute(command);
+        err << command << ": " << reply << "\n";
+        if (!reply.startsWith("ok"))
+            return 1;
+    }
+    err.flush();
+
+    return app.exec();
+}
@@ -0,0 +1,740 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "lockin_engine.hh"
+#include "fifo.hh"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <QVarLengthArray>
+
+template <>
+LockinEngine::Block<double> &LockinEngine::block<double>()
+{
+    return _double;
+}
+
+template <>
+LockinEngine::Block<float> &LockinEngine::block<float>()
+{
+    return _float;
+}
+
+template <>
+const LockinEngine::Block<double> &LockinEngine::block<double>() const
+{
+    return _double;
+}
+
+template <>
+const LockinEngine::Block<float> &LockinEngine::block<float>() const
+{
+    return _float;
+}
+
+// z = a * b for every sample, squared when a is b, then times w if multiply : one pass of a binary powering
+template <typename Real>
+static void powerStep(const Real *ac, const Real *as, const Real *bc, const Real *bs,
+                      const Real *wc, const Real *ws, bool multiply, Real *zc, Real *zs, int size)
+{
+    if (multiply) {
+        for (int i = 0; i < size; ++i) {
+            Real c = ac[i] * bc[i] - as[i] * bs[i];
+            Real s = as[i] * bc[i] + ac[i] * bs[i];
+            zc[i] = c * wc[i] - s * ws[i];
+            zs[i] = s * wc[i] + c * ws[i];
+        }
+    } else {
+        for (int i = 0; i < size; ++i) {
+            Real c = ac[i] * bc[i] - as[i] * bs[i];
+            Real s = as[i] * bc[i] + ac[i] * bs[i];
+            zc[i] = c;
+            zs[i] = s;
+        }
+    }
+}
+
+LockinEngine::LockinEngine() :
+    _precision(Double), _working(Double), _blockFrames(0),
+    _invertLR(false), _integrationTime(3.0), _filter(LowPassFilter::Boxcar),
+    _decimatedRate(0.0), _decimation(1), _referenceChannel(1), _referenceFrequency(0.0),
+    _frameCount(0), _settledFrame(-1), _settledValues(0),
+    _outputPeriod(0), _outputsRead(0)
+{
+    _harmonics << 1;
+}
+
+bool LockinEngine::setFormat(const QAudioFormat &format)
+{
+    _format = format;
+    return format.channelCount() >= 1 && _double.decoder.setFormat(format) && _float.decoder.setFormat(format);
+}
+
+const QAudioFormat &LockinEngine::format() const
+{
+    return _format;
+}
+
+void LockinEngine::setIntegrationTime(qreal integrationTime)
+{
+    _integrationTime = integrationTime;
+}
+
+qreal LockinEngine::integrationTime() const
+{
+    return _integrationTime;
+}
+
+void LockinEngine::setFilter(LowPassFilter::Type filter)
+{
+    _filter = filter;
+}
+
+LowPassFilter::Type LockinEngine::filter() const
+{
+    return _filter;
+}
+
+void LockinEngine::setDecimatedRate(qreal rate)
+{
+    _decimatedRate = qMax<qreal>(0.0, rate);
+}
+
+qreal LockinEngine::decimatedRate() const
+{
+    return _decimatedRate;
+}
+
+int LockinEngine::decimation() const
+{
+    return _decimation;
+}
+
+qint64 LockinEngine::memoryFrames() const
+{
+    const int factor = CicDecimator::factorFor(_format.sampleRate(), _decimatedRate);
+    return LowPassFilter::memoryFrames(_filter, _integrationTime, qreal(_format.sampleRate()) / factor) * factor
+            + CicDecimator::memoryFrames(factor);
+}
+
+void LockinEngine::setInvertLR(bool on)
+{
+    _invertLR = on;
+}
+
+void LockinEngine::setReferenceChannel(int channel)
+{
+    Q_ASSERT(channel >= 0);
+    _referenceChannel = channel;
+}
+
+int LockinEngine::referenceChannel() const
+{
+    return _referenceFrequency > 0.0 ? -1 : _referenceChannel;
+}
+
+void LockinEngine::setReferenceFrequency(qreal frequency)
+{
+    Q_ASSERT(frequency >= 0.0);
+    _referenceFrequency = frequency;
+}
+
+qreal LockinEngine::referenceFrequency() const
+{
+    return _referenceFrequency;
+}
+
+int LockinEngine::channelCount() const
+{
+    return _format.channelCount();
+}
+
+int LockinEngine::signalCount() const
+{
+    return _signals.size();
+}
+
+int LockinEngine::signalChannel(int signal) const
+{
+    return _signals[signal];
+}
+
+bool LockinEngine::setHarmonics(const QVector<int> &harmonics)
+{
+    if (!isValidHarmonics(harmonics))
+        return false;
+    _harmonics = harmonics;
+    return true;
+}
+
+bool LockinEngine::isValidHarmonics(const QVector<int> &harmonics)
+{
+    if (harmonics.isEmpty())
+        return false;
+    foreach (int h, harmonics) {
+        if (h < 1)
+            return false;
+    }
+    return true;
+}
+
+const QVector<int> &LockinEngine::harmonics() const
+{
+    return _harmonics;
+}
+
+void LockinEngine::setPhases(const QVector<qreal> &phases)
+{
+    _phases = phases;
+    _rotations.resize(_phases.size());
+    for (int m = 0; m < _phases.size(); ++m)
+        _rotations[m] = std::polar<qreal>(1.0, -_phases[m]);
+}
+
+const QVector<qreal> &LockinEngine::phases() const
+{
+    return _phases;
+}
+
+bool LockinEngine::autoPhase()
+{
+    if (_lastValues.isEmpty())
+        return false;
+
+    // the values are still filtered with the old reference, the filter is linear so rotating its output is the same
+    QVector<qreal> phases(_lastValues.size());
+    for (int m = 0; m < _lastValues.size(); ++m)
+        phases[m] = std::arg(_lastValues[m]);
+    setPhases(phases);
+    return true;
+}
+
+void LockinEngine::setOutputPeriod(qint64 frames)
+{
+    _outputPeriod = qMax<qint64>(0, frames);
+}
+
+qint64 LockinEngine::outputPeriod() const
+{
+    return _outputPeriod;
+}
+
+void LockinEngine::setPrecision(Precision precision)
+{
+    _precision = precision;
+}
+
+LockinEngine::Precision LockinEngine::precision() const
+{
+    return _precision;
+}
+
+QString LockinEngine::precisionName(Precision precision)
+{
+    switch (precision) {
+    case Double: return "double";
+    case Float: return "float";
+    }
+    return QString();
+}
+
+bool LockinEngine::precisionFromName(const QString &name, Precision *precision)
+{
+    for (int p = Double; p <= Float; ++p) {
+        if (name.compare(precisionName(Precision(p)), Qt::CaseInsensitive) == 0) {
+            *precision = Precision(p);
+            return true;
+        }
+    }
+    return false;
+}
+
+void LockinEngine::reset(qint64 firstFrame)
+{
+    Q_ASSERT(_referenceFrequency > 0.0 || _referenceChannel < channelCount());
+    _signals.clear();
+    for (int c = 0; c < channelCount(); ++c) {
+        if (c != referenceChannel())
+            _signals << c;
+    }
+    _working = _precision;
+
+    // the filter runs at the decimated rate
+    _decimation = CicDecimator::factorFor(_format.sampleRate(), _decimatedRate);
+
+    // nettoyage des variables
+    _measures.resize(_signals.size() * _harmonics.size());
+    _decimators.resize(_measures.size());
+    for (int k = 0; k < _measures.size(); ++k) {
+        _measures[k].reset(_filter, _integrationTime, qreal(_format.sampleRate()) / _decimation); // vide <x,y>
+        _decimators[k].reset(_decimation, firstFrame);
+    }
+    _frameCount = firstFrame;
+    _reference.reset(firstFrame);
+    if (_referenceFrequency > 0.0) {
+        const bool ok = _oscillator.reset(_referenceFrequency, _format.sampleRate(), firstFrame);
+        Q_ASSERT(ok); // below the half of the sample rate, see Lockin::isFormatSupported()
+        Q_UNUSED(ok);
+    }
+    _settledFrame = _referenceFrequency > 0.0 ? firstFrame : -1; // the oscillator needs no history
+    _settledValues = 0;
+    _remainder.clear();
+    _outputs.clear();
+    _outputsRead = 0;
+    _lastValues.clear();
+
+    // the buffers of the other precision are freed
+    clearBlock<double>();
+    clearBlock<float>();
+    block<double>().channels.resize(_working == Double ? channelCount() : 0);
+    block<float>().channels.resize(_working == Float ? channelCount() : 0);
+    _blockFrames = 0;
+}
+
+template <typename Real>
+void LockinEngine::clearBlock()
+{
+    Block<Real> &b = block<Real>();
+    b.channels.clear();
+    b.ref_cos.clear();
+    b.ref_sin.clear();
+    b.pow_cos.clear();
+    b.pow_sin.clear();
+    b.harm_cos.clear();
+    b.harm_sin.clear();
+    b.mix_x.clear();
+    b.mix_y.clear();
+}
+
+int LockinEngine::frameSize() const
+{
+    return _double.decoder.frameSize();
+}
+
+int LockinEngine::readSoudCard(Fifo *fifo, qint64 maxlen)
+{
+    // read the whole frames directly into the fifo memory
+    Fifo::Span spans[2] = { { nullptr, 0 }, { nullptr, 0 } };
+    fifo->readSpans(spans, maxlen);
+
+    int frames = decode(spans[0].data, spans[0].size, spans[1].data, spans[1].size);
+
+    fifo->consume(qint64(frames) * frameSize());
+    return frames;
+}
+
+int LockinEngine::readFrames(const char *data, int frames)
+{
+    return decode(data, qint64(frames) * frameSize(), nullptr, 0);
+}
+
+int LockinEngine::readBytes(const char *data, qint64 size)
+{
+    // the incomplete frame of the previous call comes first
+    QByteArray previous;
+    previous.swap(_remainder);
+
+    int frames = decode(previous.constData(), previous.size(), data, size);
+
+    const qint64 rest = previous.size() + size - qint64(frames) * frameSize();
+    if (rest > size)
+        _remainder = previous.right(rest - size) + QByteArray(data, size);
+    else
+        _remainder = QByteArray(data + size - rest, rest);
+
+    return frames;
+}
+
+int LockinEngine::decode(const char *first, qint64 firstSize, const char *second, qint64 secondSize)
+{
+    if (_working == Float)
+        return decodeBlock<float>(first, firstSize, second, secondSize);
+    return decodeBlock<double>(first, firstSize, second, secondSize);
+}
+
+template <typename Real>
+int LockinEngine::decodeBlock(const char *first, qint64 firstSize, const char *second, qint64 secondSize)
+{
+    Block<Real> &b = block<Real>();
+    const int frameSize = this->frameSize();
+
+    const int frames = (firstSize + secondSize) / frameSize;
+    const int channels = b.channels.size();
+    for (int c = 0; c < channels; ++c)
+        b.channels[c].resize(frames);
+    _blockFrames = frames;
+
+    if (frames == 0)
+        return 0;
+
+    // planar output, the inversion of the channels 0 and 1 is done by swapping the destinations
+    QVarLengthArray<Real *, 16> out(channels);
+    for (int c = 0; c < channels; ++c)
+        out[c] = b.channels[c].data();
+    if (_invertLR && channels >= 2) {
+        std::swap(out[0], out[1]);
+    }
+
+    int done = qMin<qint64>(firstSize / frameSize, frames);
+    b.decoder.decode(first, done, out.constData());
+
+    if (done < frames) {
+        const char *next = second;
+        QVarLengthArray<Real *, 16> at(channels);
+
+        // a frame can be cut by the end of the ring
+        int cut = firstSize - done * frameSize;
+        if (cut > 0) {
+            QVarLengthArray<char, 64> frame(frameSize);
+            memcpy(frame.data(), first + done * frameSize, cut);
+            memcpy(frame.data() + cut, next, frameSize - cut);
+
+            for (int c = 0; c < channels; ++c)
+                at[c] = out[c] + done;
+            b.decoder.decode(frame.constData(), 1, at.constData());
+            next += frameSize - cut;
+            done++;
+        }
+
+        for (int c = 0; c < channels; ++c)
+            at[c] = out[c] + done;
+        b.decoder.decode(next, frames - done, at.constData());
+    }
+
+    return frames;
+}
+
+void LockinEngine::parseChopperSignal()
+{
+    if (_working == Float)
+        parseBlock<float>();
+    else
+        parseBlock<double>();
+}
+
+template <typename Real>
+void LockinEngine::parseBlock()
+{
+    Block<Real> &b = block<Real>();
+    const int size = _blockFrames;
+    b.ref_cos.resize(size);
+    b.ref_sin.resize(size);
+
+    if (_referenceFrequency > 0.0) {
+        // no edges to look for, settled from the first frame
+        _oscillator.process(size, b.ref_cos.data(), b.ref_sin.data());
+        return;
+    }
+
+    // the tracker keeps its state between the blocks, only the begining of the acquisition is NaN
+    // it stops at the output frames, so the frequency of an output doesn't depend on the blocks
+    const Real *chopper = b.channels[_referenceChannel].constData();
+    _outputPeriods.clear();
+    int begin = 0;
+    while (begin < size) {
+        bool output;
+        const int end = segmentEnd(begin, size, &output);
+        _reference.process(chopper + begin, end - begin, b.ref_cos.data() + begin, b.ref_sin.data() + begin);
+        if (output)
+            _outputPeriods << _reference.period();
+        begin = end;
+    }
+}
+
+int LockinEngine::segmentEnd(int begin, int size, bool *output) const
+{
+    *output = _outputPeriod == 0;
+    if (_outputPeriod > 0) {
+        const qint64 next = ((_frameCount + begin) / _outputPeriod + 1) * _outputPeriod;
+        if (next <= _frameCount + size) {
+            *output = true;
+            return int(next - _frameCount);
+        }
+    }
+    return size;
+}
+
+void LockinEngine::demodulate()
+{
+    if (_working == Float)
+        demodulateBlock<float>();
+    else
+        demodulateBlock<double>();
+}
+
+template <typename Real>
+void LockinEngine::demodulateBlock()
+{
+    Block<Real> &b = block<Real>();
+    const int size = b.ref_cos.size();
+    const Real *cos1 = b.ref_cos.constData();
+    const Real *sin1 = b.ref_sin.constData();
+
+    // the reference of harmonic h is (cos + i sin)^h, only the requested ones are computed
+    // in increasing order : one pass if h is the sum of two powers already known (the fundamental
+    // included), else a binary powering of the fundamental. The mixer reads them in place.
+    // NaN propagates so the ignored samples are the same for all harmonics
+    const int harmonics = _harmonics.size();
+    b.harm_cos.resize(harmonics);
+    b.harm_sin.resize(harmonics);
+    b.pow_cos.resize(harmonics);
+    b.pow_sin.resize(harmonics);
+
+    QVarLengthArray<int, 16> order(harmonics);
+    for (int k = 0; k < harmonics; ++k)
+        order[k] = k;
+    std::sort(order.begin(), order.end(), [this](int a, int b) { return _harmonics[a] < _harmonics[b]; });
+
+    QVarLengthArray<int, 16> known; // indexes k already computed
+    for (int n = 0; n < harmonics; ++n) {
+        const int k = order[n];
+        const int h = _harmonics[k];
+
+        if (h == 1) {
+            b.harm_cos[k] = cos1;
+            b.harm_sin[k] = sin1;
+            known.append(k);
+            continue;
+        }
+        if (n > 0 && _harmonics[order[n - 1]] == h) {
+            // the same harmonic twice
+            b.harm_cos[k] = b.harm_cos[order[n - 1]];
+            b.harm_sin[k] = b.harm_sin[order[n - 1]];
+            continue;
+        }
+
+        b.pow_cos[k].resize(size);
+        b.pow_sin[k].resize(size);
+        Real *cos = b.pow_cos[k].data();
+        Real *sin = b.pow_sin[k].data();
+        b.harm_cos[k] = cos;
+        b.harm_sin[k] = sin;
+
+        // h = a + b with a and b among the fundamental and the known powers
+        const Real *ac = nullptr, *as = nullptr, *bc = nullptr, *bs = nullptr;
+        for (int i = -1; i < known.size() && ac == nullptr; ++i) {
+            const int a = i < 0 ? 1 : _harmonics[known[i]];
+            for (int j = i; j < known.size(); ++j) {
+                if (a + (j < 0 ? 1 : _harmonics[known[j]]) != h)
+                    continue;
+                ac = i < 0 ? cos1 : b.harm_cos[known[i]];
+                as = i < 0 ? sin1 : b.harm_sin[known[i]];
+                bc = j < 0 ? cos1 : b.harm_cos[known[j]];
+                bs = j < 0 ? sin1 : b.harm_sin[known[j]];
+                break;
+            }
+        }
+
+        if (ac != nullptr) {
+            powerStep(ac, as, bc, bs, cos1, sin1, false, cos, sin, size);
+        } else {
+            // square and multiply from the most significant bit of h, h >= 1 (setHarmonics())
+            int bit = 30;
+            while (!(h >> bit & 1))
+                --bit;
+            const Real *zc = cos1, *zs = sin1;
+            for (--bit; bit >= 0; --bit) {
+                powerStep(zc, zs, zc, zs, cos1, sin1, (h >> bit & 1) != 0, cos, sin, size);
+                zc = cos;
+                zs = sin;
+            }
+        }
+        known.append(k);
+    }
+
+    if (_referenceFrequency <= 0.0 && _reference.settledFrame() != _settledFrame) {
+        _settledFrame = _reference.settledFrame();
+        _settledValues = 0;
+    }
+
+    _outputs.clear();
+    _outputsRead = 0;
+
+    // the values are taken at fixed frame indexes, so they don't depend on the size of the blocks
+    int begin = 0, outputs = 0;
+    while (begin < size) {
+        bool output;
+        const int end = segmentEnd(begin, size, &output);
+
+        pushValues<Real>(begin, end);
+        if (output) {
+            const qreal period = _referenceFrequency > 0.0 ? 0.0 : _outputPeriods.value(outputs);
+            appendOutput(_frameCount + end, period);
+            outputs++;
+        }
+
+        begin = end;
+    }
+
+    _frameCount += size;
+}
+
+template <typename Real>
+void LockinEngine::pushValues(int begin, int end)
+{
+    Block<Real> &b = block<Real>();
+    const int harmonics = _harmonics.size();
+    const int size = end - begin;
+    b.mix_x.resize(size);
+    b.mix_y.resize(size);
+    Real *x = b.mix_x.data();
+    Real *y = b.mix_y.data();
+
+    for (int k = 0; k < harmonics; ++k) {
+        const Real *cos = b.harm_cos[k] + begin;
+        const Real *sin = b.harm_sin[k] + begin;
+
+        // the same reference for all the signals
+        for (int s = 0; s < _signals.size(); ++s) {
+            const Real *signal = b.channels[_signals[s]].constData() + begin;
+
+            // no branch, vectorized by the compiler, the NaN are skipped by the filter
+            for (int i = 0; i < size; ++i) {
+                x[i] = cos[i] * signal[i];
+                y[i] = sin[i] * signal[i];
+            }
+
+            const int m = s * harmonics + k;
+            if (_decimation > 1) {
+                _dec_x.resize(size / _decimation + 1);
+                _dec_y.resize(size / _decimation + 1);
+                qint64 first;
+                int count = _decimators[m].process(_frameCount + begin, x, y, size, _dec_x.data(), _dec_y.data(), &first);
+                _measures[m].push(first, _dec_x.constData(), _dec_y.constData(), count);
+            } else {
+                _measures[m].push(_frameCount + begin, x, y, size);
+            }
+
+            if (k == 0 && s == 0 && _settledFrame >= 0) {
+                for (int i = int(qBound<qint64>(0, _settledFrame - _frameCount - begin, size)); i < size; ++i) {
+                    if (!std::isnan(x[i]) && !std::isnan(y[i]))
+                        _settledValues++;
+                }
+            }
+        }
+    }
+}
+
+void LockinEngine::appendOutput(qint64 frame, qreal period)
+{
+    // stop if there is not enough values into data xy
+    if (!isFull()) {
+        return;
+    }
+
+    LockinOutput output;
+
+    // computed from the frame index, so it doesn't depend on the history of the blocks
+    output.time = qreal(frame) / qreal(_format.sampleRate());
+    if (_referenceFrequency > 0.0)
+        output.frequency = _oscillator.frequency();
+    else
+        output.frequency = period > 0.0 ? qreal(_format.sampleRate()) / period : 0.0;
+    const int harmonics = _harmonics.size();
+    output.values.resize(_measures.size());
+    _lastValues.resize(_measures.size());
+
+    for (int m = 0; m < _measures.size(); ++m) {
+        _lastValues[m] = _measures[m].value(frame / _decimation);
+        const std::complex<qreal> x = m < _rotations.size() ? _lastValues[m] * _rotations[m] : _lastValues[m];
+
+        LockinValue &value = output.values[m];
+        value.channel = _signals[m / harmonics];
+        value.harmonic = _harmonics[m % harmonics];
+        value.x = x.real();
+        value.y = x.imag();
+        value.r = std::abs(x);
+        value.theta = std::arg(x);
+    }
+
+    output.value = output.values[0];
+    _outputs << output;
+}
+
+bool LockinEngine::isFull() const
+{
+    return _measures[0].isFull();
+}
+
+bool LockinEngine::isSettled() const
+{
+    return _settledValues >= memoryFrames() && isFull();
+}
+
+qint64 LockinEngine::frameCount() const
+{
+    return _frameCount;
+}
+
+bool LockinEngine::integrate(LockinOutput *output)
+{
+    if (_outputsRead >= _outputs.size())
+        return false;
+
+    *output = _outputs[_outputsRead++];
+    return true;
+}
+
+int LockinEngine::process(Fifo *fifo, QVector<LockinOutput> *outputs)
+{
+    if (readSoudCard(fifo) == 0)
+        return 0;
+
+    parseChopperSignal();
+    demodulate();
+
+    LockinOutput output;
+    int count = 0;
+    while (integrate(&output)) {
+        *outputs << output;
+        count++;
+    }
+    return count;
+}
+
+int LockinEngine::blockFrames() const
+{
+    return _blockFrames;
+}
+
+void LockinEngine::copyChannel(int channel, int begin, int size, qreal *out) const
+{
+    Q_ASSERT(begin >= 0 && begin + size <= _blockFrames);
+    if (_working == Float) {
+        const float *in = _float.channels[channel].constData() + begin;
+        std::copy(in, in + size, out);
+    } else {
+        memcpy(out, _double.channels[channel].constData() + begin, size * sizeof(qreal));
+    }
+}
+
+void LockinEngine::copyReference(int begin, int size, qreal *cos, qreal *sin) const
+{
+    Q_ASSERT(begin >= 0 && begin + size <= _blockFrames);
+    if (_working == Float) {
+        std::copy(_float.ref_cos.constData() + begin, _float.ref_cos.constData() + begin + size, cos);
+        std::copy(_float.ref_sin.constData() + begin, _float.ref_sin.constData() + begin + size, sin);
+    } else {
+        memcpy(cos, _double.ref_cos.constData() + begin, size * sizeof(qreal));
+        memcpy(sin, _double.ref_sin.constData() + begin, size * sizeof(qreal));
+    }
+}
@@ -0,0 +1,202 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef LOCKIN_ENGINE_HPP
+#define LOCKIN_ENGINE_HPP
+
+#include <QAudioFormat>
+#include <QVector>
+#include <QByteArray>
+#include <complex>
+#include "pcmdecoder.hh"
+#include "lowpassfilter.hh"
+#include "cicdecimator.hh"
+#include "referencetracker.hh"
+#include "referenceoscillator.hh"
+
+class Fifo;
+
+// demodulated value of one channel at one harmonic of the chopper, averaged over the integration time
+struct LockinValue {
+    int channel; // index of the input channel
+    int harmonic;
+    qreal x; // in phase with the reference rotated by LockinEngine::setPhases()
+    qreal y; // quadrature
+    qreal r; // sqrt(x^2 + y^2)
+    qreal theta; // atan2(y, x)
+};
+
+struct LockinOutput {
+    qreal time;
+    qreal frequency; // of the reference in Hz, 0 while the chopper is not locked
+    LockinValue value; // first signal channel at the first harmonic
+    QVector<LockinValue> values; // for each signal channel, one per harmonic in the order of setHarmonics()
+};
+
+/* Signal processing of the lockin, without any thread or audio device
+ *
+ * The frames have any number of channels (at least 2), one of them is the chopper
+ * (referenceChannel(), the right one by default) and the others are signals.
+ * With setReferenceFrequency() the reference is an internal oscillator instead and
+ * all the channels are signals (at least 1).
+ * All the signal channels are demodulated with the same reference.
+ *
+ * For each block : readSoudCard() then parseChopperSignal(), demodulate() and integrate()
+ * The buffers of the last block stay valid until the next readSoudCard()
+ *
+ * The samples, the reference and the products run in double or in float (setPrecision()),
+ * float doubles the width of the vectors and halves the memory. The decimators, the filters
+ * and the values stay in double : they sum the products over the whole integration time.
+ */
+
+class LockinEngine
+{
+public:
+    enum Precision {
+        Double,
+        Float
+    };
+
+    LockinEngine();
+
+    bool setFormat(const QAudioFormat &format); // return false if the format is not supported
+    const QAudioFormat &format() const;
+    void setIntegrationTime(qreal integrationTime); // effective after reset()
+    qreal integrationTime() const;
+    void setFilter(LowPassFilter::Type filter); // effective after reset(), Boxcar by default
+    LowPassFilter::Type filter() const;
+    void setDecimatedRate(qreal rate); // effective after reset(), the filter runs at a rate >= rate (CicDecimator), 0 : full rate by default
+    qreal decimatedRate() const;
+    int decimation() const; // factor of the CicDecimator, after reset()
+    qint64 memoryFrames() const; // frames after which an output doesn't depend on the older values
+    void setInvertLR(bool on); // swap the channels 0 and 1
+    void setReferenceChannel(int channel); // effective after reset(), 1 by default
+    int referenceChannel() const; // -1 with the internal reference
+    void setReferenceFrequency(qreal frequency); // effective after reset(), > 0 : internal reference in Hz below sampleRate / 2, 0 : chopper (default)
+    qreal referenceFrequency() const;
+    int channelCount() const;
+    int signalCount() const; // channelCount() - 1
+    int signalChannel(int signal) const; // index of the channel of a signal
+    bool setHarmonics(const QVector<int> &harmonics); // effective after reset(), {1} by default, false and unchanged unless isValidHarmonics()
+    static bool isValidHarmonics(const QVector<int> &harmonics); // not empty, all >= 1
+    const QVector<int> &harmonics() const;
+    // rotation of the reference of each value [signal * harmonics + harmonic] in radians, effective for the next values,
+    // x + iy is multiplied by exp(-i phase), the missing ones are 0
+    void setPhases(const QVector<qreal> &phases);
+    const QVector<qreal> &phases() const;
+    bool autoPhase(); // the phases of the last values, so that they are in x (theta = 0), false before the first value
+    void setOutputPeriod(qint64 frames); // a value every frames, on multiples of frames, 0 : a value at the end of each block
+    qint64 outputPeriod() const;
+    void setPrecision(Precision precision); // effective after reset(), Double by default
+    Precision precision() const;
+    static QString precisionName(Precision precision);
+    static bool precisionFromName(const QString &name, Precision *precision);
+
+    void reset(qint64 firstFrame = 0); // call it before a new acquisition, firstFrame is the index of the next frame read
+
+    int readSoudCard(Fifo *fifo, qint64 maxlen = -1); // write into _channels, return the number of frames
+    int readFrames(const char *data, int frames); // same from memory
+    int readBytes(const char *data, qint64 size); // same from a stream, the incomplete frame is kept for the next call
+    void parseChopperSignal(); // write into _ref_cos and _ref_sin, from the chopper or the internal oscillator
+    void demodulate(); // product of the signals with the sin/cos of each harmonic filtered into _measures, computes the values of the block
+    bool integrate(LockinOutput *output); // next value computed by demodulate(), false if there is no more
+    bool isFull() const; // the filter has enough values
+    bool isSettled() const; // the memory of the filter only holds values computed with a settled reference
+    qint64 frameCount() const; // absolute index of the next frame read
+
+    // the 4 steps above, append the new values to outputs and return their number
+    int process(Fifo *fifo, QVector<LockinOutput> *outputs);
+
+    // the last block in double whatever the precision, [begin, begin + size) within blockFrames()
+    int blockFrames() const;
+    void copyChannel(int channel, int begin, int size, qreal *out) const;
+    void copyReference(int begin, int size, qreal *cos, qreal *sin) const; // NaN where the chopper phase is unknown
+
+private:
+    // buffers of a block in the working precision
+    template <typename Real>
+    struct Block {
+        PcmDecoder<Real> decoder;
+        QVector<QVector<Real>> channels; // raw, planar
+        QVector<Real> ref_cos; // cos constructed from the chopper
+        QVector<Real> ref_sin; // sin constructed from the chopper
+        QVector<QVector<Real>> pow_cos; // (cos + i sin)^h of each harmonic but the fundamental
+        QVector<QVector<Real>> pow_sin;
+        QVector<const Real *> harm_cos; // cos/sin of each harmonic, into ref_* or pow_*
+        QVector<const Real *> harm_sin;
+        QVector<Real> mix_x; // product of a signal with the reference of a harmonic
+        QVector<Real> mix_y;
+    };
+
+    template <typename Real> Block<Real> &block();
+    template <typename Real> const Block<Real> &block() const;
+    template <typename Real> void clearBlock();
+
+    // decode the whole frames of two consecutive memory areas, a frame can be split between both
+    int decode(const char *first, qint64 firstSize, const char *second, qint64 secondSize);
+    template <typename Real> int decodeBlock(const char *first, qint64 firstSize, const char *second, qint64 secondSize);
+    template <typename Real> void parseBlock();
+    template <typename Real> void demodulateBlock();
+    template <typename Real> void pushValues(int begin, int end); // push the products of the frames [begin, end) of the block
+    int segmentEnd(int begin, int size, bool *output) const; // next output frame of the block after begin, or size
+    void appendOutput(qint64 frame, qreal period); // value of the window that ends just before frame, period of the chopper there
+    int frameSize() const;
+
+    QAudioFormat _format;
+    QByteArray _remainder; // incomplete frame of readBytes()
+    Precision _precision;
+    Precision _working; // _precision as of reset()
+    Block<double> _double;
+    Block<float> _float;
+    int _blockFrames;
+
+    bool _invertLR;
+    qreal _integrationTime;
+    LowPassFilter::Type _filter;
+    qreal _decimatedRate;
+    int _decimation;
+    int _referenceChannel;
+    QVector<int> _signals; // indexes of the signal channels
+
+    qreal _referenceFrequency;
+    ReferenceTracker _reference;
+    ReferenceOscillator _oscillator; // instead of _reference when _referenceFrequency > 0
+    QVector<qreal> _outputPeriods; // period() of _reference at each output frame of the block
+
+    QVector<int> _harmonics;
+    QVector<CicDecimator> _decimators; // [signal * harmonics + harmonic]
+    QVector<qreal> _dec_x; // output of a decimator
+    QVector<qreal> _dec_y;
+    QVector<LowPassFilter> _measures; // [signal * harmonics + harmonic]
+    QVector<qreal> _phases; // setPhases(), kept by reset()
+    QVector<std::complex<qreal>> _rotations; // exp(-i phase)
+    QVector<std::complex<qreal>> _lastValues; // of the last output, before the rotation
+    qint64 _frameCount; // absolute index of the next frame
+    qint64 _settledFrame; // settledFrame() of _reference
+    qint64 _settledValues; // number of values pushed since _settledFrame
+
+    qint64 _outputPeriod;
+    QVector<LockinOutput> _outputs; // computed by the last demodulate()
+    int _outputsRead;
+};
+
+#endif // LOCKIN_ENGINE_HPP
@@ -26,6 +26,8 @@
 #include <QSettings>
 #include <QDebug>
 #include <QMessageBox>
+#include <QRegExp>
+#include <cmath>
 
 LockinGui::LockinGui(QWidget *parent) :
     QWidget(parent),
@@ -33,7 +35,9 @@ LockinGui::LockinGui(QWidget *parent) :
 {
     ui->setupUi(this);
 
-    _lockin = new Lockin(this);
+    _manager = new LockinManager(0, this);
+    _lockin = _manager->create("main");
+    _instances = 0;
 
     foreach (const QAudioDeviceInfo &device, QAudioDeviceInfo::availableDevices(QAudio::AudioInput)) {
         if (device.deviceName().contains("alsa_input")) {
@@ -44,9 +48,26 @@ LockinGui::LockinGui(QWidget *parent) :
     QSettings set;
     ui->outputPeriod->setValue(set.value("output period", ui->outputPeriod->value()).toDouble());
     ui->integrationTime->setValue(set.value("integration time", _lockin->integrationTime()).toDouble());
+    LowPassFilter::Type filter = _lockin->filter();
+    LowPassFilter::fromName(set.value("filter").toString(), &filter);
+    ui->filter->setCurrentIndex(filter);
+    ui->decimatedRate->setValue(set.value("decimated rate", ui->decimatedRate->value()).toInt());
+    LockinEngine::Precision precision = _lockin->precision();
+    LockinEngine::precisionFromName(set.value("precision").toString(), &precision);
+    ui->precision->setCurrentIndex(precision);
+    ui->harmonics->setText(set.value("harmonics", ui->harmonics->text()).toString());
+    ui->logFile->setText(set.value("log file").toString());
+    ui->logRaw->setChecked(set.value("log raw", false).toBool());
+    ui->channels->setValue(set.value("channels", ui->channels->value()).toInt());
+    ui->referenceChannel->setValue(set.value("reference channel", ui->referenceChannel->value()).toInt());
+    ui->referenceFrequency->setValue(set.value("reference frequency", 0.0).toDouble());
+    ui->quantity->setCurrentIndex(qBound(0, set.value("plot", 0).toInt(), QuantityCount - 1));
+    ui->historyMemory->setValue(set.value("history memory (MB)", ui->historyMemory->value()).toInt());
 
     connect(_lockin, SIGNAL(newRawData()), this, SLOT(updateGraphs()));
-    connect(_lockin, SIGNAL(newValue(qreal,qreal)), this, SLOT(getValue(qreal,qreal)));
+    connect(_lockin, SIGNAL(newValue(qreal,LockinValue)), this, SLOT(getValue(qreal,LockinValue)));
+    connect(_lockin, SIGNAL(newValues(qreal,QVector<LockinValue>)), this, SLOT(getValues(qreal,QVector<LockinValue>)));
+    connect(_lockin, SIGNAL(phasesChanged(QVector<qreal>)), this, SLOT(showPhases(QVector<qreal>)));
 
     ui->left->backgroundBrush = QBrush(Qt::black);
     ui->left->axesPen = QPen(Qt::lightGray);
@@ -54,9 +75,7 @@ LockinGui::LockinGui(QWidget *parent) :
     ui->left->textPen = QPen(Qt::gray);
     ui->left->setZoom(0, 100, -1.1, 1.1);
 
-    _vumeter_left_plot.linePen = QPen(QBrush(Qt::white), 1.5);
-    _vumeter_left_plot.dotRadius = 0.0;
-    ui->left->pointLists << &_vumeter_left_plot;
+    setupSignalPlots(1);
 
 
     ui->right->backgroundBrush = QBrush(Qt::black);
@@ -84,20 +103,68 @@ LockinGui::LockinGui(QWidget *parent) :
 
     _regraph_timer.setSingleShot(true);
     connect(&_regraph_timer, SIGNAL(timeout()), this, SLOT(regraph()));
+
+    ui->statsTable->setRowCount(LockinStats::HistogramCount);
+    ui->statsTable->setColumnCount(6);
+    ui->statsTable->setHorizontalHeaderLabels(QStringList() << "unit" << "count" << "mean" << "median" << "99 %" << "max");
+    QStringList names;
+    for (int h = 0; h < LockinStats::HistogramCount; ++h) {
+        names << LockinStats::name(LockinStats::Histogram(h));
+        for (int c = 0; c < 6; ++c)
+            ui->statsTable->setItem(h, c, new QTableWidgetItem);
+        ui->statsTable->item(h, 0)->setText(LockinStats::unit(LockinStats::Histogram(h)));
+    }
+    ui->statsTable->setVerticalHeaderLabels(names);
+    on_statsReset_clicked();
+
+    ui->instancesTable->setColumnCount(8);
+    ui->instancesTable->setHorizontalHeaderLabels(QStringList() << "name" << "device" << "format" << "state"
+                                                  << "priority" << "value" << "reference" << "load (99 %)");
+    ui->instancePriority->setCurrentIndex(WorkStealingPool::Normal);
+    connect(_lockin, SIGNAL(newValue(qreal,LockinValue)), this, SLOT(getInstanceValue(qreal,LockinValue)));
+    connect(_manager, SIGNAL(lockinsChanged()), this, SLOT(updateInstances()));
+    updateInstances();
+
+    // also the states and the loads of the instances
+    connect(&_stats_timer, SIGNAL(timeout()), this, SLOT(updateStats()));
+    _stats_timer.start(500);
+
+    if (!LockinStats::isEnabled()) {
+        ui->statsTable->setEnabled(false);
+        ui->statsReset->setEnabled(false);
+        ui->label_losses->setText("compiled without LOCKIN_STATS");
+    }
 }
 
 LockinGui::~LockinGui()
 {
+    // the acquisition thread writes into _logger
+    if (_lockin->isRunning())
+        stopLockin();
+    delete _manager;
+
     QSettings set;
     set.setValue("output period", ui->outputPeriod->value());
     set.setValue("integration time", ui->integrationTime->value());
+    set.setValue("filter", LowPassFilter::name(LowPassFilter::Type(ui->filter->currentIndex())));
+    set.setValue("decimated rate", ui->decimatedRate->value());
+    set.setValue("precision", LockinEngine::precisionName(LockinEngine::Precision(ui->precision->currentIndex())));
+    set.setValue("harmonics", ui->harmonics->text());
+    set.setValue("log file", ui->logFile->text());
+    set.setValue("log raw", ui->logRaw->isChecked());
+    set.setValue("channels", ui->channels->value());
+    set.setValue("reference channel", ui->referenceChannel->value());
+    set.setValue("reference frequency", ui->referenceFrequency->value());
+    set.setValue("plot", ui->quantity->currentIndex());
+    set.setValue("history memory (MB)", ui->historyMemory->value());
 
     delete ui;
+    qDeleteAll(_vumeter_signal_plots);
 }
 
-const QList<QPointF> &LockinGui::values() const
+const History &LockinGui::history() const
 {
-    return _measures_plot;
+    return _histories[ui->quantity->currentIndex()];
 }
 
 const QTime &LockinGui::start_time() const
@@ -137,92 +204,378 @@ void LockinGui::on_buttonStartStop_clicked()
 
 void LockinGui::updateGraphs()
 {
-    const QVector<QPair<qreal, qreal>> &data = _lockin->raw_signals();
-    const QVector<std::complex<qreal>> &sin_cos = _lockin->complex_exp_signal();
-    _vumeter_left_plot.clear();
-    _vumeter_right_plot.clear();
-    _vumeter_sin_plot.clear();
+    // snapshot published by the worker, it doesn't change until the next newRawData()
+    const QVector<qreal> &right = _lockin->raw_right();
+    const QVector<qreal> &ref_cos = _lockin->reference_cos();
+    const QVector<qreal> &ref_sin = _lockin->reference_sin();
+    const int size = qMin(ref_cos.size(), 2048); // no chopper with the internal reference
     qreal msPerDot = 1000.0 / qreal(_lockin->format().sampleRate());
 
+    // trigger on the zero phase of the reference
     int trigger = 0;
-    for (int i = 0; i < qMin(data.size(), 2048); ++i) {
-        if (!std::isnan(sin_cos[i].real()) && !std::isnan(sin_cos[i].imag())) {
+    for (int i = 1; i < size; ++i) {
+        if (ref_sin[i-1] < 0.0 && ref_sin[i] >= 0.0 && ref_cos[i] > 0.0) {
             trigger = i;
             break;
         }
     }
+    qreal t0 = -qreal(trigger) * msPerDot;
 
-    for (int i = 0; i < qMin(data.size(), 2048); ++i) {
-        qreal t = qreal(i - trigger) * msPerDot;
-        _vumeter_left_plot.append(QPointF(t, data[i].first));
-        _vumeter_right_plot.append(QPointF(t, data[i].second));
-        if (!std::isnan(sin_cos[i].real())) {
-            _vumeter_sin_plot.append(QPointF(t, sin_cos[i].imag()));
-        }
+    // at most two points per pixel column, written over the previous ones
+    _left_decimator.setColumns(ui->left->width() * ui->left->devicePixelRatio());
+    _left_decimator.setRange(ui->left->xmin(), ui->left->xmax());
+    for (int c = 0, s = 0; c < _lockin->channelCount() && s < _vumeter_signal_plots.size(); ++c) {
+        if (_lockin->referenceFrequency() <= 0.0 && c == _lockin->referenceChannel())
+            continue;
+
+        const QVector<qreal> &signal = _lockin->raw_channel(c);
+        _left_decimator.decimate(signal.constData(), qMin(size, signal.size()), t0, msPerDot, _vumeter_signal_plots[s++]);
     }
 
+    _right_decimator.setColumns(ui->right->width() * ui->right->devicePixelRatio());
+    _right_decimator.setRange(ui->right->xmin(), ui->right->xmax());
+    _right_decimator.decimate(right.constData(), qMin(size, right.size()), t0, msPerDot, &_vumeter_right_plot);
+    _right_decimator.decimate(ref_sin.constData(), size, t0, msPerDot, &_vumeter_sin_plot);
+
     if (!_regraph_timer.isActive()) {
         _regraph_timer.start(50);
     }
 }
 
-void LockinGui::getValue(qreal time, qreal measure)
+qreal LockinGui::quantity(const LockinValue &value, int quantity)
+{
+    switch (quantity) {
+    case X: return value.x;
+    case Y: return value.y;
+    case Theta: return value.theta * 180.0 / M_PI;
+    default: return value.r;
+    }
+}
+
+void LockinGui::getValue(qreal time, const LockinValue &value)
 {
-    ui->label_current_value->setText(QString::number(measure));
+    ui->label_current_value->setText(QString::number(quantity(value, ui->quantity->currentIndex())));
     ui->label_current_time->setText(QTime(0, 0).addMSecs(1000 * time).toString());
     ui->label_real_time->setText(QTime(0, 0).addMSecs(_run_time.elapsed()).toString());
+    const qreal frequency = _lockin->measuredFrequency();
+    ui->label_frequency->setText(frequency > 0.0 ? QString("%1 Hz").arg(frequency, 0, 'f', 3) : QString("not locked"));
 
-    _measures_plot << QPointF(time, measure);
+    // all of them, so the plot can switch without losing the past
+    for (int q = 0; q < QuantityCount; ++q)
+        _histories[q].append(time, quantity(value, q));
     emit newValue();
 
     if (ui->output->xmax() < time && ui->output->xmax() > time * 0.9)
         ui->output->setxmax(time + 0.20 * ui->output->xwidth());
 }
 
+void LockinGui::getValues(qreal time, const QVector<LockinValue> &values)
+{
+    Q_UNUSED(time);
+
+    // one line per signal channel when there are several
+    const bool channels = _vumeter_signal_plots.size() > 1;
+
+    QStringList lines;
+    QStringList text;
+    for (int k = 0; k < values.size(); ++k) {
+        if (k > 0 && values[k].channel != values[k-1].channel) {
+            lines << text.join("  ");
+            text.clear();
+        }
+        if (channels && text.isEmpty())
+            text << QString("ch%1").arg(values[k].channel);
+        text << QString("%1f: %2").arg(values[k].harmonic).arg(quantity(values[k], ui->quantity->currentIndex()));
+    }
+    lines << text.join("  ");
+    ui->label_harmonics->setText(lines.join("\n"));
+}
+
+void LockinGui::showPhases(const QVector<qreal> &phases)
+{
+    // in degrees, of the first value
+    ui->label_phase->setText(QString::number(phases.isEmpty() ? 0.0 : phases[0] * 180.0 / M_PI, 'f', 1));
+}
+
+void LockinGui::on_quantity_currentIndexChanged(int index)
+{
+    Q_UNUSED(index);
+    regraph();
+}
+
+void LockinGui::on_autoPhase_clicked()
+{
+    _lockin->autoPhase();
+}
+
+void LockinGui::on_resetPhase_clicked()
+{
+    _lockin->setPhases(QVector<qreal>());
+}
+
+void LockinGui::on_lockFrequency_clicked()
+{
+    // calibration : the chopper has been measured, it can be left out
+    const qreal frequency = _lockin->measuredFrequency();
+    if (frequency <= 0.0) {
+        QMessageBox::warning(this, "Lock fail", "The chopper is not locked.");
+        return;
+    }
+    ui->referenceFrequency->setValue(frequency);
+}
+
+void LockinGui::on_statsReset_clicked()
+{
+    // the histograms are never cleared, the table shows the difference
+    _stats_baseline.resize(LockinStats::HistogramCount);
+    for (int h = 0; h < LockinStats::HistogramCount; ++h)
+        _stats_baseline[h] = _lockin->stats().histogram(LockinStats::Histogram(h)).snapshot();
+}
+
+void LockinGui::updateStats()
+{
+    if (ui->tabWidget->currentWidget() == ui->tabInstances)
+        updateInstances();
+    if (ui->tabWidget->currentWidget() != ui->tabPerformance || !LockinStats::isEnabled())
+        return;
+
+    for (int h = 0; h < LockinStats::HistogramCount; ++h) {
+        const PerfHistogram::Snapshot s = _lockin->stats().histogram(LockinStats::Histogram(h)).snapshot() - _stats_baseline[h];
+        ui->statsTable->item(h, 1)->setText(QString::number(s.count));
+        ui->statsTable->item(h, 2)->setText(QString::number(s.mean(), 'f', 0));
+        ui->statsTable->item(h, 3)->setText(QString::number(s.percentile(0.5)));
+        ui->statsTable->item(h, 4)->setText(QString::number(s.percentile(0.99)));
+        ui->statsTable->item(h, 5)->setText(QString::number(s.percentile(1.0)));
+    }
+
+    ui->label_losses->setText(QString("dropped blocks %1, late blocks %2, dropped values %3")
+                              .arg(_lockin->droppedBlocks()).arg(_lockin->lateBlocks()).arg(_lockin->droppedValues()));
+}
+
+static QTableWidgetItem *cell(QTableWidget *table, int row, int column)
+{
+    QTableWidgetItem *item = table->item(row, column);
+    if (item == nullptr) {
+        item = new QTableWidgetItem;
+        table->setItem(row, column, item);
+    }
+    return item;
+}
+
+void LockinGui::updateInstances()
+{
+    QTableWidget *table = ui->instancesTable;
+    table->setRowCount(_manager->count());
+
+    for (int i = 0; i < _manager->count(); ++i) {
+        const Lockin *lockin = _manager->lockin(i);
+        const QAudioFormat &format = lockin->format();
+        const bool running = lockin->isRunning();
+
+        cell(table, i, 0)->setText(lockin->objectName());
+        cell(table, i, 1)->setText(_devices.value(lockin));
+        cell(table, i, 2)->setText(format.isValid() ? QString("%1 Hz, %2 ch, %3 bits").arg(format.sampleRate())
+                                   .arg(format.channelCount()).arg(format.sampleSize()) : QString());
+        cell(table, i, 3)->setText(running ? QString("running") : QString("stopped"));
+        cell(table, i, 4)->setText(WorkStealingPool::priorityName(lockin->priority()));
+        cell(table, i, 6)->setText(!running ? QString() : lockin->measuredFrequency() > 0.0 ?
+                                   QString("%1 Hz").arg(lockin->measuredFrequency(), 0, 'f', 3) : QString("not locked"));
+        // permille of the block duration
+        const quint64 load = lockin->stats().histogram(LockinStats::Load).snapshot().percentile(0.99);
+        cell(table, i, 7)->setText(LockinStats::isEnabled() ? QString("%1 %").arg(0.1 * load, 0, 'f', 1) : QString());
+    }
+
+    ui->label_pool->setText(QString("%1 processing threads, %2 kHz in total")
+                            .arg(_manager->threadCount()).arg(_manager->totalSampleRate() / 1000.0));
+    ui->removeInstance->setEnabled(_manager->count() > 1);
+}
+
+void LockinGui::getInstanceValue(qreal time, const LockinValue &value)
+{
+    Q_UNUSED(time);
+
+    const int row = _manager->indexOf(qobject_cast<Lockin *>(sender()));
+    if (row >= 0 && row < ui->instancesTable->rowCount())
+        cell(ui->instancesTable, row, 5)->setText(QString::number(quantity(value, ui->quantity->currentIndex())));
+}
+
+void LockinGui::on_addInstance_clicked()
+{
+    // same settings as the main one, without recording
+    Lockin *lockin = _manager->create(QString("lockin %1").arg(++_instances));
+    lockin->setPriority(WorkStealingPool::Priority(ui->instancePriority->currentIndex()));
+
+    QAudioDeviceInfo device;
+    QAudioFormat format;
+    if (!configureLockin(lockin, &device, &format)) {
+        _manager->destroy(lockin);
+        return;
+    }
+    if (!lockin->start(device, format, ui->outputPeriod->value() * 1000)) {
+        _manager->destroy(lockin);
+        QMessageBox::warning(this, "Add instance fail", "Start has failed.");
+        return;
+    }
+
+    _devices[lockin] = device.deviceName();
+    connect(lockin, SIGNAL(newValue(qreal,LockinValue)), this, SLOT(getInstanceValue(qreal,LockinValue)));
+    updateInstances();
+}
+
+void LockinGui::on_removeInstance_clicked()
+{
+    // the main one stays, it belongs to the other tabs
+    Lockin *lockin = _manager->lockin(ui->instancesTable->currentRow());
+    if (lockin == nullptr || lockin == _lockin)
+        return;
+
+    _devices.remove(lockin);
+    _manager->destroy(lockin);
+}
+
+void LockinGui::on_instancePriority_activated(int index)
+{
+    Lockin *lockin = _manager->lockin(ui->instancesTable->currentRow());
+    if (lockin != nullptr) {
+        lockin->setPriority(WorkStealingPool::Priority(index));
+        updateInstances();
+    }
+}
+
+void LockinGui::on_instancesTable_currentCellChanged(int row, int column, int previousRow, int previousColumn)
+{
+    Q_UNUSED(column);
+    Q_UNUSED(previousRow);
+    Q_UNUSED(previousColumn);
+
+    const Lockin *lockin = _manager->lockin(row);
+    if (lockin != nullptr)
+        ui->instancePriority->setCurrentIndex(lockin->priority());
+}
+
 void LockinGui::regraph()
 {
+    // only the visible range, at most two points per pixel column
+    history().trace(ui->output->xmin(), ui->output->xmax(),
+                   ui->output->width() * ui->output->devicePixelRatio(), &_measures_plot);
+
     ui->left->update();
     ui->right->update();
     ui->output->update();
 }
 
-void LockinGui::startLockin()
+bool LockinGui::configureLockin(Lockin *lockin, QAudioDeviceInfo *device, QAudioFormat *format)
 {
     QAudioDeviceInfo selected_device = ui->audioDeviceSelector->itemData(ui->audioDeviceSelector->currentIndex()).value<QAudioDeviceInfo>();
 
 //    qDebug() << "========== device infos ========== ";
 //    showQAudioDeviceInfo(selected_device);
 
-    QAudioFormat format = selected_device.preferredFormat();
-    format.setChannelCount(2);
-    format.setCodec("audio/pcm");
-    format.setSampleRate(ui->sampleRateComboBox->itemData(ui->sampleRateComboBox->currentIndex()).toInt());
-    format.setSampleSize(ui->sampleSizeComboBox->itemData(ui->sampleSizeComboBox->currentIndex()).toInt());
+    *device = selected_device;
+    *format = selected_device.preferredFormat();
+    format->setChannelCount(ui->channels->value());
+    format->setCodec("audio/pcm");
+    format->setSampleRate(ui->sampleRateComboBox->itemData(ui->sampleRateComboBox->currentIndex()).toInt());
+    format->setSampleSize(ui->sampleSizeComboBox->itemData(ui->sampleSizeComboBox->currentIndex()).toInt());
 
 //    qDebug() << "========== format infos ========== ";
-    qDebug() << format;
+    qDebug() << *format;
+
+    lockin->setIntegrationTime(ui->integrationTime->value());
+    lockin->setFilter(LowPassFilter::Type(ui->filter->currentIndex()));
+    lockin->setDecimatedRate(ui->decimatedRate->value());
+    lockin->setPrecision(LockinEngine::Precision(ui->precision->currentIndex()));
+
+    QVector<int> harmonics;
+    foreach (const QString &h, ui->harmonics->text().split(QRegExp("[,;\\s]+"), QString::SkipEmptyParts)) {
+        int n = h.toInt();
+        if (n > 0 && !harmonics.contains(n))
+            harmonics << n;
+    }
+    if (harmonics.isEmpty())
+        harmonics << 1;
+    lockin->setHarmonics(harmonics);
+
+    const qreal frequency = ui->referenceFrequency->value();
+    if (frequency <= 0.0 && ui->referenceChannel->value() >= format->channelCount()) {
+        QMessageBox::warning(this, "Start lockin fail", "The chopper channel must be one of the channels.");
+        return false;
+    }
+    if (frequency >= 0.5 * format->sampleRate()) {
+        QMessageBox::warning(this, "Start lockin fail", "The reference frequency must be below the half of the sample rate.");
+        return false;
+    }
+    lockin->setReferenceChannel(ui->referenceChannel->value());
+    lockin->setReferenceFrequency(frequency);
 
-    _lockin->setIntegrationTime(ui->integrationTime->value());
+    return true;
+}
+
+void LockinGui::startLockin()
+{
+    QAudioDeviceInfo selected_device;
+    QAudioFormat format;
+    if (!configureLockin(_lockin, &selected_device, &format))
+        return;
+
+    const qreal frequency = _lockin->referenceFrequency();
+    const QVector<int> &harmonics = _lockin->harmonics();
+
+    if (!ui->logFile->text().isEmpty()) {
+        if (!_logger.open(ui->logFile->text(), format, ui->integrationTime->value(), harmonics,
+                          ui->logRaw->isChecked(), frequency > 0.0 ? -1 : ui->referenceChannel->value())) {
+            QMessageBox::warning(this, "Recording fail", _logger.errorString());
+            return;
+        }
+    }
+    _lockin->setLogger(_logger.isOpen() ? &_logger : nullptr);
 
     if (_lockin->start(selected_device, format, ui->outputPeriod->value() * 1000)) {
+        _devices[_lockin] = selected_device.deviceName();
+        updateInstances();
         _run_time.start();
         _start_time = QTime::currentTime();
+        on_statsReset_clicked();
 
+        // the memory is shared by the quantities, setMemoryLimit() clears the history
+        const qint64 memory = qint64(ui->historyMemory->value()) << 20;
+        for (int q = 0; q < QuantityCount; ++q)
+            _histories[q].setMemoryLimit(memory / QuantityCount);
         _measures_plot.clear();
-        _vumeter_left_plot.clear();
+        setupSignalPlots(_lockin->signalCount());
         _vumeter_right_plot.clear();
 
         ui->frame->setEnabled(false);
         ui->buttonStartStop->setText("Stop !");
     } else {
+        _logger.close();
         qDebug() << __FUNCTION__ << ": cannot start lockin";
         QMessageBox::warning(this, "Start lockin fail", "Start has failed.");
     }
 }
 
+void LockinGui::setupSignalPlots(int count)
+{
+    foreach (XY::PointList *plot, _vumeter_signal_plots)
+        ui->left->pointLists.removeAll(plot);
+    qDeleteAll(_vumeter_signal_plots);
+    _vumeter_signal_plots.clear();
+
+    // the first signal in white like the chopper, the others in colors
+    for (int s = 0; s < count; ++s) {
+        XY::PointList *plot = new XY::PointList;
+        QColor color = s == 0 ? QColor(Qt::white) : QColor::fromHsv(360 * (s - 1) / qMax(1, count - 1), 160, 255);
+        plot->linePen = QPen(QBrush(color), 1.5);
+        plot->dotRadius = 0.0;
+        ui->left->pointLists << plot;
+        _vumeter_signal_plots << plot;
+    }
+}
+
 void LockinGui::stopLockin()
 {
     _lockin->stop();
+    _logger.close();
     ui->frame->setEnabled(true);
     ui->buttonStartStop->setText("Start");
 }
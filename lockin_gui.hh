@@ -26,7 +26,12 @@
 #include <QWidget>
 #include <QTime>
 #include <QTimer>
+#include <QHash>
 #include "lockin.hh"
+#include "lockinmanager.hh"
+#include "scopedecimator.hh"
+#include "history.hh"
+#include "datalogger.hh"
 #include "xygraph/xygraph.hh"
 
 namespace Ui {
@@ -41,7 +46,7 @@ public:
     explicit LockinGui(QWidget *parent = 0);
     ~LockinGui();
 
-    const QList<QPointF>& values() const;
+    const History& history() const; // of the plotted quantity
     const QTime& start_time() const;
 
 private slots:
@@ -49,30 +54,58 @@ private slots:
     void on_audioDeviceSelector_currentIndexChanged(int arg1);
     void on_buttonStartStop_clicked();
     void updateGraphs();
-    void getValue(qreal time, qreal measure);
+    void getValue(qreal time, const LockinValue &value);
+    void getValues(qreal time, const QVector<LockinValue> &values);
+    void showPhases(const QVector<qreal> &phases);
+    void on_quantity_currentIndexChanged(int index);
+    void on_autoPhase_clicked();
+    void on_resetPhase_clicked();
+    void on_lockFrequency_clicked();
+    void on_statsReset_clicked();
+    void updateStats();
+    void updateInstances();
+    void getInstanceValue(qreal time, const LockinValue &value);
+    void on_addInstance_clicked();
+    void on_removeInstance_clicked();
+    void on_instancePriority_activated(int index);
+    void on_instancesTable_currentCellChanged(int row, int column, int previousRow, int previousColumn);
     void regraph();
 
 signals:
     void newValue();
 
 private:
+    bool configureLockin(Lockin *lockin, QAudioDeviceInfo *device, QAudioFormat *format);
     void startLockin();
     void stopLockin();
+    void setupSignalPlots(int count);
+
+    enum Quantity { R, X, Y, Theta, QuantityCount }; // in the order of ui->quantity
+    static qreal quantity(const LockinValue &value, int quantity);
 
     Ui::LockinGui *ui;
 
-    Lockin *_lockin;
+    LockinManager *_manager;
+    Lockin *_lockin; // the first one of _manager, the one of the plots
+    QHash<const Lockin *, QString> _devices; // of the instances
+    int _instances; // added since the begining, to name them
+    DataLogger _logger;
     QTime _run_time;
     QTimer _regraph_timer;
+    QTimer _stats_timer;
+    QVector<PerfHistogram::Snapshot> _stats_baseline; // of the Reset, one per LockinStats::Histogram
     QTime _start_time;
 
     // Plots
-    XY::PointList _vumeter_left_plot;
+    QList<XY::PointList *> _vumeter_signal_plots; // one per signal channel
 
     XY::PointList _vumeter_right_plot;
     XY::PointList _vumeter_sin_plot;
+    ScopeDecimator _left_decimator;
+    ScopeDecimator _right_decimator;
 
-    XY::PointList _measures_plot;
+    History _histories[QuantityCount]; // of the first value
+    XY::PointList _measures_plot; // visible part of the plotted history
 };
 
 #endif // LOCKINGUI_HPP
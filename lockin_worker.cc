@@ -0,0 +1,435 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "lockin_worker.hh"
+#include "fifo.hh"
+#include "datalogger.hh"
+#include "shmpublisher.hh"
+#include <QDebug>
+#include <functional>
+
+namespace {
+class Task : public QRunnable
+{
+public:
+    explicit Task(const std::function<void()> &f) : _f(f) {}
+    void run() override { _f(); }
+
+private:
+    std::function<void()> _f;
+};
+} // namespace
+
+LockinWorker::LockinWorker(QObject *parent) :
+    QObject(parent),
+    _audioInput(nullptr),
+    _source(nullptr),
+    _realTime(true),
+    _replayTimer(nullptr),
+    _replayFrames(0),
+    _outputPeriod(500),
+    _integrationTime(3.0),
+    _filter(LowPassFilter::Boxcar),
+    _decimatedRate(0.0),
+    _referenceChannel(1),
+    _referenceFrequency(0.0),
+    _precision(LockinEngine::Double),
+    _logger(nullptr),
+    _publisher(nullptr),
+    _invertLR(0),
+    _pool(nullptr),
+    _priority(WorkStealingPool::Normal),
+    _requests(0),
+    _outputs(256),
+    _pending(0),
+    _lateBlocks(0),
+    _droppedValues(0)
+{
+    _fifo = new Fifo(this);
+    _fifo->open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+}
+
+void LockinWorker::configure(const QAudioDeviceInfo &audioDevice, const QAudioFormat &format, int outputPeriod,
+                             qreal integrationTime, LowPassFilter::Type filter, qreal decimatedRate,
+                             const QVector<int> &harmonics, int referenceChannel, qreal referenceFrequency,
+                             LockinEngine::Precision precision)
+{
+    Q_ASSERT(_audioInput == nullptr);
+    _audioDevice = audioDevice;
+    _format = format;
+    _outputPeriod = outputPeriod;
+    _integrationTime = integrationTime;
+    _filter = filter;
+    _decimatedRate = decimatedRate;
+    _harmonics = harmonics;
+    _referenceChannel = referenceChannel;
+    _referenceFrequency = referenceFrequency;
+    _precision = precision;
+}
+
+void LockinWorker::setLogger(DataLogger *logger)
+{
+    Q_ASSERT(_audioInput == nullptr);
+    _logger = logger;
+}
+
+void LockinWorker::setPublisher(ShmPublisher *publisher)
+{
+    Q_ASSERT(_audioInput == nullptr);
+    _publisher = publisher;
+}
+
+void LockinWorker::setReplaySource(QIODevice *source, bool realTime)
+{
+    Q_ASSERT(_audioInput == nullptr && _replayTimer == nullptr);
+    _source = source;
+    _realTime = realTime;
+}
+
+void LockinWorker::setPool(WorkStealingPool *pool)
+{
+    Q_ASSERT(_audioInput == nullptr && _replayTimer == nullptr);
+    _pool = pool;
+}
+
+void LockinWorker::setInvertLR(bool on)
+{
+    _invertLR.storeRelease(on ? 1 : 0);
+}
+
+void LockinWorker::setPriority(WorkStealingPool::Priority priority)
+{
+    _priority.storeRelease(priority);
+}
+
+TripleBuffer<LockinScope> &LockinWorker::scope()
+{
+    return _scope;
+}
+
+SpscQueue<LockinOutput> &LockinWorker::outputs()
+{
+    return _outputs;
+}
+
+void LockinWorker::acknowledge()
+{
+    _pending.storeRelease(0);
+}
+
+const Fifo *LockinWorker::fifo() const
+{
+    return _fifo;
+}
+
+qint64 LockinWorker::lateBlocks() const
+{
+    return _lateBlocks.loadAcquire();
+}
+
+qint64 LockinWorker::droppedValues() const
+{
+    return _droppedValues.loadAcquire();
+}
+
+LockinStats &LockinWorker::stats()
+{
+    return _stats;
+}
+
+bool LockinWorker::start()
+{
+    if (_audioInput != nullptr || _replayTimer != nullptr) {
+        qDebug() << __FUNCTION__ << ": already running";
+        return false;
+    }
+
+    if (!_engine.setFormat(_format)) {
+        qDebug() << __FUNCTION__ << ": format not supported";
+        return false;
+    }
+    _engine.setIntegrationTime(_integrationTime);
+    _engine.setFilter(_filter);
+    _engine.setDecimatedRate(_decimatedRate);
+    _engine.setHarmonics(_harmonics);
+    _engine.setReferenceChannel(_referenceChannel);
+    _engine.setReferenceFrequency(_referenceFrequency);
+    _engine.setPrecision(_precision);
+    // the values are taken every outputPeriod of sound, whatever the moment of the notify
+    _engine.setOutputPeriod(qMax<qint64>(1, qint64(_outputPeriod) * _format.sampleRate() / 1000));
+    // the time of a replay counts from the position 0 of the source (a LogReplayDevice starts at the first recorded frame)
+    _engine.reset(_source != nullptr ? _source->pos() / _format.bytesPerFrame() : 0);
+
+    if (_publisher != nullptr) {
+        // one value per signal channel and harmonic, in the order of LockinOutput::values
+        QVector<int> channels, harmonics;
+        for (int s = 0; s < _engine.signalCount(); ++s) {
+            for (int k = 0; k < _harmonics.size(); ++k) {
+                channels << _engine.signalChannel(s);
+                harmonics << _harmonics[k];
+            }
+        }
+        _publisher->configure(_format.sampleRate(), _format.channelCount(), channels, harmonics);
+    }
+
+    // room for 4 notify periods but at least one second of sound
+    _fifo->setCapacity(_format.bytesForDuration(qMax(4000 * _outputPeriod, 1000000)));
+    _fifo->resetStatistics();
+    _lateBlocks.storeRelease(0);
+    _droppedValues.storeRelease(0);
+
+    if (_source != nullptr) {
+        // interval 0 : as fast as possible, one output period of sound per event
+        _replayFrames = 0;
+        _replayBuffer.clear();
+        _replayClock.start();
+        _replayTimer = new QTimer(this);
+        _replayTimer->setInterval(_realTime ? _outputPeriod : 0);
+        connect(_replayTimer, SIGNAL(timeout()), this, SLOT(replayInput()));
+        _replayTimer->start();
+        return true;
+    }
+
+    _audioInput = new QAudioInput(_audioDevice, _format, this);
+    _audioInput->setNotifyInterval(_outputPeriod);
+
+    connect(_audioInput, SIGNAL(notify()), this, SLOT(interpretInput()));
+
+    _audioInput->start(_fifo);
+
+    return true;
+}
+
+void LockinWorker::stop()
+{
+    if (_audioInput == nullptr && _replayTimer == nullptr) {
+        qDebug() << __FUNCTION__ << ": lockin is not running";
+        return;
+    }
+
+    if (_audioInput != nullptr) {
+        _audioInput->stop();
+        delete _audioInput;
+        _audioInput = nullptr;
+    }
+
+    if (_replayTimer != nullptr) {
+        // stop() is called from replayInput(), the timer is deleted once out of its timeout()
+        _replayTimer->stop();
+        _replayTimer->deleteLater();
+        _replayTimer = nullptr;
+    }
+
+    // nothing more is notified, the last frames are processed
+    waitIdle();
+
+    if (_logger != nullptr)
+        _logger->flush();
+
+    qDebug() << __FUNCTION__ << ": fifo capacity" << _fifo->capacity()
+             << "high water mark" << _fifo->highWaterMark()
+             << "overruns" << _fifo->overruns() << "(" << _fifo->overrunBytes() << "bytes )"
+             << "late blocks" << lateBlocks()
+             << "dropped values" << droppedValues();
+}
+
+void LockinWorker::setPhases(const QVector<qreal> &phases)
+{
+    QMutexLocker locker(&_engineMutex);
+    _engine.setPhases(phases);
+    emit phasesChanged(_engine.phases());
+}
+
+void LockinWorker::autoPhase()
+{
+    QMutexLocker locker(&_engineMutex);
+    if (!_engine.autoPhase()) {
+        qDebug() << __FUNCTION__ << ": no value yet";
+        return;
+    }
+    emit phasesChanged(_engine.phases());
+}
+
+void LockinWorker::interpretInput()
+{
+    if (_pool == nullptr) {
+        process();
+        return;
+    }
+
+    // at most one task per lockin, started by the first request
+    if (_requests.fetchAndAddOrdered(1) == 0)
+        _pool->start(new Task([this]() { processRequests(); }), WorkStealingPool::Priority(_priority.loadAcquire()));
+}
+
+void LockinWorker::processRequests()
+{
+    int requests = _requests.loadAcquire();
+    forever {
+        // a pass can find the fifo empty, the previous one read the frames of this request
+        if (_fifo->bytesAvailable() >= _format.bytesPerFrame())
+            process();
+
+        // the last access to this object, waitIdle() returns once the mutex is released
+        QMutexLocker locker(&_idleMutex);
+        const int left = _requests.fetchAndAddOrdered(-requests) - requests;
+        if (left == 0) {
+            _idle.wakeAll();
+            return;
+        }
+        requests = left;
+    }
+}
+
+void LockinWorker::waitIdle()
+{
+    QMutexLocker locker(&_idleMutex);
+    while (_requests.loadAcquire() != 0)
+        _idle.wait(&_idleMutex);
+}
+
+void LockinWorker::process()
+{
+    QMutexLocker locker(&_engineMutex);
+
+    // récupère les nouvelles valeurs
+    /*
+     * le nombre de nouvelle valeurs = outputPeriod * sampleRate / 1000
+     * The reference tracker keeps the chopper phase from one block to the next,
+     * so the periods cut by the ends of the block are not lost anymore.
+     * The engine gives a value every outputPeriod of sound, a late notify gives
+     * several values and an early one none.
+     */
+
+    StageClock clock;
+    clock.start();
+    if (LockinStats::isEnabled())
+        _stats.add(LockinStats::FifoFill, quint64(_fifo->bytesAvailable() * 1000 / qMax<qint64>(1, _fifo->capacity())));
+
+    if (_fifo->bytesAvailable() > 2 * _format.bytesForDuration(1000 * qint64(_outputPeriod))) {
+        // the thread could not keep up with the sound card
+        _lateBlocks.fetchAndAddRelaxed(1);
+    }
+
+    _engine.setInvertLR(_invertLR.loadAcquire());
+
+    qint64 maxlen = -1;
+    if (_logger != nullptr && _logger->logsRaw()) {
+        // the exact bytes that the engine will read, before they are consumed
+        Fifo::Span spans[2] = { { nullptr, 0 }, { nullptr, 0 } };
+        _fifo->readSpans(spans);
+        const int frameSize = _format.bytesPerFrame();
+        maxlen = (spans[0].size + spans[1].size) / frameSize * frameSize;
+        _logger->appendRaw(_engine.frameCount(), spans[0].data, qMin(spans[0].size, maxlen),
+                           spans[1].data, maxlen - qMin(spans[0].size, maxlen));
+    }
+
+    // load audio channels and cast them in the interval (-1, 1)
+    const int frames = _engine.readSoudCard(_fifo, maxlen);
+    if (frames == 0) {
+        qDebug() << __FUNCTION__ << ": empty channels";
+        return;
+    }
+    _stats.add(LockinStats::Decode, clock.lap());
+
+    _engine.parseChopperSignal();
+    _stats.add(LockinStats::Reference, clock.lap());
+    publishScope();
+    if (_publisher != nullptr)
+        _publisher->appendScope(_engine);
+    clock.lap(); // the copies for the scope belong to no stage
+
+    _engine.demodulate();
+    _stats.add(LockinStats::Mix, clock.lap());
+
+    LockinOutput output;
+    while (_engine.integrate(&output)) {
+        if (_logger != nullptr)
+            _logger->appendValue(output);
+        if (_publisher != nullptr)
+            _publisher->appendValue(output);
+
+        if (!_outputs.push(output))
+            _droppedValues.fetchAndAddRelaxed(1);
+    }
+    _stats.add(LockinStats::Integrate, clock.lap());
+
+    if (LockinStats::isEnabled()) {
+        // processing time over the duration of the sound
+        _stats.add(LockinStats::BlockFrames, quint64(frames));
+        _stats.add(LockinStats::Load, clock.total() * _format.sampleRate() / (quint64(frames) * 1000000));
+    }
+
+    if (_pending.testAndSetOrdered(0, 1))
+        emit ready();
+}
+
+void LockinWorker::replayInput()
+{
+    const int frameSize = _format.bytesPerFrame();
+
+    // in real time, the frames that the sound card would have given since start
+    qint64 frames = qint64(_outputPeriod) * _format.sampleRate() / 1000;
+    if (_realTime)
+        frames = _replayClock.nsecsElapsed() / 1000 * _format.sampleRate() / 1000000 - _replayFrames;
+    frames = qMin(frames, (_fifo->capacity() - _fifo->bytesAvailable()) / frameSize);
+
+    if (frames > 0) {
+        // the incomplete frame of the previous read comes first, any device can stop within a frame
+        const qint64 kept = _replayBuffer.size();
+        _replayBuffer.resize(frames * frameSize);
+        const qint64 read = _source->read(_replayBuffer.data() + kept, _replayBuffer.size() - kept);
+        const qint64 bytes = kept + qMax<qint64>(0, read);
+        const qint64 n = bytes / frameSize;
+
+        if (n > 0) {
+            _fifo->write(_replayBuffer.constData(), n * frameSize);
+            _replayFrames += n;
+            interpretInput();
+        }
+        _replayBuffer.resize(bytes);
+        _replayBuffer.remove(0, n * frameSize);
+
+        if (read < 0 || (n < frames && _source->atEnd())) {
+            stop();
+            emit finished();
+        }
+    }
+}
+
+void LockinWorker::publishScope()
+{
+    const int size = qMin(_engine.blockFrames(), int(scopeLength));
+
+    // in double whatever the precision of the engine
+    LockinScope &scope = _scope.back();
+    scope.channels.resize(_engine.channelCount());
+    for (int c = 0; c < scope.channels.size(); ++c) {
+        scope.channels[c].resize(size);
+        _engine.copyChannel(c, 0, size, scope.channels[c].data());
+    }
+    scope.cos.resize(size);
+    scope.sin.resize(size);
+    _engine.copyReference(0, size, scope.cos.data(), scope.sin.data());
+
+    _scope.publish();
+}
@@ -0,0 +1,151 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef LOCKIN_WORKER_HPP
+#define LOCKIN_WORKER_HPP
+
+#include <QAudioInput>
+#include <QAtomicInteger>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QWaitCondition>
+#include "lockin_engine.hh"
+#include "triplebuffer.hh"
+#include "spscqueue.hh"
+#include "lockinstats.hh"
+#include "workstealingpool.hh"
+
+class Fifo;
+class DataLogger;
+class ShmPublisher;
+
+// copy of the begining of the last block, for the scope
+struct LockinScope {
+    QVector<QVector<qreal>> channels; // all of them, the chopper included
+    QVector<qreal> cos;
+    QVector<qreal> sin;
+};
+
+/* Lives in the acquisition thread : owns the audio input and runs the LockinEngine
+ * The results are exchanged without locks, the owner reads them in its own thread
+ * when ready() is emitted and calls acknowledge() to be notified again.
+ *
+ * With a pool, the acquisition thread only fills the fifo and the engine runs in a task
+ * of the pool, one at a time, that reads everything the fifo holds when it runs.
+ */
+
+class LockinWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit LockinWorker(QObject *parent = 0);
+
+    // only while stopped
+    void configure(const QAudioDeviceInfo &audioDevice, const QAudioFormat &format, int outputPeriod,
+                   qreal integrationTime, LowPassFilter::Type filter, qreal decimatedRate,
+                   const QVector<int> &harmonics, int referenceChannel, qreal referenceFrequency,
+                   LockinEngine::Precision precision);
+    void setLogger(DataLogger *logger); // opened by the owner, null to log nothing
+    void setPublisher(ShmPublisher *publisher); // opened by the owner, null to publish nothing
+    void setReplaySource(QIODevice *source, bool realTime); // frames of a recording instead of the sound card, null for the sound card
+    void setPool(WorkStealingPool *pool); // only while stopped, null to process in the acquisition thread (default)
+    void setInvertLR(bool on); // from any thread
+    void setPriority(WorkStealingPool::Priority priority); // from any thread, of the next tasks
+
+    // reader side of the results
+    TripleBuffer<LockinScope> &scope();
+    SpscQueue<LockinOutput> &outputs();
+    void acknowledge();
+
+    // statistics, from any thread
+    const Fifo *fifo() const;
+    qint64 lateBlocks() const; // blocks processed after more than two output periods
+    qint64 droppedValues() const; // values lost because the owner was too slow to read them
+    LockinStats &stats(); // written by this thread, except LockinStats::Gui by the owner
+
+    static const int scopeLength = 2048;
+
+public slots:
+    bool start();
+    void stop();
+    void setPhases(const QVector<qreal> &phases); // see LockinEngine::setPhases()
+    void autoPhase(); // nothing before the first value
+
+signals:
+    void ready();
+    void phasesChanged(const QVector<qreal> &phases);
+    void finished(); // end of the replay source, the worker is stopped
+
+private slots:
+    void interpretInput();
+    void replayInput();
+
+private:
+    void process(); // one block, everything in the fifo
+    void processRequests(); // task of the pool
+    void waitIdle(); // until the task of the pool is done
+    void publishScope();
+
+    QAudioInput *_audioInput; // is null when stoped
+    Fifo *_fifo; // feeded by _audioInput or by replayInput()
+
+    QIODevice *_source; // replay instead of the sound card
+    bool _realTime;
+    QTimer *_replayTimer; // is null when stoped
+    QElapsedTimer _replayClock;
+    qint64 _replayFrames; // read from _source since start
+    QByteArray _replayBuffer; // holds the incomplete frame of the last read between two replayInput()
+
+    QAudioDeviceInfo _audioDevice;
+    QAudioFormat _format;
+    int _outputPeriod;
+    qreal _integrationTime;
+    LowPassFilter::Type _filter;
+    qreal _decimatedRate;
+    QVector<int> _harmonics;
+    int _referenceChannel;
+    qreal _referenceFrequency;
+    LockinEngine::Precision _precision;
+
+    LockinEngine _engine;
+    QMutex _engineMutex; // process() against setPhases() and autoPhase() with a pool
+    DataLogger *_logger;
+    ShmPublisher *_publisher;
+    QAtomicInt _invertLR;
+
+    WorkStealingPool *_pool;
+    QAtomicInt _priority;
+    QAtomicInt _requests; // interpretInput() not yet handled by the task, 0 when there is no task
+    QMutex _idleMutex;
+    QWaitCondition _idle;
+
+    TripleBuffer<LockinScope> _scope;
+    SpscQueue<LockinOutput> _outputs;
+    QAtomicInt _pending; // ready() emitted and not acknowledged
+
+    QAtomicInteger<qint64> _lateBlocks;
+    QAtomicInteger<qint64> _droppedValues;
+    LockinStats _stats;
+};
+
+#endif // LOCKIN_WORKER_HPP
@@ -0,0 +1,100 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "lockinmanager.hh"
+#include <QDebug>
+
+LockinManager::LockinManager(int threads, QObject *parent) :
+    QObject(parent),
+    _pool(threads)
+{
+    _acquisition.start(QThread::TimeCriticalPriority);
+    qDebug() << __FUNCTION__ << ": " << _pool.threadCount() << " processing threads";
+}
+
+LockinManager::~LockinManager()
+{
+    // the workers are deleted in the acquisition thread, before it finishes
+    qDeleteAll(_lockins);
+    _lockins.clear();
+
+    _acquisition.quit();
+    _acquisition.wait();
+}
+
+Lockin *LockinManager::create(const QString &name)
+{
+    Lockin *lockin = new Lockin(&_acquisition, &_pool, this);
+    lockin->setObjectName(name);
+    _lockins << lockin;
+
+    emit lockinsChanged();
+    return lockin;
+}
+
+void LockinManager::destroy(Lockin *lockin)
+{
+    if (!_lockins.removeOne(lockin))
+        return;
+
+    delete lockin;
+    emit lockinsChanged();
+}
+
+int LockinManager::count() const
+{
+    return _lockins.size();
+}
+
+Lockin *LockinManager::lockin(int index) const
+{
+    return _lockins.value(index, nullptr);
+}
+
+int LockinManager::indexOf(const Lockin *lockin) const
+{
+    for (int i = 0; i < _lockins.size(); ++i) {
+        if (_lockins[i] == lockin)
+            return i;
+    }
+    return -1;
+}
+
+const QList<Lockin *> &LockinManager::lockins() const
+{
+    return _lockins;
+}
+
+int LockinManager::threadCount() const
+{
+    return _pool.threadCount();
+}
+
+qreal LockinManager::totalSampleRate() const
+{
+    qreal rate = 0.0;
+    foreach (Lockin *lockin, _lockins) {
+        if (lockin->isRunning())
+            rate += lockin->format().sampleRate();
+    }
+    return rate;
+}
@@ -0,0 +1,68 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef LOCKINMANAGER_HPP
+#define LOCKINMANAGER_HPP
+
+#include <QObject>
+#include <QList>
+#include <QThread>
+#include "lockin.hh"
+#include "workstealingpool.hh"
+
+/* Several Lockin at the same time, e.g. one per sound card
+ *
+ * They share one acquisition thread, that only moves the frames from the sound cards
+ * into the fifos, and a pool of processing threads sized to the cores. A lockin
+ * occupies a thread of the pool only while it has frames to process, so the load
+ * follows the sum of the sample rates and not the number of lockins.
+ */
+
+class LockinManager : public QObject
+{
+    Q_OBJECT
+public:
+    explicit LockinManager(int threads = 0, QObject *parent = 0); // 0 : QThread::idealThreadCount()
+    ~LockinManager(); // stops and deletes the lockins
+
+    // the new lockin is stopped, configured and started by the caller, its objectName() is name
+    Lockin *create(const QString &name);
+    void destroy(Lockin *lockin); // stops it if needed
+
+    int count() const;
+    Lockin *lockin(int index) const;
+    int indexOf(const Lockin *lockin) const;
+    const QList<Lockin *> &lockins() const;
+
+    int threadCount() const; // of the pool
+    qreal totalSampleRate() const; // of the running lockins, in frames per second
+
+signals:
+    void lockinsChanged();
+
+private:
+    QThread _acquisition;
+    WorkStealingPool _pool;
+    QList<Lockin *> _lockins;
+};
+
+#endif // LOCKINMANAGER_HPP
@@ -0,0 +1,149 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+#include "lockinprotocol.hh"
+#include <QtEndian>
+#include <cmath>
+#include <cstring>
+
+namespace LockinProtocol
+{
+
+static void putDouble(double value, uchar *out)
+{
+    quint64 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    qToLittleEndian<quint64>(bits, out);
+}
+
+static double getDouble(const uchar *in)
+{
+    const quint64 bits = qFromLittleEndian<quint64>(in);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+QByteArray frame(FrameType type, const QByteArray &payload)
+{
+    QByteArray data(HeaderSize + payload.size(), Qt::Uninitialized);
+    uchar *out = reinterpret_cast<uchar *>(data.data());
+    qToLittleEndian<quint32>(payload.size(), out);
+    qToLittleEndian<quint16>(type, out + 4);
+    qToLittleEndian<quint16>(0, out + 6);
+    memcpy(out + HeaderSize, payload.constData(), payload.size());
+    return data;
+}
+
+QByteArray valuesFrame(quint32 sequence, qreal time, const QVector<LockinValue> &values)
+{
+    const int size = 16 + 20 * values.size();
+    QByteArray data(HeaderSize + size, Qt::Uninitialized);
+    uchar *out = reinterpret_cast<uchar *>(data.data());
+    qToLittleEndian<quint32>(size, out);
+    qToLittleEndian<quint16>(Values, out + 4);
+    qToLittleEndian<quint16>(0, out + 6);
+    out += HeaderSize;
+
+    putDouble(time, out);
+    qToLittleEndian<quint32>(sequence, out + 8);
+    qToLittleEndian<quint32>(values.size(), out + 12);
+    out += 16;
+
+    for (int k = 0; k < values.size(); ++k, out += 20) {
+        qToLittleEndian<quint16>(values[k].channel, out);
+        qToLittleEndian<quint16>(values[k].harmonic, out + 2);
+        putDouble(values[k].x, out + 4);
+        putDouble(values[k].y, out + 12);
+    }
+
+    return data;
+}
+
+bool parseValues(const QByteArray &payload, quint32 *sequence, qreal *time, QVector<LockinValue> *values)
+{
+    if (payload.size() < 16)
+        return false;
+
+    const uchar *in = reinterpret_cast<const uchar *>(payload.constData());
+    const quint32 count = qFromLittleEndian<quint32>(in + 12);
+    if (payload.size() != 16 + 20 * qint64(count))
+        return false;
+
+    *time = getDouble(in);
+    *sequence = qFromLittleEndian<quint32>(in + 8);
+    values->resize(count);
+    in += 16;
+
+    for (quint32 k = 0; k < count; ++k, in += 20) {
+        LockinValue &v = (*values)[k];
+        v.channel = qFromLittleEndian<quint16>(in);
+        v.harmonic = qFromLittleEndian<quint16>(in + 2);
+        v.x = getDouble(in + 4);
+        v.y = getDouble(in + 12);
+        v.r = std::sqrt(v.x * v.x + v.y * v.y);
+        v.theta = std::atan2(v.y, v.x);
+    }
+
+    return true;
+}
+
+FrameReader::FrameReader() :
+    _position(0), _corrupted(false)
+{
+}
+
+void FrameReader::append(const QByteArray &data)
+{
+    // drop what was already read before growing the buffer
+    if (_position > 0) {
+        _buffer = _buffer.mid(_position);
+        _position = 0;
+    }
+    _buffer.append(data.constData(), data.size());
+}
+
+bool FrameReader::next(FrameType *type, QByteArray *payload)
+{
+    if (_corrupted || _buffer.size() - _position < HeaderSize)
+        return false;
+
+    const uchar *in = reinterpret_cast<const uchar *>(_buffer.constData() + _position);
+    const quint32 size = qFromLittleEndian<quint32>(in);
+    if (size > quint32(MaxPayload)) {
+        _corrupted = true;
+        return false;
+    }
+    if (_buffer.size() - _position < HeaderSize + int(size))
+        return false;
+
+    *type = FrameType(qFromLittleEndian<quint16>(in + 4));
+    *payload = _buffer.mid(_position + HeaderSize, size);
+    _position += HeaderSize + size;
+    return true;
+}
+
+bool FrameReader::isCorrupted() const
+{
+    return _corrupted;
+}
+
+} // namespace LockinProtocol
@@ -0,0 +1,84 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+#ifndef LOCKINPROTOCOL_HPP
+#define LOCKINPROTOCOL_HPP
+
+#include <QByteArray>
+#include <QVector>
+#include "lockin_engine.hh"
+
+/* Framing of the socket API of lockin-daemon, little endian
+ *
+ *   frame : quint32 payload size, quint16 type, quint16 reserved (0), then the payload
+ *
+ * client -> server
+ *   Command : a text line, "configure key=value ...", "start", "stop", "subscribe", "unsubscribe", "status",
+ *             "autophase" (rotates the references so that the values are in x), "resetphase",
+ *             "stats" (timings of the processing, see LockinStats)
+ * server -> client
+ *   Reply : "ok ..." or "error ..." text, one per command and in the same order
+ *   Values : pushed to the subscribers, double time, quint32 sequence, quint32 count,
+ *            then count times { quint16 channel, quint16 harmonic, double x, double y }
+ *   Event : text sent to every client, "started", "stopped" or "finished" (end of a replay)
+ *
+ * The sequence counts the values since the start, a gap means that values were dropped
+ * because the client didn't read them fast enough.
+ */
+
+namespace LockinProtocol
+{
+
+enum FrameType {
+    Command = 1,
+    Reply = 2,
+    Values = 3,
+    Event = 4
+};
+
+enum {
+    HeaderSize = 8,
+    MaxPayload = 1 << 20
+};
+
+QByteArray frame(FrameType type, const QByteArray &payload);
+QByteArray valuesFrame(quint32 sequence, qreal time, const QVector<LockinValue> &values);
+bool parseValues(const QByteArray &payload, quint32 *sequence, qreal *time, QVector<LockinValue> *values); // computes r and theta
+
+// cuts a stream into frames
+class FrameReader
+{
+public:
+    FrameReader();
+
+    void append(const QByteArray &data);
+    bool next(FrameType *type, QByteArray *payload); // false if no complete frame
+    bool isCorrupted() const; // a frame larger than MaxPayload, the stream is lost
+
+private:
+    QByteArray _buffer;
+    int _position;
+    bool _corrupted;
+};
+
+} // namespace LockinProtocol
+
+#endif // LOCKINPROTOCOL_HPP
@@ -0,0 +1,432 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+#include "lockinserver.hh"
+#include "logreplaydevice.hh"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QAudioDeviceInfo>
+#include <QRegExp>
+#include <QDebug>
+
+LockinServer::LockinServer(QObject *parent) :
+    QObject(parent),
+    _replay(nullptr),
+    _tcp(nullptr),
+    _local(nullptr),
+    _sequence(0),
+    _maxPending(1 << 20)
+{
+    _lockin = new Lockin(this);
+    connect(_lockin, SIGNAL(newValues(qreal,QVector<LockinValue>)), this, SLOT(pushValues(qreal,QVector<LockinValue>)));
+    connect(_lockin, SIGNAL(finished()), this, SLOT(lockinFinished()));
+
+    _settings.realTime = true;
+    _settings.sampleRate = 48000;
+    _settings.sampleSize = 16;
+    _settings.channels = 2;
+    _settings.reference = 1;
+    _settings.frequency = 0.0;
+    _settings.period = 0.5;
+    _settings.integration = 3.0;
+    _settings.filter = LowPassFilter::Boxcar;
+    _settings.decimate = 0.0;
+    _settings.harmonics << 1;
+    _settings.precision = LockinEngine::Double;
+}
+
+LockinServer::~LockinServer()
+{
+    if (_lockin->isRunning())
+        _lockin->stop();
+    qDeleteAll(_clients);
+}
+
+bool LockinServer::listenTcp(const QHostAddress &address, quint16 port)
+{
+    _tcp = new QTcpServer(this);
+    if (!_tcp->listen(address, port)) {
+        _error = _tcp->errorString();
+        return false;
+    }
+    connect(_tcp, SIGNAL(newConnection()), this, SLOT(newTcpConnection()));
+    return true;
+}
+
+bool LockinServer::listenLocal(const QString &name)
+{
+    // the socket of a daemon that was killed
+    QLocalServer::removeServer(name);
+
+    _local = new QLocalServer(this);
+    if (!_local->listen(name)) {
+        _error = _local->errorString();
+        return false;
+    }
+    connect(_local, SIGNAL(newConnection()), this, SLOT(newLocalConnection()));
+    return true;
+}
+
+QString LockinServer::errorString() const
+{
+    return _error;
+}
+
+void LockinServer::setMaxPending(qint64 bytes)
+{
+    _maxPending = bytes;
+}
+
+void LockinServer::setPublisher(ShmPublisher *publisher)
+{
+    _lockin->setPublisher(publisher);
+}
+
+void LockinServer::newTcpConnection()
+{
+    while (_tcp->hasPendingConnections()) {
+        QTcpSocket *socket = _tcp->nextPendingConnection();
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        addClient(socket);
+    }
+}
+
+void LockinServer::newLocalConnection()
+{
+    while (_local->hasPendingConnections())
+        addClient(_local->nextPendingConnection());
+}
+
+void LockinServer::addClient(QIODevice *socket)
+{
+    Client *c = new Client;
+    c->socket = socket;
+    c->subscribed = false;
+    c->dropped = 0;
+    _clients << c;
+
+    connect(socket, SIGNAL(readyRead()), this, SLOT(readClient()));
+    connect(socket, SIGNAL(disconnected()), this, SLOT(removeClient()));
+    qDebug() << __FUNCTION__ << ": " << _clients.size() << " clients";
+}
+
+LockinServer::Client *LockinServer::client(QObject *socket) const
+{
+    foreach (Client *c, _clients) {
+        if (c->socket == socket)
+            return c;
+    }
+    return nullptr;
+}
+
+void LockinServer::readClient()
+{
+    Client *c = client(sender());
+    if (c == nullptr)
+        return;
+
+    c->reader.append(c->socket->readAll());
+
+    LockinProtocol::FrameType type;
+    QByteArray payload;
+    while (c->reader.next(&type, &payload)) {
+        QString reply;
+        const QString command = QString::fromUtf8(payload).trimmed();
+
+        if (type != LockinProtocol::Command) {
+            reply = "error unexpected frame";
+        } else if (command == "subscribe") {
+            c->subscribed = true;
+            reply = "ok";
+        } else if (command == "unsubscribe") {
+            c->subscribed = false;
+            reply = QString("ok dropped=%1").arg(c->dropped);
+        } else {
+            reply = execute(command);
+        }
+
+        c->socket->write(LockinProtocol::frame(LockinProtocol::Reply, reply.toUtf8()));
+    }
+
+    if (c->reader.isCorrupted()) {
+        qDebug() << __FUNCTION__ << ": corrupted stream, the client is disconnected";
+        c->socket->close();
+    }
+}
+
+void LockinServer::removeClient()
+{
+    Client *c = client(sender());
+    if (c == nullptr)
+        return;
+
+    _clients.removeOne(c);
+    c->socket->deleteLater();
+    delete c;
+    qDebug() << __FUNCTION__ << ": " << _clients.size() << " clients";
+}
+
+void LockinServer::pushValues(qreal time, const QVector<LockinValue> &values)
+{
+    // encoded once for all the subscribers
+    const QByteArray frame = LockinProtocol::valuesFrame(_sequence++, time, values);
+
+    foreach (Client *c, _clients) {
+        if (!c->subscribed)
+            continue;
+
+        // never block : the socket buffers, up to _maxPending
+        if (c->socket->bytesToWrite() + frame.size() > _maxPending) {
+            c->dropped++;
+            continue;
+        }
+        c->socket->write(frame);
+    }
+}
+
+void LockinServer::lockinFinished()
+{
+    broadcastEvent("finished");
+}
+
+void LockinServer::broadcastEvent(const QString &event)
+{
+    const QByteArray frame = LockinProtocol::frame(LockinProtocol::Event, event.toUtf8());
+    foreach (Client *c, _clients)
+        c->socket->write(frame);
+}
+
+QString LockinServer::execute(const QString &command)
+{
+    QStringList words = command.split(QRegExp("\\s+"), QString::SkipEmptyParts);
+    if (words.isEmpty())
+        return "error empty command";
+
+    const QString name = words.takeFirst();
+    if (name == "configure")
+        return configure(words);
+    if (name == "start")
+        return start();
+    if (name == "stop")
+        return stop();
+    if (name == "status")
+        return status();
+    if (name == "stats")
+        return stats();
+    if (name == "autophase")
+        return autoPhase();
+    if (name == "resetphase") {
+        _lockin->setPhases(QVector<qreal>());
+        return "ok";
+    }
+
+    return "error unknown command " + name;
+}
+
+QString LockinServer::configure(const QStringList &arguments)
+{
+    if (_lockin->isRunning())
+        return "error stop the lockin first";
+
+    // all or nothing
+    Settings settings = _settings;
+
+    foreach (const QString &argument, arguments) {
+        const int equal = argument.indexOf('=');
+        if (equal <= 0)
+            return "error expected key=value : " + argument;
+
+        const QString key = argument.left(equal);
+        const QString value = argument.mid(equal + 1);
+        bool ok = true;
+
+        if (key == "device") {
+            settings.device = value;
+        } else if (key == "replay") {
+            settings.replay = value;
+        } else if (key == "realtime") {
+            settings.realTime = value.toInt(&ok) != 0;
+        } else if (key == "rate") {
+            settings.sampleRate = value.toInt(&ok);
+        } else if (key == "bits") {
+            settings.sampleSize = value.toInt(&ok);
+        } else if (key == "channels") {
+            settings.channels = value.toInt(&ok);
+            ok = ok && settings.channels >= 1; // 2 with the chopper, checked by start()
+        } else if (key == "reference") {
+            settings.reference = value.toInt(&ok);
+            ok = ok && settings.reference >= 0;
+        } else if (key == "frequency") {
+            settings.frequency = value.toDouble(&ok);
+            ok = ok && settings.frequency >= 0.0;
+        } else if (key == "period") {
+            settings.period = value.toDouble(&ok);
+            ok = ok && settings.period > 0.0;
+        } else if (key == "integration") {
+            settings.integration = value.toDouble(&ok);
+            ok = ok && settings.integration > 0.0;
+        } else if (key == "filter") {
+            ok = LowPassFilter::fromName(value, &settings.filter);
+        } else if (key == "decimate") {
+            settings.decimate = value.toDouble(&ok);
+        } else if (key == "harmonics") {
+            settings.harmonics.clear();
+            foreach (const QString &h, value.split(',', QString::SkipEmptyParts)) {
+                int n = h.toInt();
+                if (n > 0 && !settings.harmonics.contains(n))
+                    settings.harmonics << n;
+            }
+            ok = !settings.harmonics.isEmpty();
+        } else if (key == "precision") {
+            ok = LockinEngine::precisionFromName(value, &settings.precision);
+        } else {
+            return "error unknown key " + key;
+        }
+
+        if (!ok)
+            return "error bad value for " + key;
+    }
+
+    // a replay has its own rate, checked by start()
+    if (settings.replay.isEmpty() && settings.frequency >= 0.5 * settings.sampleRate)
+        return "error frequency must be below the half of the rate";
+
+    _settings = settings;
+    return "ok";
+}
+
+QString LockinServer::start()
+{
+    if (_lockin->isRunning())
+        return "error already running";
+
+    _lockin->setIntegrationTime(_settings.integration);
+    _lockin->setFilter(_settings.filter);
+    _lockin->setDecimatedRate(_settings.decimate);
+    if (!_lockin->setHarmonics(_settings.harmonics))
+        return "error bad harmonics";
+    _lockin->setReferenceChannel(_settings.reference);
+    _lockin->setReferenceFrequency(_settings.frequency);
+    _lockin->setPrecision(_settings.precision);
+
+    const int period = qRound(_settings.period * 1000.0);
+    bool ok;
+
+    delete _replay;
+    _replay = nullptr;
+
+    if (!_settings.replay.isEmpty()) {
+        _replay = new LogReplayDevice(this);
+        if (!_replay->open(_settings.replay))
+            return "error " + _settings.replay + ": " + _replay->reader().errorString();
+        if (_settings.frequency >= 0.5 * _replay->format().sampleRate())
+            return "error frequency must be below the half of the rate of the replay";
+
+        ok = _lockin->start(_replay, _replay->format(), period, _settings.realTime);
+    } else {
+        QAudioDeviceInfo device = QAudioDeviceInfo::defaultInputDevice();
+        foreach (const QAudioDeviceInfo &d, QAudioDeviceInfo::availableDevices(QAudio::AudioInput)) {
+            if (d.deviceName() == _settings.device)
+                device = d;
+        }
+
+        QAudioFormat format = device.preferredFormat();
+        format.setChannelCount(_settings.channels);
+        format.setCodec("audio/pcm");
+        format.setSampleRate(_settings.sampleRate);
+        format.setSampleSize(_settings.sampleSize);
+
+        ok = _lockin->start(device, format, period);
+    }
+
+    if (!ok)
+        return "error cannot start the lockin";
+
+    _sequence = 0;
+    foreach (Client *c, _clients)
+        c->dropped = 0;
+    broadcastEvent("started");
+    return "ok";
+}
+
+QString LockinServer::stop()
+{
+    if (!_lockin->isRunning())
+        return "error not running";
+
+    _lockin->stop();
+    broadcastEvent("stopped");
+    return "ok";
+}
+
+QString LockinServer::autoPhase()
+{
+    if (!_lockin->isRunning())
+        return "error not running";
+
+    // applied by the acquisition thread to the next values
+    _lockin->autoPhase();
+    return "ok";
+}
+
+QString LockinServer::stats() const
+{
+    if (!LockinStats::isEnabled())
+        return "error compiled without LOCKIN_STATS";
+
+    // since the start of the daemon, name=count/mean/median/99%/max
+    QStringList fields;
+    for (int h = 0; h < LockinStats::HistogramCount; ++h) {
+        const PerfHistogram::Snapshot s = _lockin->stats().histogram(LockinStats::Histogram(h)).snapshot();
+        fields << QString("%1=%2/%3/%4/%5/%6")
+                  .arg(LockinStats::name(LockinStats::Histogram(h)).replace(' ', '_'))
+                  .arg(s.count)
+                  .arg(qRound64(s.mean()))
+                  .arg(s.percentile(0.5))
+                  .arg(s.percentile(0.99))
+                  .arg(s.percentile(1.0));
+    }
+    fields << QString("dropped_blocks=%1 late_blocks=%2 dropped_values=%3")
+              .arg(_lockin->droppedBlocks()).arg(_lockin->lateBlocks()).arg(_lockin->droppedValues());
+
+    return "ok " + fields.join(' ');
+}
+
+QString LockinServer::status() const
+{
+    QStringList harmonics;
+    foreach (int h, _settings.harmonics)
+        harmonics << QString::number(h);
+
+    return QString("ok %1 values=%2 clients=%3 integration=%4 filter=%5 decimate=%6 harmonics=%7 reference=%8 frequency=%9 precision=%10")
+            .arg(_lockin->isRunning() ? "running" : "stopped")
+            .arg(_sequence)
+            .arg(_clients.size())
+            .arg(_settings.integration)
+            .arg(LowPassFilter::name(_settings.filter))
+            .arg(_settings.decimate)
+            .arg(harmonics.join(','))
+            .arg(_settings.reference)
+            .arg(_lockin->isRunning() ? _lockin->measuredFrequency() : _settings.frequency)
+            .arg(LockinEngine::precisionName(_settings.precision));
+}
@@ -0,0 +1,118 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+#ifndef LOCKINSERVER_HPP
+#define LOCKINSERVER_HPP
+
+#include <QObject>
+#include <QList>
+#include <QStringList>
+#include <QHostAddress>
+#include "lockin.hh"
+#include "lockinprotocol.hh"
+
+class QTcpServer;
+class QLocalServer;
+class LogReplayDevice;
+class ShmPublisher;
+
+/* Socket API of the lockin, for lockin-daemon
+ *
+ * Listens on TCP and/or on a local socket (see lockinprotocol.hh for the framing).
+ * The values are pushed from the thread of the server : the acquisition thread never
+ * waits for a client. Each client has a bound on the bytes not yet sent (setMaxPending()),
+ * beyond it the values are dropped for this client only.
+ *
+ * configure keys : device (name of the sound card), replay (recording of DataLogger),
+ * realtime (0 or 1), rate, bits, channels, reference, frequency (Hz, internal reference), period and integration (seconds),
+ * filter (LowPassFilter::name()), decimate (Hz), harmonics (comma separated) and precision (double or float)
+ */
+
+class LockinServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit LockinServer(QObject *parent = 0);
+    ~LockinServer();
+
+    bool listenTcp(const QHostAddress &address, quint16 port);
+    bool listenLocal(const QString &name);
+    QString errorString() const;
+
+    void setMaxPending(qint64 bytes); // per client, 1 MB by default
+    void setPublisher(ShmPublisher *publisher); // see Lockin::setPublisher()
+    QString execute(const QString &command); // as if it came from a client, return the reply
+
+private slots:
+    void newTcpConnection();
+    void newLocalConnection();
+    void readClient();
+    void removeClient();
+    void pushValues(qreal time, const QVector<LockinValue> &values);
+    void lockinFinished();
+
+private:
+    struct Settings {
+        QString device;
+        QString replay;
+        bool realTime;
+        int sampleRate;
+        int sampleSize;
+        int channels;
+        int reference;
+        qreal frequency; // internal reference, 0 : chopper on reference
+        qreal period;
+        qreal integration;
+        LowPassFilter::Type filter;
+        qreal decimate;
+        QVector<int> harmonics;
+        LockinEngine::Precision precision;
+    };
+
+    struct Client {
+        QIODevice *socket;
+        LockinProtocol::FrameReader reader;
+        bool subscribed;
+        qint64 dropped; // values
+    };
+
+    void addClient(QIODevice *socket);
+    Client *client(QObject *socket) const;
+    QString configure(const QStringList &arguments);
+    QString start();
+    QString stop();
+    QString status() const;
+    QString stats() const;
+    QString autoPhase();
+    void broadcastEvent(const QString &event);
+
+    Lockin *_lockin;
+    LogReplayDevice *_replay;
+    QTcpServer *_tcp;
+    QLocalServer *_local;
+    QList<Client *> _clients;
+    Settings _settings;
+    quint32 _sequence; // values since the start
+    qint64 _maxPending;
+    QString _error;
+};
+
+#endif // LOCKINSERVER_HPP
@@ -0,0 +1,132 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "lockinstats.hh"
+#include <QtAlgorithms>
+
+PerfHistogram::PerfHistogram() :
+    _count(0), _sum(0)
+{
+    for (int b = 0; b < Buckets; ++b)
+        _buckets[b].store(0);
+}
+
+PerfHistogram::Snapshot PerfHistogram::snapshot() const
+{
+    Snapshot s;
+    s.count = _count.load();
+    s.sum = _sum.load();
+    s.buckets.resize(Buckets);
+    for (int b = 0; b < Buckets; ++b)
+        s.buckets[b] = _buckets[b].load();
+    return s;
+}
+
+int PerfHistogram::bucket(quint64 value)
+{
+    // 0..3 as they are, then 4 buckets between 2^e and 2^(e+1)
+    if (value < 4)
+        return int(value);
+    const int e = 63 - qCountLeadingZeroBits(value);
+    return 4 * (e - 1) + int((value >> (e - 2)) & 3);
+}
+
+quint64 PerfHistogram::bucketEnd(int bucket)
+{
+    if (bucket < 4)
+        return quint64(bucket);
+    const int e = bucket / 4 + 1;
+    const quint64 sub = quint64(bucket % 4);
+    // the next bucket begins at (4 + sub + 1) << (e - 2)
+    return ((4 + sub + 1) << (e - 2)) - 1;
+}
+
+qreal PerfHistogram::Snapshot::mean() const
+{
+    return count > 0 ? qreal(sum) / qreal(count) : 0.0;
+}
+
+quint64 PerfHistogram::Snapshot::percentile(qreal p) const
+{
+    // the buckets may not sum up exactly to count (see the class comment)
+    quint64 total = 0;
+    for (int b = 0; b < buckets.size(); ++b)
+        total += buckets[b];
+    if (total == 0)
+        return 0;
+
+    const quint64 rank = qMax<quint64>(1, quint64(qBound<qreal>(0.0, p, 1.0) * total + 0.5));
+    quint64 seen = 0;
+    for (int b = 0; b < buckets.size(); ++b) {
+        seen += buckets[b];
+        if (seen >= rank)
+            return bucketEnd(b);
+    }
+    return bucketEnd(buckets.size() - 1);
+}
+
+PerfHistogram::Snapshot PerfHistogram::Snapshot::operator-(const Snapshot &since) const
+{
+    Snapshot d = *this;
+    if (since.buckets.size() != buckets.size())
+        return d;
+
+    d.count -= qMin(since.count, count);
+    d.sum -= qMin(since.sum, sum);
+    for (int b = 0; b < buckets.size(); ++b)
+        d.buckets[b] -= qMin(since.buckets[b], buckets[b]);
+    return d;
+}
+
+QString LockinStats::name(Histogram histogram)
+{
+    switch (histogram) {
+    case Decode: return "decode";
+    case Reference: return "reference";
+    case Mix: return "mix";
+    case Integrate: return "integrate";
+    case Gui: return "gui";
+    case FifoFill: return "fifo fill";
+    case BlockFrames: return "block size";
+    case Load: return "load";
+    case HistogramCount: break;
+    }
+    return QString();
+}
+
+QString LockinStats::unit(Histogram histogram)
+{
+    switch (histogram) {
+    case FifoFill:
+    case Load:
+        return "permille";
+    case BlockFrames:
+        return "frames";
+    default:
+        return "ns";
+    }
+}
+
+const PerfHistogram &LockinStats::histogram(Histogram histogram) const
+{
+    return _histograms[histogram];
+}
@@ -0,0 +1,155 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef LOCKINSTATS_HPP
+#define LOCKINSTATS_HPP
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QString>
+#include <QVector>
+
+/* Histogram of positive integers (durations in ns, fill levels...) without locks
+ *
+ * One thread adds, any thread reads : the counters are relaxed atomics, so a snapshot
+ * taken during an add() can miss this value in some of them. 4 buckets per power of two,
+ * a percentile is known within 19 %.
+ */
+
+class PerfHistogram
+{
+public:
+    enum { Buckets = 252 };
+
+    struct Snapshot {
+        quint64 count;
+        quint64 sum;
+        QVector<quint64> buckets;
+
+        qreal mean() const;
+        quint64 percentile(qreal p) const; // largest value of the bucket, p in [0, 1], 0 if empty
+        Snapshot operator-(const Snapshot &since) const; // the values added between since and this one
+    };
+
+    PerfHistogram();
+
+    // from the writer thread only
+    inline void add(quint64 value);
+    Snapshot snapshot() const;
+
+    static int bucket(quint64 value);
+    static quint64 bucketEnd(int bucket); // largest value of the bucket
+
+private:
+    QAtomicInteger<quint64> _count;
+    QAtomicInteger<quint64> _sum;
+    QAtomicInteger<quint64> _buckets[Buckets];
+};
+
+/* Statistics of the hot path of the lockin, see LockinWorker::interpretInput()
+ *
+ * Recorded when compiled with LOCKIN_STATS (lockin_core.pri defines it unless
+ * qmake CONFIG+=nostats), otherwise add() and StageClock are empty inline
+ * functions and the histograms stay empty.
+ */
+
+class LockinStats
+{
+public:
+    enum Histogram {
+        Decode, // ns, readSoudCard()
+        Reference, // ns, parseChopperSignal()
+        Mix, // ns, demodulate() : products, decimation and filter
+        Integrate, // ns, integrate() with the logger and the shared memory
+        Gui, // ns, Lockin::collect() and the slots of its signals, in the thread of the Lockin
+        FifoFill, // permille of the fifo used before the block is read
+        BlockFrames, // frames per block
+        Load, // permille, processing time over the duration of the block
+        HistogramCount
+    };
+
+    static bool isEnabled()
+    {
+#ifdef LOCKIN_STATS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    static QString name(Histogram histogram);
+    static QString unit(Histogram histogram);
+
+    // each histogram has one writer thread
+    void add(Histogram histogram, quint64 value)
+    {
+        if (isEnabled())
+            _histograms[histogram].add(value);
+    }
+    const PerfHistogram &histogram(Histogram histogram) const;
+
+private:
+    PerfHistogram _histograms[HistogramCount];
+};
+
+// ns between two laps, measures nothing when the statistics are compiled out
+class StageClock
+{
+public:
+    void start()
+    {
+        if (LockinStats::isEnabled()) {
+            _timer.start();
+            _last = 0;
+        }
+    }
+
+    quint64 lap()
+    {
+        if (!LockinStats::isEnabled())
+            return 0;
+        const qint64 now = _timer.nsecsElapsed();
+        const qint64 lap = now - _last;
+        _last = now;
+        return quint64(qMax<qint64>(0, lap));
+    }
+
+    quint64 total() const // since start()
+    {
+        return LockinStats::isEnabled() ? quint64(_last) : 0;
+    }
+
+private:
+    QElapsedTimer _timer;
+    qint64 _last;
+};
+
+inline void PerfHistogram::add(quint64 value)
+{
+    // single writer : no read-modify-write needed
+    QAtomicInteger<quint64> &bucket = _buckets[PerfHistogram::bucket(value)];
+    bucket.store(bucket.load() + 1);
+    _sum.store(_sum.load() + value);
+    _count.store(_count.load() + 1);
+}
+
+#endif // LOCKINSTATS_HPP
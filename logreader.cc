@@ -0,0 +1,307 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "logreader.hh"
+#include <QVarLengthArray>
+#include <cstring>
+
+LogReader::LogReader() :
+    _map(nullptr), _size(0), _integrationTime(0.0), _startTime(0), _referenceChannel(1), _frameSize(1), _recordSize(0)
+{
+}
+
+LogReader::~LogReader()
+{
+    close();
+}
+
+bool LogReader::open(const QString &fileName)
+{
+    close();
+
+    _file.setFileName(fileName);
+    if (!_file.open(QIODevice::ReadOnly)) {
+        _error = _file.errorString();
+        return false;
+    }
+
+    _size = _file.size();
+    if (_size < qint64(sizeof(LogFileHeader))) {
+        _error = "not a lockin recording";
+        close();
+        return false;
+    }
+
+    _map = _file.map(0, _size);
+    if (_map == nullptr) {
+        _error = _file.errorString();
+        close();
+        return false;
+    }
+
+    LogFileHeader header;
+    memcpy(&header, _map, sizeof(header));
+    if (memcmp(header.magic, "LOCKINLG", 8) != 0 || (header.version != 1 && header.version != 2)) {
+        // a wrong version can also be a file written with the other byte order
+        _error = "not a lockin recording or unknown version";
+        close();
+        return false;
+    }
+    if (header.version == 1) {
+        header.signalCount = 1;
+        header.referenceChannel = 1;
+    }
+
+    // nothing is read from the mapping before the header is known to be sane
+    if (header.channelCount < 1 || header.channelCount > maxChannels
+            || header.sampleSize < 8 || header.sampleSize > 64 || header.sampleSize % 8 != 0
+            || header.harmonicCount < 0 || header.harmonicCount > maxHarmonics
+            || header.referenceChannel < -1 || header.referenceChannel >= header.channelCount
+            || header.signalCount < 0 || header.signalCount > header.channelCount - (header.referenceChannel >= 0 ? 1 : 0)
+            || header.headerSize < sizeof(LogFileHeader) + header.harmonicCount * sizeof(qint32)
+            || header.headerSize > _size) {
+        _error = "corrupted header";
+        close();
+        return false;
+    }
+
+    _format.setCodec("audio/pcm");
+    _format.setSampleRate(header.sampleRate);
+    _format.setChannelCount(header.channelCount);
+    _format.setSampleSize(header.sampleSize);
+    _format.setSampleType(QAudioFormat::SampleType(header.sampleType));
+    _format.setByteOrder(QAudioFormat::Endian(header.byteOrder));
+    _integrationTime = header.integrationTime;
+    _startTime = header.startTime;
+
+    _harmonics.resize(header.harmonicCount);
+    memcpy(_harmonics.data(), _map + sizeof(LogFileHeader), header.harmonicCount * sizeof(qint32));
+
+    _referenceChannel = header.referenceChannel;
+    _signals.clear();
+    for (int c = 0; _signals.size() < header.signalCount; ++c) {
+        if (c != _referenceChannel)
+            _signals << c;
+    }
+
+    _frameSize = qMax(1, _format.bytesPerFrame());
+    _recordSize = (1 + 4 * header.signalCount * header.harmonicCount) * sizeof(double);
+
+    // index of the chunks, stops at the first incomplete one and at the first one
+    // that goes back over the previous one of its type (corrupted or concatenated file)
+    qint64 position = header.headerSize;
+    while (position + qint64(sizeof(LogChunkHeader)) <= _size) {
+        LogChunkHeader chunk;
+        memcpy(&chunk, _map + position, sizeof(chunk));
+
+        const qint64 payload = position + sizeof(LogChunkHeader);
+        if (chunk.size < 0 || payload + chunk.size > _size)
+            break;
+        // a record or a frame takes one byte at least, so first + count can't overflow
+        if (chunk.count < 0 || chunk.count > chunk.size || chunk.first < 0 || chunk.first > Q_INT64_C(1) << 62)
+            break;
+
+        Chunk entry = { payload, chunk.first, chunk.count };
+        if (chunk.type == LogChunkHeader::Values && chunk.size == chunk.count * _recordSize) {
+            if (!_values.isEmpty() && chunk.first < _values.last().first + _values.last().count)
+                break;
+            _values << entry;
+        }
+        if (chunk.type == LogChunkHeader::Raw && chunk.size == chunk.count * _frameSize) {
+            if (!_raw.isEmpty() && chunk.first < _raw.last().first + _raw.last().count)
+                break;
+            _raw << entry;
+        }
+
+        position = payload + ((chunk.size + 7) & ~qint64(7));
+    }
+
+    return true;
+}
+
+void LogReader::close()
+{
+    if (_map != nullptr)
+        _file.unmap(const_cast<uchar *>(_map));
+    _map = nullptr;
+    _size = 0;
+    _file.close();
+
+    _harmonics.clear();
+    _signals.clear();
+    _values.clear();
+    _raw.clear();
+}
+
+bool LogReader::isOpen() const
+{
+    return _map != nullptr;
+}
+
+QString LogReader::errorString() const
+{
+    return _error;
+}
+
+bool LogReader::isLogFile(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    char magic[8];
+    return file.read(magic, 8) == 8 && memcmp(magic, "LOCKINLG", 8) == 0;
+}
+
+QAudioFormat LogReader::format() const
+{
+    return _format;
+}
+
+qreal LogReader::integrationTime() const
+{
+    return _integrationTime;
+}
+
+qint64 LogReader::startTime() const
+{
+    return _startTime;
+}
+
+const QVector<int> &LogReader::harmonics() const
+{
+    return _harmonics;
+}
+
+int LogReader::referenceChannel() const
+{
+    return _referenceChannel;
+}
+
+qint64 LogReader::valueCount() const
+{
+    return _values.isEmpty() ? 0 : _values.last().first + _values.last().count;
+}
+
+bool LogReader::value(qint64 index, LockinOutput *output) const
+{
+    int c = find(_values, index);
+    if (c == _values.size() || _values[c].first > index)
+        return false;
+
+    const int harmonics = _harmonics.size();
+    const int count = harmonics * _signals.size();
+    QVarLengthArray<double, 64> record(1 + 4 * count);
+    memcpy(record.data(), _map + _values[c].offset + (index - _values[c].first) * _recordSize, _recordSize);
+
+    output->time = record[0];
+    output->frequency = 0.0; // not recorded
+    output->values.resize(count);
+    for (int k = 0; k < count; ++k) {
+        LockinValue &v = output->values[k];
+        v.channel = _signals[k / harmonics];
+        v.harmonic = _harmonics[k % harmonics];
+        v.x = record[1 + 4*k];
+        v.y = record[2 + 4*k];
+        v.r = record[3 + 4*k];
+        v.theta = record[4 + 4*k];
+    }
+    output->value = count > 0 ? output->values[0] : LockinValue();
+    return true;
+}
+
+const QVector<LogReader::Chunk> &LogReader::rawChunks() const
+{
+    return _raw;
+}
+
+qint64 LogReader::firstFrame() const
+{
+    return _raw.isEmpty() ? 0 : _raw.first().first;
+}
+
+qint64 LogReader::endFrame() const
+{
+    return _raw.isEmpty() ? 0 : _raw.last().first + _raw.last().count;
+}
+
+int LogReader::findRawChunk(qint64 frame) const
+{
+    return find(_raw, frame);
+}
+
+const char *LogReader::rawData(int chunk) const
+{
+    return reinterpret_cast<const char *>(_map + _raw[chunk].offset);
+}
+
+qint64 LogReader::readFrames(qint64 frame, char *data, qint64 frames) const
+{
+    frames = qBound<qint64>(0, frames, endFrame() - frame);
+    return readBytes((frame - firstFrame()) * _frameSize, data, frames * _frameSize) / _frameSize;
+}
+
+qint64 LogReader::readBytes(qint64 position, char *data, qint64 size) const
+{
+    const qint64 total = (endFrame() - firstFrame()) * _frameSize;
+    size = qBound<qint64>(0, size, total - position);
+
+    qint64 done = 0;
+    while (done < size) {
+        const qint64 pos = position + done;
+        const qint64 frame = firstFrame() + pos / _frameSize;
+        const int c = findRawChunk(frame);
+        if (c == _raw.size())
+            break;
+
+        // byte position of the chunk in the stream
+        const qint64 begin = (_raw[c].first - firstFrame()) * _frameSize;
+        qint64 n;
+
+        if (_raw[c].first <= frame) {
+            n = qMin(size - done, begin + _raw[c].count * _frameSize - pos);
+            memcpy(data + done, _map + _raw[c].offset + (pos - begin), n);
+        } else {
+            // frames dropped while recording
+            n = qMin(size - done, begin - pos);
+            memset(data + done, 0, n);
+        }
+        Q_ASSERT(n > 0); // the chunks are in order and don't overlap (open())
+        done += n;
+    }
+
+    return done;
+}
+
+int LogReader::find(const QVector<Chunk> &chunks, qint64 index)
+{
+    // first chunk that ends after index
+    int lo = 0, hi = chunks.size();
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (chunks[mid].first + chunks[mid].count <= index)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
@@ -0,0 +1,102 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef LOGREADER_HPP
+#define LOGREADER_HPP
+
+#include <QFile>
+#include <QAudioFormat>
+#include "datalogger.hh"
+
+/* Reads a file written by DataLogger without loading it
+ *
+ * The file is mapped in memory, open() only walks through the chunk headers
+ * to build an index of the values and of the raw frames. The raw frames are
+ * addressed by their absolute frame index, a frame missing from the file
+ * (chunk dropped while recording) reads as zeros.
+ * A header out of the limits below is rejected as corrupted, the index stops
+ * at the first chunk that overlaps the previous one of its type.
+ */
+
+class LogReader
+{
+public:
+    enum { maxChannels = 256, maxHarmonics = 256 };
+
+    struct Chunk {
+        qint64 offset; // of the payload in the file
+        qint64 first;
+        qint64 count;
+    };
+
+    LogReader();
+    ~LogReader();
+
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const;
+    QString errorString() const;
+
+    static bool isLogFile(const QString &fileName);
+
+    // header
+    QAudioFormat format() const;
+    qreal integrationTime() const;
+    qint64 startTime() const; // ms since epoch, UTC
+    const QVector<int> &harmonics() const;
+    int referenceChannel() const;
+
+    // values
+    qint64 valueCount() const;
+    bool value(qint64 index, LockinOutput *output) const;
+
+    // raw frames
+    const QVector<Chunk> &rawChunks() const;
+    qint64 firstFrame() const;
+    qint64 endFrame() const; // after the last frame
+    int findRawChunk(qint64 frame) const; // chunk holding frame or the next one, rawChunks().size() if none
+    const char *rawData(int chunk) const; // in place
+    qint64 readFrames(qint64 frame, char *data, qint64 frames) const;
+    qint64 readBytes(qint64 position, char *data, qint64 size) const; // position in bytes from firstFrame()
+
+private:
+    static int find(const QVector<Chunk> &chunks, qint64 index);
+
+    QFile _file;
+    const uchar *_map;
+    qint64 _size;
+    QString _error;
+
+    QAudioFormat _format;
+    qreal _integrationTime;
+    qint64 _startTime;
+    QVector<int> _harmonics;
+    QVector<int> _signals; // channels of the values
+    int _referenceChannel;
+    int _frameSize;
+    int _recordSize;
+
+    QVector<Chunk> _values;
+    QVector<Chunk> _raw;
+};
+
+#endif // LOGREADER_HPP
@@ -0,0 +1,107 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "logreplaydevice.hh"
+#include <cstring>
+
+LogReplayDevice::LogReplayDevice(QObject *parent) :
+    QIODevice(parent)
+{
+}
+
+bool LogReplayDevice::open(const QString &fileName)
+{
+    close();
+
+    if (!_reader.open(fileName)) {
+        setErrorString(_reader.errorString());
+        return false;
+    }
+
+    // Unbuffered, the bytes are already in memory
+    if (!QIODevice::open(QIODevice::ReadOnly | QIODevice::Unbuffered))
+        return false;
+    return seek(_reader.firstFrame() * _reader.format().bytesPerFrame());
+}
+
+void LogReplayDevice::close()
+{
+    QIODevice::close();
+    _reader.close();
+}
+
+const LogReader &LogReplayDevice::reader() const
+{
+    return _reader;
+}
+
+QAudioFormat LogReplayDevice::format() const
+{
+    return _reader.format();
+}
+
+bool LogReplayDevice::isSequential() const
+{
+    return false;
+}
+
+qint64 LogReplayDevice::size() const
+{
+    return _reader.endFrame() * _reader.format().bytesPerFrame();
+}
+
+bool LogReplayDevice::seekTime(qreal time)
+{
+    // the frame index is the time since the start, the chunk index does the rest
+    qint64 frame = qBound(_reader.firstFrame(), qint64(time * _reader.format().sampleRate()), _reader.endFrame());
+    return seek(frame * _reader.format().bytesPerFrame());
+}
+
+qreal LogReplayDevice::time() const
+{
+    return qreal(frame()) / qreal(_reader.format().sampleRate());
+}
+
+qint64 LogReplayDevice::frame() const
+{
+    return pos() / _reader.format().bytesPerFrame();
+}
+
+qint64 LogReplayDevice::readData(char *data, qint64 maxlen)
+{
+    const qint64 origin = _reader.firstFrame() * _reader.format().bytesPerFrame();
+
+    // before the first recorded frame
+    qint64 done = 0;
+    if (pos() < origin) {
+        done = qMin(maxlen, origin - pos());
+        memset(data, 0, done);
+    }
+    return done + _reader.readBytes(pos() + done - origin, data + done, maxlen - done);
+}
+
+qint64 LogReplayDevice::writeData(const char *data, qint64 len)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(len);
+    return -1;
+}
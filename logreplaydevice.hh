@@ -0,0 +1,65 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef LOGREPLAYDEVICE_HPP
+#define LOGREPLAYDEVICE_HPP
+
+#include <QIODevice>
+#include "logreader.hh"
+
+/* The raw frames of a recording as a read-only random access device
+ *
+ * The bytes come from the mapped file, so a recording of several gigabytes
+ * doesn't take memory. Give it to Lockin::start() to run the lockin again
+ * with other settings.
+ * The positions count from the absolute frame 0 of the recording, so that pos()
+ * gives the time of the recorded values to any reader of a QIODevice : open()
+ * seeks to the first recorded frame, the frames before it read as zeros.
+ */
+
+class LogReplayDevice : public QIODevice
+{
+    Q_OBJECT
+public:
+    explicit LogReplayDevice(QObject *parent = 0);
+
+    bool open(const QString &fileName); // opens the device in ReadOnly
+    void close() override;
+    const LogReader &reader() const;
+    QAudioFormat format() const;
+
+    bool isSequential() const override;
+    qint64 size() const override;
+
+    bool seekTime(qreal time); // seconds since the start of the recording
+    qreal time() const;
+    qint64 frame() const; // absolute index of the next frame read, pos() / bytesPerFrame
+
+protected:
+    qint64 readData(char *data, qint64 maxlen) override;
+    qint64 writeData(const char *data, qint64 len) override;
+
+private:
+    LogReader _reader;
+};
+
+#endif // LOGREPLAYDEVICE_HPP
@@ -0,0 +1,331 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+#include "lowpassfilter.hh"
+#include <cmath>
+
+LowPassFilter::LowPassFilter() :
+    _type(Boxcar), _pushed(0), _order(0), _alpha(0.0), _settling(0),
+    _decimation(1), _firstBlock(-1)
+{
+    _current.id = -1;
+    _current.count = 0;
+    _current.x = _current.y = 0.0;
+    for (int i = 0; i < 4; ++i)
+        _stageX[i] = _stageY[i] = 0.0;
+}
+
+void LowPassFilter::reset(Type type, qreal integrationTime, qreal sampleRate)
+{
+    _type = type;
+    _pushed = 0;
+    _order = order(type);
+
+    // one value at least, value() divides by the window
+    _boxcar.reset(type == Boxcar ? qMax(1, int(sampleRate * integrationTime)) : 0);
+
+    // y += alpha (x - y) for each stage, alpha = 1 - exp(-dt / tau)
+    const qreal samples = qMax<qreal>(1.0, integrationTime * sampleRate);
+    _alpha = -std::expm1(-1.0 / samples);
+    for (int i = 0; i < 4; ++i)
+        _stageX[i] = _stageY[i] = 0.0;
+
+    // time to reach 99% of a step, in tau
+    static const qreal settling[4] = { 4.61, 6.64, 8.41, 10.05 };
+    _settling = _order > 0 ? qint64(std::ceil(settling[_order - 1] * samples)) : 0;
+
+    _decimation = firDecimation(integrationTime, sampleRate);
+    _firstBlock = -1;
+    _current.id = -1;
+    _current.count = 0;
+    _current.x = _current.y = 0.0;
+    _blocks.clear();
+    if (type == Fir) {
+        SubBlock empty = _current;
+        _blocks.fill(empty, 2 * FirTaps);
+    }
+}
+
+// N cascaded stages y += a (x - y) on x and y, no branch and the states in registers :
+// the stages are unrolled and x and y can share the lanes of a vector
+template <int N, typename Real>
+static void cascade(qreal a, qreal *stageX, qreal *stageY, const Real *x, const Real *y, int size)
+{
+    qreal sx[N], sy[N];
+    for (int k = 0; k < N; ++k) {
+        sx[k] = stageX[k];
+        sy[k] = stageY[k];
+    }
+
+    for (int i = 0; i < size; ++i) {
+        qreal vx = x[i];
+        qreal vy = y[i];
+        for (int k = 0; k < N; ++k) {
+            sx[k] += a * (vx - sx[k]);
+            sy[k] += a * (vy - sy[k]);
+            vx = sx[k];
+            vy = sy[k];
+        }
+    }
+
+    for (int k = 0; k < N; ++k) {
+        stageX[k] = sx[k];
+        stageY[k] = sy[k];
+    }
+}
+
+template <typename Real>
+void LowPassFilter::pushIir(const Real *x, const Real *y, int size)
+{
+    switch (_order) {
+    case 1: cascade<1>(_alpha, _stageX, _stageY, x, y, size); break;
+    case 2: cascade<2>(_alpha, _stageX, _stageY, x, y, size); break;
+    case 3: cascade<3>(_alpha, _stageX, _stageY, x, y, size); break;
+    case 4: cascade<4>(_alpha, _stageX, _stageY, x, y, size); break;
+    }
+    _pushed += size;
+}
+
+template <typename Real>
+void LowPassFilter::push(qint64 frame, const Real *x, const Real *y, int size)
+{
+    switch (_type) {
+    case Boxcar:
+        for (int i = 0; i < size; ++i) {
+            if (!std::isnan(x[i]) && !std::isnan(y[i])) {
+                _boxcar.push(frame + i, std::complex<qreal>(x[i], y[i]));
+                _pushed++;
+            }
+        }
+        break;
+
+    case Rc6dB:
+    case Rc12dB:
+    case Rc18dB:
+    case Rc24dB: {
+        // the NaN come in runs (before the lock of the reference, chopper lost) :
+        // one vectorized count for the whole segment, then the runs of values without NaN
+        int valid = 0;
+        for (int i = 0; i < size; ++i)
+            valid += int(x[i] == x[i]) & int(y[i] == y[i]);
+
+        if (valid == size) {
+            pushIir(x, y, size);
+        } else if (valid > 0) {
+            for (int i = 0; i < size;) {
+                while (i < size && (std::isnan(x[i]) || std::isnan(y[i])))
+                    ++i;
+                int end = i;
+                while (end < size && !std::isnan(x[end]) && !std::isnan(y[end]))
+                    ++end;
+                pushIir(x + i, y + i, end - i);
+                i = end;
+            }
+        }
+        break;
+    }
+
+    case Fir:
+        pushFir(frame, x, y, size);
+        break;
+    }
+}
+
+template <typename Real>
+void LowPassFilter::pushFir(qint64 frame, const Real *x, const Real *y, int size)
+{
+    const int mask = _blocks.size() - 1;
+
+    for (int i = 0; i < size; ++i) {
+        if (std::isnan(x[i]) || std::isnan(y[i]))
+            continue;
+
+        const qint64 id = (frame + i) / _decimation;
+        if (id != _current.id) {
+            if (_current.count > 0)
+                _blocks[int(_current.id & mask)] = _current;
+            if (_firstBlock < 0)
+                _firstBlock = id;
+
+            _current.id = id;
+            _current.count = 0;
+            _current.x = _current.y = 0.0;
+        }
+
+        _current.count++;
+        _current.x += x[i];
+        _current.y += y[i];
+        _pushed++;
+    }
+}
+
+template void LowPassFilter::push<float>(qint64 frame, const float *x, const float *y, int size);
+template void LowPassFilter::push<double>(qint64 frame, const double *x, const double *y, int size);
+
+std::complex<qreal> LowPassFilter::value(qint64 frame) const
+{
+    switch (_type) {
+    case Boxcar:
+        return _boxcar.sum() / qreal(_boxcar.window());
+
+    case Rc6dB:
+    case Rc12dB:
+    case Rc18dB:
+    case Rc24dB:
+        return std::complex<qreal>(_stageX[_order - 1], _stageY[_order - 1]);
+
+    case Fir:
+        break;
+    }
+
+    // only the sub blocks that end before frame, the missing ones are ignored
+    const QVector<qreal> &w = firWeights();
+    const int mask = _blocks.size() - 1;
+    const qint64 last = frame / _decimation - 1;
+
+    std::complex<qreal> sum;
+    qreal weights = 0.0;
+    for (int j = 0; j < FirTaps; ++j) {
+        const qint64 id = last - j;
+        const SubBlock &b = id == _current.id ? _current : _blocks[int(id & mask)];
+        if (b.id != id || b.count == 0)
+            continue;
+
+        sum += (w[j] / b.count) * std::complex<qreal>(b.x, b.y);
+        weights += w[j];
+    }
+
+    if (weights == 0.0)
+        return std::complex<qreal>();
+    return sum / weights;
+}
+
+bool LowPassFilter::isFull() const
+{
+    switch (_type) {
+    case Boxcar:
+        return _boxcar.isFull();
+
+    case Rc6dB:
+    case Rc12dB:
+    case Rc18dB:
+    case Rc24dB:
+        return _pushed > 0 && _pushed >= _settling;
+
+    case Fir:
+        break;
+    }
+
+    // the first sub block can be partial
+    return _firstBlock >= 0 && _current.id - FirTaps > _firstBlock;
+}
+
+LowPassFilter::Type LowPassFilter::type() const
+{
+    return _type;
+}
+
+qint64 LowPassFilter::memoryFrames(Type type, qreal integrationTime, qreal sampleRate)
+{
+    const int n = order(type);
+    if (n > 0) {
+        // tail of the step response of n stages : exp(-t) sum_{k<n} t^k/k!, in tau
+        qreal t = 1.0;
+        for (;; t += 0.5) {
+            qreal term = 1.0, tail = 0.0;
+            for (int k = 0; k < n; ++k) {
+                tail += term;
+                term *= t / (k + 1);
+            }
+            if (std::exp(-t) * tail < 1e-16)
+                break;
+        }
+        return qint64(std::ceil(t * qMax<qreal>(1.0, integrationTime * sampleRate)));
+    }
+
+    if (type == Fir)
+        return qint64(FirTaps + 2) * firDecimation(integrationTime, sampleRate);
+
+    return qMax<qint64>(1, qint64(sampleRate * integrationTime));
+}
+
+int LowPassFilter::order(Type type)
+{
+    switch (type) {
+    case Rc6dB: return 1;
+    case Rc12dB: return 2;
+    case Rc18dB: return 3;
+    case Rc24dB: return 4;
+    default: return 0;
+    }
+}
+
+QString LowPassFilter::name(Type type)
+{
+    switch (type) {
+    case Boxcar: return "boxcar";
+    case Rc6dB: return "6db";
+    case Rc12dB: return "12db";
+    case Rc18dB: return "18db";
+    case Rc24dB: return "24db";
+    case Fir: return "fir";
+    }
+    return QString();
+}
+
+bool LowPassFilter::fromName(const QString &name, Type *type)
+{
+    for (int t = Boxcar; t <= Fir; ++t) {
+        if (name.compare(LowPassFilter::name(Type(t)), Qt::CaseInsensitive) == 0) {
+            *type = Type(t);
+            return true;
+        }
+    }
+    return false;
+}
+
+const QVector<qreal> &LowPassFilter::firWeights()
+{
+    static const QVector<qreal> weights = [] {
+        QVector<qreal> w(FirTaps);
+        for (int j = 0; j < FirTaps; ++j) {
+            const qreal u = 2.0 * M_PI * (j + 0.5) / FirTaps;
+            w[j] = 0.42 - 0.5 * std::cos(u) + 0.08 * std::cos(2.0 * u);
+        }
+        return w;
+    }();
+    return weights;
+}
+
+int LowPassFilter::firDecimation(qreal integrationTime, qreal sampleRate)
+{
+    // equivalent noise bandwidth of the window : FirTaps sum(w^2) / sum(w)^2 sub blocks
+    // the window is stretched to have the noise bandwidth of a boxcar of integrationTime
+    const QVector<qreal> &w = firWeights();
+    qreal sum = 0.0, sum2 = 0.0;
+    for (int j = 0; j < FirTaps; ++j) {
+        sum += w[j];
+        sum2 += w[j] * w[j];
+    }
+    const qreal enbw = FirTaps * sum2 / (sum * sum);
+
+    return int(qMax<qint64>(1, qRound64(enbw * integrationTime * sampleRate / FirTaps)));
+}
@@ -0,0 +1,109 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+#ifndef LOWPASSFILTER_HPP
+#define LOWPASSFILTER_HPP
+
+#include <QVector>
+#include <QString>
+#include <complex>
+#include "slidingintegrator.hh"
+
+/* Low pass filter of the demodulated values x + iy
+ *
+ * Boxcar : mean over the integration time (the historic behaviour), memory in integration time.
+ * Rc6dB ... Rc24dB : 1 to 4 cascaded single pole IIR with the time constant tau = integration time,
+ *   like the analog lockins. O(1) memory and cost per value, the NaN are found once per push
+ *   and the runs of values between them go through the stages without branch.
+ * Fir : Blackman window evaluated only at the output frames on the means of 64 sub blocks
+ *   (polyphase decimation), the sub blocks are scaled to the same noise bandwidth as the boxcar.
+ *   O(1) memory, O(1) per value plus 64 products per output.
+ *
+ * The NaN values are ignored. Except for the IIR, the result only depends on the values
+ * and on their frame index, not on the way they were pushed.
+ * The values are float or double (Real), the sums and the states are always double.
+ */
+
+class LowPassFilter
+{
+public:
+    enum Type {
+        Boxcar,
+        Rc6dB,
+        Rc12dB,
+        Rc18dB,
+        Rc24dB,
+        Fir
+    };
+
+    LowPassFilter();
+
+    void reset(Type type, qreal integrationTime, qreal sampleRate); // preallocate and clear
+
+    template <typename Real>
+    void push(qint64 frame, const Real *x, const Real *y, int size); // values of the frames [frame, frame + size)
+    std::complex<qreal> value(qint64 frame) const; // output for the values before frame
+    bool isFull() const; // enough values for a meaningful output
+
+    Type type() const;
+
+    // frames after which the output doesn't depend anymore on the older values (within the rounding for IIR)
+    static qint64 memoryFrames(Type type, qreal integrationTime, qreal sampleRate);
+    static int order(Type type); // number of IIR stages, 0 if not an IIR
+    static QString name(Type type);
+    static bool fromName(const QString &name, Type *type);
+
+    enum { FirTaps = 64 };
+
+private:
+    struct SubBlock {
+        qint64 id; // frame / _decimation
+        int count;
+        qreal x, y;
+    };
+
+    template <typename Real>
+    void pushIir(const Real *x, const Real *y, int size); // values without NaN
+    template <typename Real>
+    void pushFir(qint64 frame, const Real *x, const Real *y, int size);
+    static const QVector<qreal> &firWeights();
+    static int firDecimation(qreal integrationTime, qreal sampleRate);
+
+    Type _type;
+    qint64 _pushed;
+
+    // Boxcar
+    SlidingIntegrator<std::complex<qreal>> _boxcar;
+
+    // IIR
+    int _order;
+    qreal _alpha;
+    qint64 _settling; // values to reach 99% of a step
+    qreal _stageX[4], _stageY[4];
+
+    // FIR
+    int _decimation;
+    qint64 _firstBlock;
+    SubBlock _current;
+    QVector<SubBlock> _blocks; // ring of the complete sub blocks, power of two size
+};
+
+#endif // LOWPASSFILTER_HPP
@@ -0,0 +1,346 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "pcmdecoder.hh"
+#include <QtEndian>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+/* Scalar conversion of one sample
+ * Bytes are assembled explicitly so it works on any host byte order
+ */
+template <int Bytes, QAudioFormat::Endian Order>
+inline quint32 loadBits(const uchar *p)
+{
+    quint32 v = 0;
+    for (int b = 0; b < Bytes; ++b)
+        v |= quint32(p[Order == QAudioFormat::LittleEndian ? b : Bytes - 1 - b]) << (8 * b);
+    return v;
+}
+
+template <typename Real, QAudioFormat::SampleType Type, int Bytes, QAudioFormat::Endian Order>
+struct Sample;
+
+template <typename Real, int Bytes, QAudioFormat::Endian Order>
+struct Sample<Real, QAudioFormat::SignedInt, Bytes, Order> {
+    static inline Real read(const uchar *p)
+    {
+        // sign extension of the Bytes*8 bits value
+        qint32 v = qint32(loadBits<Bytes, Order>(p) << (32 - 8 * Bytes)) >> (32 - 8 * Bytes);
+        return Real(v) * Real(1.0 / double(1u << (8 * Bytes - 1)));
+    }
+};
+
+template <typename Real, int Bytes, QAudioFormat::Endian Order>
+struct Sample<Real, QAudioFormat::UnSignedInt, Bytes, Order> {
+    static inline Real read(const uchar *p)
+    {
+        quint32 v = loadBits<Bytes, Order>(p);
+        return Real(double(v) * (1.0 / double(1u << (8 * Bytes - 1))) - 1.0);
+    }
+};
+
+template <typename Real, QAudioFormat::Endian Order>
+struct Sample<Real, QAudioFormat::Float, 4, Order> {
+    static inline Real read(const uchar *p)
+    {
+        quint32 v = loadBits<4, Order>(p);
+        float f;
+        memcpy(&f, &v, 4);
+        return Real(f);
+    }
+};
+
+template <typename Real, QAudioFormat::SampleType Type, int Bytes, QAudioFormat::Endian Order>
+void decodeGeneric(const char *data, int frames, int channels, Real *const *out)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+    for (int i = 0; i < frames; ++i) {
+        for (int c = 0; c < channels; ++c) {
+            out[c][i] = Sample<Real, Type, Bytes, Order>::read(p);
+            p += Bytes;
+        }
+    }
+}
+
+template <typename Real, QAudioFormat::SampleType Type, int Bytes, QAudioFormat::Endian Order>
+void decodeStereo(const char *data, int frames, int, Real *const *out)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+    Real *left = out[0];
+    Real *right = out[1];
+    for (int i = 0; i < frames; ++i) {
+        left[i] = Sample<Real, Type, Bytes, Order>::read(p);
+        right[i] = Sample<Real, Type, Bytes, Order>::read(p + Bytes);
+        p += 2 * Bytes;
+    }
+}
+
+#if defined(__SSE2__) && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+
+/* Vectorized stereo kernels for the native byte order
+ * They process 4 frames per iteration (8 with AVX2) and finish with the scalar loop
+ */
+
+inline void store4(float *dst, __m128i v, float scale)
+{
+    _mm_storeu_ps(dst, _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(scale)));
+}
+
+inline void store4(double *dst, __m128i v, double scale)
+{
+    __m128d s = _mm_set1_pd(scale);
+    _mm_storeu_pd(dst, _mm_mul_pd(_mm_cvtepi32_pd(v), s));
+    _mm_storeu_pd(dst + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(3, 2, 3, 2))), s));
+}
+
+inline void store4(float *dst, __m128 v)
+{
+    _mm_storeu_ps(dst, v);
+}
+
+inline void store4(double *dst, __m128 v)
+{
+    _mm_storeu_pd(dst, _mm_cvtps_pd(v));
+    _mm_storeu_pd(dst + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+}
+
+#if defined(__AVX2__)
+inline void store8(float *dst, __m256i v, float scale)
+{
+    _mm256_storeu_ps(dst, _mm256_mul_ps(_mm256_cvtepi32_ps(v), _mm256_set1_ps(scale)));
+}
+
+inline void store8(double *dst, __m256i v, double scale)
+{
+    __m256d s = _mm256_set1_pd(scale);
+    _mm256_storeu_pd(dst, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(v)), s));
+    _mm256_storeu_pd(dst + 4, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1)), s));
+}
+#endif
+
+template <typename Real>
+void decodeStereoS16(const char *data, int frames, int channels, Real *const *out)
+{
+    const Real scale = Real(1.0 / 32768.0);
+    Real *left = out[0];
+    Real *right = out[1];
+    int i = 0;
+
+#if defined(__AVX2__)
+    for (; i + 8 <= frames; i += 8) {
+        // each 32 bits lane holds one frame : right << 16 | left
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 4 * i));
+        store8(left + i, _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16), scale);
+        store8(right + i, _mm256_srai_epi32(v, 16), scale);
+    }
+#endif
+
+    for (; i + 4 <= frames; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 4 * i));
+        store4(left + i, _mm_srai_epi32(_mm_slli_epi32(v, 16), 16), scale);
+        store4(right + i, _mm_srai_epi32(v, 16), scale);
+    }
+
+    if (i < frames) {
+        Real *rest[2] = { left + i, right + i };
+        decodeStereo<Real, QAudioFormat::SignedInt, 2, QAudioFormat::LittleEndian>(data + 4 * i, frames - i, channels, rest);
+    }
+}
+
+template <typename Real>
+void decodeStereoS32(const char *data, int frames, int channels, Real *const *out)
+{
+    const Real scale = Real(1.0 / 2147483648.0);
+    Real *left = out[0];
+    Real *right = out[1];
+    int i = 0;
+
+    for (; i + 4 <= frames; i += 4) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 8 * i)); // L0 R0 L1 R1
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 8 * i + 16)); // L2 R2 L3 R3
+        a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0)); // L0 L1 R0 R1
+        b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0)); // L2 L3 R2 R3
+        store4(left + i, _mm_unpacklo_epi64(a, b), scale);
+        store4(right + i, _mm_unpackhi_epi64(a, b), scale);
+    }
+
+    if (i < frames) {
+        Real *rest[2] = { left + i, right + i };
+        decodeStereo<Real, QAudioFormat::SignedInt, 4, QAudioFormat::LittleEndian>(data + 8 * i, frames - i, channels, rest);
+    }
+}
+
+template <typename Real>
+void decodeStereoF32(const char *data, int frames, int channels, Real *const *out)
+{
+    Real *left = out[0];
+    Real *right = out[1];
+    int i = 0;
+
+    for (; i + 4 <= frames; i += 4) {
+        __m128 a = _mm_loadu_ps(reinterpret_cast<const float *>(data + 8 * i)); // L0 R0 L1 R1
+        __m128 b = _mm_loadu_ps(reinterpret_cast<const float *>(data + 8 * i + 16)); // L2 R2 L3 R3
+        store4(left + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        store4(right + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+
+    if (i < frames) {
+        Real *rest[2] = { left + i, right + i };
+        decodeStereo<Real, QAudioFormat::Float, 4, QAudioFormat::LittleEndian>(data + 8 * i, frames - i, channels, rest);
+    }
+}
+
+#define LOCKIN_SIMD_DECODER
+
+#endif
+
+template <typename Real, QAudioFormat::SampleType Type, int Bytes, QAudioFormat::Endian Order>
+void (*selectKernel(int channels))(const char *, int, int, Real *const *)
+{
+#ifdef LOCKIN_SIMD_DECODER
+    if (channels == 2 && Order == QAudioFormat::LittleEndian) {
+        if (Type == QAudioFormat::SignedInt && Bytes == 2)
+            return &decodeStereoS16<Real>;
+        if (Type == QAudioFormat::SignedInt && Bytes == 4)
+            return &decodeStereoS32<Real>;
+        if (Type == QAudioFormat::Float)
+            return &decodeStereoF32<Real>;
+    }
+#endif
+    if (channels == 2)
+        return &decodeStereo<Real, Type, Bytes, Order>;
+    return &decodeGeneric<Real, Type, Bytes, Order>;
+}
+
+template <typename Real, QAudioFormat::SampleType Type, QAudioFormat::Endian Order>
+void (*selectKernel(int bytes, int channels))(const char *, int, int, Real *const *)
+{
+    switch (bytes) {
+    case 1: return selectKernel<Real, Type, 1, Order>(channels);
+    case 2: return selectKernel<Real, Type, 2, Order>(channels);
+    case 3: return selectKernel<Real, Type, 3, Order>(channels);
+    case 4: return selectKernel<Real, Type, 4, Order>(channels);
+    }
+    return nullptr;
+}
+
+template <typename Real, QAudioFormat::Endian Order>
+void (*selectKernel(QAudioFormat::SampleType type, int bytes, int channels))(const char *, int, int, Real *const *)
+{
+    switch (type) {
+    case QAudioFormat::SignedInt:
+        return selectKernel<Real, QAudioFormat::SignedInt, Order>(bytes, channels);
+    case QAudioFormat::UnSignedInt:
+        return selectKernel<Real, QAudioFormat::UnSignedInt, Order>(bytes, channels);
+    case QAudioFormat::Float:
+        if (bytes == 4)
+            return selectKernel<Real, QAudioFormat::Float, 4, Order>(channels);
+        return nullptr;
+    case QAudioFormat::Unknown:
+        break;
+    }
+    return nullptr;
+}
+
+} // namespace
+
+template <typename Real>
+PcmDecoder<Real>::PcmDecoder() :
+    _kernel(nullptr), _channels(0), _frameSize(0)
+{
+}
+
+template <typename Real>
+bool PcmDecoder<Real>::setFormat(const QAudioFormat &format)
+{
+    _kernel = nullptr;
+    _channels = 0;
+    _frameSize = 0;
+
+    if (!isFormatSupported(format))
+        return false;
+
+    const int bytes = format.sampleSize() / 8;
+
+    if (format.byteOrder() == QAudioFormat::LittleEndian)
+        _kernel = selectKernel<Real, QAudioFormat::LittleEndian>(format.sampleType(), bytes, format.channelCount());
+    else
+        _kernel = selectKernel<Real, QAudioFormat::BigEndian>(format.sampleType(), bytes, format.channelCount());
+
+    if (_kernel == nullptr)
+        return false;
+
+    _channels = format.channelCount();
+    _frameSize = bytes * _channels;
+    return true;
+}
+
+template <typename Real>
+bool PcmDecoder<Real>::isFormatSupported(const QAudioFormat &format)
+{
+    if (format.codec() != "audio/pcm" || format.channelCount() < 1)
+        return false;
+
+    switch (format.sampleType()) {
+    case QAudioFormat::SignedInt:
+    case QAudioFormat::UnSignedInt:
+        return format.sampleSize() == 8 || format.sampleSize() == 16
+                || format.sampleSize() == 24 || format.sampleSize() == 32;
+    case QAudioFormat::Float:
+        return format.sampleSize() == 32;
+    case QAudioFormat::Unknown:
+        break;
+    }
+    return false;
+}
+
+template <typename Real>
+int PcmDecoder<Real>::channelCount() const
+{
+    return _channels;
+}
+
+template <typename Real>
+int PcmDecoder<Real>::frameSize() const
+{
+    return _frameSize;
+}
+
+template <typename Real>
+void PcmDecoder<Real>::decode(const char *data, int frames, Real *const *out) const
+{
+    Q_ASSERT(_kernel != nullptr);
+    if (frames > 0)
+        _kernel(data, frames, _channels, out);
+}
+
+template class PcmDecoder<float>;
+template class PcmDecoder<double>;
@@ -0,0 +1,60 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef PCMDECODER_HPP
+#define PCMDECODER_HPP
+
+#include <QAudioFormat>
+
+/* Converts blocks of interleaved PCM frames into planar channels
+ * with values in the interval (-1, 1)
+ *
+ * The conversion function is chosen once in setFormat(), the supported formats are
+ * signed/unsigned integers of 8, 16, 24 or 32 bits and 32 bits floats, in both byte orders.
+ * Stereo 16/32 bits integers and floats in the native byte order use SSE2 (and AVX2
+ * when compiled with -mavx2), everything else a scalar loop.
+ */
+
+template <typename Real>
+class PcmDecoder
+{
+public:
+    PcmDecoder();
+
+    bool setFormat(const QAudioFormat &format); // return false if the format is not supported
+    static bool isFormatSupported(const QAudioFormat &format);
+
+    int channelCount() const;
+    int frameSize() const; // in bytes
+
+    // out[c] must have room for frames values, to swap two channels swap the pointers
+    void decode(const char *data, int frames, Real *const *out) const;
+
+private:
+    typedef void (*Kernel)(const char *data, int frames, int channels, Real *const *out);
+
+    Kernel _kernel;
+    int _channels;
+    int _frameSize;
+};
+
+#endif // PCMDECODER_HPP
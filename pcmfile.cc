@@ -0,0 +1,207 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "pcmfile.hh"
+#include <QtEndian>
+
+PcmFile::PcmFile() :
+    _dataOffset(0), _dataSize(0), _position(0)
+{
+}
+
+bool PcmFile::open(const QString &fileName)
+{
+    close();
+    _file.setFileName(fileName);
+
+    if (!_file.open(QIODevice::ReadOnly)) {
+        _error = _file.errorString();
+        return false;
+    }
+
+    if (!parseWavHeader()) {
+        close();
+        return false;
+    }
+
+    return seek(0);
+}
+
+bool PcmFile::openRaw(const QString &fileName, const QAudioFormat &format)
+{
+    close();
+    _file.setFileName(fileName);
+
+    if (!_file.open(QIODevice::ReadOnly)) {
+        _error = _file.errorString();
+        return false;
+    }
+
+    if (!format.isValid()) {
+        _error = "invalid format";
+        close();
+        return false;
+    }
+
+    _format = format;
+    _dataOffset = 0;
+    _dataSize = _file.size() - _file.size() % format.bytesPerFrame();
+
+    return seek(0);
+}
+
+void PcmFile::close()
+{
+    _file.close();
+    _format = QAudioFormat();
+    _dataOffset = _dataSize = _position = 0;
+}
+
+const QAudioFormat &PcmFile::format() const
+{
+    return _format;
+}
+
+qint64 PcmFile::frameCount() const
+{
+    if (_format.bytesPerFrame() == 0)
+        return 0;
+    return _dataSize / _format.bytesPerFrame();
+}
+
+QString PcmFile::errorString() const
+{
+    return _error;
+}
+
+bool PcmFile::seek(qint64 frame)
+{
+    qint64 position = qBound<qint64>(0, frame * _format.bytesPerFrame(), _dataSize);
+    if (!_file.seek(_dataOffset + position)) {
+        _error = _file.errorString();
+        return false;
+    }
+    _position = position;
+    return true;
+}
+
+qint64 PcmFile::read(char *data, qint64 frames)
+{
+    const int frameSize = _format.bytesPerFrame();
+    qint64 bytes = qMin(frames * frameSize, _dataSize - _position);
+
+    bytes = _file.read(data, bytes);
+    if (bytes < 0) {
+        _error = _file.errorString();
+        return 0;
+    }
+
+    // keep the position on a frame boundary
+    qint64 extra = bytes % frameSize;
+    if (extra != 0)
+        _file.seek(_dataOffset + _position + bytes - extra);
+
+    _position += bytes - extra;
+    return bytes / frameSize;
+}
+
+bool PcmFile::parseWavHeader()
+{
+    QByteArray riff = _file.read(12);
+    if (riff.size() != 12 || !riff.startsWith("RIFF") || riff.mid(8, 4) != "WAVE") {
+        _error = "not a RIFF/WAVE file";
+        return false;
+    }
+
+    bool fmt = false;
+
+    while (!_file.atEnd()) {
+        QByteArray chunk = _file.read(8);
+        if (chunk.size() != 8)
+            break;
+
+        const QByteArray id = chunk.left(4);
+        const quint32 size = qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(chunk.constData() + 4));
+
+        if (id == "fmt ") {
+            QByteArray h = _file.read(size);
+            if (h.size() < 16) {
+                _error = "truncated fmt chunk";
+                return false;
+            }
+            const uchar *p = reinterpret_cast<const uchar *>(h.constData());
+
+            quint16 tag = qFromLittleEndian<quint16>(p);
+            quint16 channels = qFromLittleEndian<quint16>(p + 2);
+            quint32 rate = qFromLittleEndian<quint32>(p + 4);
+            quint16 bits = qFromLittleEndian<quint16>(p + 14);
+
+            if (tag == 0xFFFE && h.size() >= 26) {
+                // WAVE_FORMAT_EXTENSIBLE, the format is the begining of the sub format GUID
+                tag = qFromLittleEndian<quint16>(p + 24);
+            }
+
+            _format = QAudioFormat();
+            _format.setCodec("audio/pcm");
+            _format.setByteOrder(QAudioFormat::LittleEndian);
+            _format.setChannelCount(channels);
+            _format.setSampleRate(rate);
+            _format.setSampleSize(bits);
+
+            if (tag == 1) {
+                // 8 bits WAV are unsigned, the others signed
+                _format.setSampleType(bits == 8 ? QAudioFormat::UnSignedInt : QAudioFormat::SignedInt);
+            } else if (tag == 3) {
+                _format.setSampleType(QAudioFormat::Float);
+            } else {
+                _error = QString("unsupported WAV format tag %1").arg(tag);
+                return false;
+            }
+
+            if (_format.bytesPerFrame() <= 0) {
+                _error = "invalid WAV format";
+                return false;
+            }
+
+            fmt = true;
+        } else if (id == "data") {
+            if (!fmt) {
+                _error = "data chunk before fmt chunk";
+                return false;
+            }
+
+            _dataOffset = _file.pos();
+            // the size of streamed WAV can be wrong (0 or 0xFFFFFFFF)
+            _dataSize = qMin<qint64>(size, _file.size() - _dataOffset);
+            if (size == 0)
+                _dataSize = _file.size() - _dataOffset;
+            _dataSize -= _dataSize % _format.bytesPerFrame();
+            return true;
+        } else {
+            // chunks are padded to an even size
+            _file.seek(_file.pos() + size + (size & 1));
+        }
+    }
+
+    _error = "no data chunk";
+    return false;
+}
@@ -0,0 +1,60 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef PCMFILE_HPP
+#define PCMFILE_HPP
+
+#include <QAudioFormat>
+#include <QFile>
+
+/* Sequential reader of recorded sound : WAV files (PCM or float)
+ * or raw interleaved PCM with a format given by the user
+ */
+
+class PcmFile
+{
+public:
+    PcmFile();
+
+    bool open(const QString &fileName); // WAV
+    bool openRaw(const QString &fileName, const QAudioFormat &format);
+    void close();
+
+    const QAudioFormat &format() const;
+    qint64 frameCount() const;
+    QString errorString() const;
+
+    bool seek(qint64 frame);
+    qint64 read(char *data, qint64 frames); // return the number of frames read
+
+private:
+    bool parseWavHeader();
+
+    QFile _file;
+    QAudioFormat _format;
+    qint64 _dataOffset; // in bytes
+    qint64 _dataSize; // in bytes
+    qint64 _position; // in bytes from _dataOffset
+    QString _error;
+};
+
+#endif // PCMFILE_HPP
@@ -0,0 +1,103 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "referenceoscillator.hh"
+#include <cmath>
+
+ReferenceOscillator::ReferenceOscillator()
+{
+    reset(0.0, 1.0);
+}
+
+bool ReferenceOscillator::reset(qreal frequency, qreal sampleRate, qint64 firstFrame)
+{
+    // frequency < sampleRate / 2, so the step fits in 63 bits (at sampleRate / 2 it would wrap to -pi)
+    const bool ok = frequency > 0.0 && frequency < 0.5 * sampleRate;
+    _sampleRate = sampleRate;
+    _step = ok ? quint64(std::ldexp(frequency / sampleRate, 64)) : 0;
+
+    const qreal w = std::ldexp(qreal(qint64(_step)), -64) * 2.0 * M_PI;
+    _wr = std::cos(w);
+    _wi = std::sin(w);
+
+    // from the previous restart, as if the oscillator had been running since then
+    _frame = firstFrame - ((firstFrame % Restart) + Restart) % Restart;
+    restart();
+    while (_frame < firstFrame) {
+        qreal r = _zr * _wr - _zi * _wi;
+        _zi = _zr * _wi + _zi * _wr;
+        _zr = r;
+        _frame++;
+    }
+    return ok;
+}
+
+void ReferenceOscillator::restart()
+{
+    // the product wraps around 2^64, seen as signed it is the phase in [-pi, pi)
+    const qint64 phase = qint64(_step * quint64(_frame));
+    const qreal p = std::ldexp(qreal(phase), -64) * 2.0 * M_PI;
+    _zr = std::cos(p);
+    _zi = std::sin(p);
+}
+
+template <typename Real>
+void ReferenceOscillator::process(int size, Real *cos, Real *sin)
+{
+    int i = 0;
+    while (i < size) {
+        const int offset = int(((_frame % Restart) + Restart) % Restart);
+        if (offset == 0)
+            restart();
+
+        const int begin = i;
+        const int end = qMin(size, i + Restart - offset);
+        qreal zr = _zr, zi = _zi;
+        const qreal wr = _wr, wi = _wi;
+
+        for (; i < end; ++i) {
+            cos[i] = Real(zr);
+            sin[i] = Real(zi);
+
+            qreal r = zr * wr - zi * wi;
+            zi = zr * wi + zi * wr;
+            zr = r;
+        }
+
+        _frame += end - begin;
+        _zr = zr;
+        _zi = zi;
+    }
+}
+
+qint64 ReferenceOscillator::frame() const
+{
+    return _frame;
+}
+
+qreal ReferenceOscillator::frequency() const
+{
+    return std::ldexp(qreal(_step), -64) * _sampleRate;
+}
+
+template void ReferenceOscillator::process<float>(int size, float *cos, float *sin);
+template void ReferenceOscillator::process<double>(int size, double *cos, double *sin);
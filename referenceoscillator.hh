@@ -0,0 +1,67 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef REFERENCEOSCILLATOR_HPP
+#define REFERENCEOSCILLATOR_HPP
+
+#include <QtGlobal>
+
+/* Internal reference : cos/sin of a fixed frequency, when there is no chopper channel
+ *
+ * The phase is a 64 bits accumulator (2^64 is a turn), so the phase of any
+ * absolute frame is exact and doesn't depend on the blocks (needed by BatchProcessor).
+ * cos/sin are produced by a recursive rotator restarted from the accumulator
+ * on the multiples of Restart frames, so its rounding errors don't grow.
+ * The phase is zero at the frame 0. The output is float or double (Real), the rotator is double.
+ */
+
+class ReferenceOscillator
+{
+public:
+    ReferenceOscillator();
+
+    // firstFrame is the absolute index of the next sample
+    // false if frequency is not in (0, sampleRate / 2), the output is then cos 1 sin 0
+    bool reset(qreal frequency, qreal sampleRate, qint64 firstFrame = 0);
+
+    // write the cos/sin of the next size samples
+    template <typename Real>
+    void process(int size, Real *cos, Real *sin);
+
+    qint64 frame() const;
+    qreal frequency() const; // rounded to the resolution of the accumulator
+
+private:
+    enum { Restart = 256 };
+
+    void restart(); // exact rotator at _frame
+
+    quint64 _step; // phase increment per frame
+    qreal _sampleRate;
+    qint64 _frame; // absolute index of the next sample
+
+    // rotator : z = exp(i phase), multiplied by w = exp(i 2 pi step / 2^64) at each sample
+    qreal _zr, _zi;
+    qreal _wr, _wi;
+};
+
+#endif // REFERENCEOSCILLATOR_HPP
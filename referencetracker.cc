@@ -0,0 +1,153 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "referencetracker.hh"
+#include <cmath>
+
+ReferenceTracker::ReferenceTracker(int memory) :
+    _memory(qBound(1, memory, int(MaxMemory)))
+{
+    reset();
+}
+
+void ReferenceTracker::reset(qint64 firstFrame)
+{
+    _frame = firstFrame;
+    _hasLast = false;
+    _last = 0.0;
+    unlock();
+}
+
+void ReferenceTracker::unlock()
+{
+    _edgeCount = 0;
+    _edgeNext = 0;
+    _lastEdge = 0.0;
+    _period = 0.0;
+    _settledFrame = -1;
+    _zr = _zi = NAN;
+    _wr = 1.0;
+    _wi = 0.0;
+}
+
+qint64 ReferenceTracker::frame() const
+{
+    return _frame;
+}
+
+bool ReferenceTracker::isLocked() const
+{
+    return _period > 0.0;
+}
+
+qint64 ReferenceTracker::settledFrame() const
+{
+    return _settledFrame;
+}
+
+qreal ReferenceTracker::period() const
+{
+    return _period;
+}
+
+void ReferenceTracker::addEdge(qreal edge)
+{
+    const int ring = _memory + 1;
+
+    _edges[_edgeNext] = edge;
+    _lastEdge = edge;
+    _edgeNext = (_edgeNext + 1) % ring;
+    if (_edgeCount < ring)
+        _edgeCount++;
+
+    if (_edgeCount >= 2) {
+        // mean of the periods in memory
+        qreal oldest = _edges[(_edgeNext - _edgeCount + ring) % ring];
+        _period = (edge - oldest) / qreal(_edgeCount - 1);
+    }
+}
+
+template <typename Real>
+void ReferenceTracker::process(const Real *chopper, int size, Real *cos, Real *sin)
+{
+    const int ring = _memory + 1;
+
+    qreal zr = _zr, zi = _zi, wr = _wr, wi = _wi;
+
+    for (int i = 0; i < size; ++i) {
+        const qreal v = chopper[i];
+        const qint64 t = _frame + i;
+
+        if (_hasLast && _last < 0.0 && v >= 0.0) {
+            // rising edge between t - 1 and t
+            qreal edge = qreal(t - 1) + _last / (_last - v);
+
+            bool accept = true;
+            if (isLocked()) {
+                // reject the glitches of a noisy chopper
+                accept = edge - _lastEdge > 0.5 * _period;
+            }
+
+            if (accept) {
+                addEdge(edge);
+
+                if (_settledFrame < 0 && _edgeCount == ring)
+                    _settledFrame = t;
+
+                if (isLocked()) {
+                    qreal phase = 2.0 * M_PI * (qreal(t) - edge) / _period;
+                    zr = std::cos(phase);
+                    zi = std::sin(phase);
+                    wr = std::cos(2.0 * M_PI / _period);
+                    wi = std::sin(2.0 * M_PI / _period);
+                }
+            }
+        } else if (isLocked()) {
+            if (qreal(t) - _lastEdge > 2.5 * _period) {
+                // the chopper has stopped
+                unlock();
+                zr = zi = NAN;
+                wr = 1.0;
+                wi = 0.0;
+            }
+        }
+
+        _last = v;
+        _hasLast = true;
+
+        cos[i] = Real(zr);
+        sin[i] = Real(zi);
+
+        qreal r = zr * wr - zi * wi;
+        zi = zr * wi + zi * wr;
+        zr = r;
+    }
+
+    _frame += size;
+    _zr = zr;
+    _zi = zi;
+    _wr = wr;
+    _wi = wi;
+}
+
+template void ReferenceTracker::process<float>(const float *chopper, int size, float *cos, float *sin);
+template void ReferenceTracker::process<double>(const double *chopper, int size, double *cos, double *sin);
@@ -0,0 +1,84 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef REFERENCETRACKER_HPP
+#define REFERENCETRACKER_HPP
+
+#include <QtGlobal>
+
+/* Follows the chopper signal from block to block and builds its cos/sin
+ *
+ * An edge-resynchronised estimator, not a PLL : rising edges are located between
+ * two samples by linear interpolation, the period is the mean of the last `memory`
+ * periods and the phase is set to zero at each edge. The jitter of an edge goes
+ * straight into the phase until the next one, and which edges are kept depends on
+ * the glitch rejection (an edge closer than half a period to the previous one is dropped).
+ * Between two edges the phase keeps running, so the samples after the last
+ * edge of a block are not lost. The finite memory makes the output depend only
+ * on the last `memory` periods (needed by BatchProcessor, a loop filter would never forget).
+ *
+ * cos/sin are produced by a recursive rotator restarted at each edge
+ * and carried from one block to the next.
+ * The output is NaN until the first two edges and after a loss of the chopper.
+ * The samples are float or double (Real), the edges and the rotator are always double.
+ */
+
+class ReferenceTracker
+{
+public:
+    explicit ReferenceTracker(int memory = 8);
+
+    void reset(qint64 firstFrame = 0); // firstFrame is the absolute index of the next sample
+
+    // chopper[0] is the sample of absolute index frame(), write size values in cos and sin
+    template <typename Real>
+    void process(const Real *chopper, int size, Real *cos, Real *sin);
+
+    qint64 frame() const;
+    bool isLocked() const;
+    qint64 settledFrame() const; // first frame computed with `memory` periods of history, -1 if none
+    qreal period() const; // in samples, 0 when not locked
+
+private:
+    void addEdge(qreal edge);
+    void unlock();
+
+    enum { MaxMemory = 64 };
+
+    int _memory;
+    qint64 _frame; // absolute index of the next sample
+    qreal _last; // last chopper sample
+    bool _hasLast;
+
+    qreal _edges[MaxMemory + 1]; // ring of the last edges, absolute fractional index
+    int _edgeCount; // number of edges in the ring
+    int _edgeNext; // next position in the ring
+    qreal _lastEdge;
+    qreal _period;
+    qint64 _settledFrame;
+
+    // rotator : z = exp(i phase), multiplied by w = exp(i 2 pi / period) at each sample
+    qreal _zr, _zi;
+    qreal _wr, _wi;
+};
+
+#endif // REFERENCETRACKER_HPP
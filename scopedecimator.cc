@@ -0,0 +1,98 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "scopedecimator.hh"
+#include <cmath>
+
+ScopeDecimator::ScopeDecimator() :
+    _columns(1), _xmin(0.0), _xmax(1.0)
+{
+}
+
+void ScopeDecimator::setColumns(int columns)
+{
+    _columns = qMax(1, columns);
+}
+
+int ScopeDecimator::columns() const
+{
+    return _columns;
+}
+
+void ScopeDecimator::setRange(qreal xmin, qreal xmax)
+{
+    _xmin = xmin;
+    _xmax = xmax;
+}
+
+void ScopeDecimator::decimate(const qreal *y, int size, qreal x0, qreal dx, QList<QPointF> *points) const
+{
+    PointWriter out(points);
+
+    if (size <= 0 || dx <= 0.0 || _xmax <= _xmin)
+        return;
+
+    // visible samples
+    int begin = qMax(0, int(std::floor((_xmin - x0) / dx)));
+    int end = qMin(size, int(std::ceil((_xmax - x0) / dx)) + 1);
+
+    const qreal samplesPerColumn = (_xmax - _xmin) / dx / qreal(_columns);
+
+    if (samplesPerColumn < 3.0) {
+        for (int i = begin; i < end; ++i) {
+            if (!std::isnan(y[i]))
+                out.put(x0 + i * dx, y[i]);
+        }
+        return;
+    }
+
+    const qreal columnsPerSample = 1.0 / samplesPerColumn;
+    const qreal first = (x0 - _xmin) / dx * columnsPerSample;
+
+    int column = -1;
+    int imin = -1, imax = -1;
+
+    for (int i = begin; i <= end; ++i) {
+        int c = i < end ? int(first + i * columnsPerSample) : -2;
+
+        if (c != column && imin >= 0) {
+            // keep the order of the samples so the line stays continuous
+            int a = qMin(imin, imax), b = qMax(imin, imax);
+            out.put(x0 + a * dx, y[a]);
+            if (b != a)
+                out.put(x0 + b * dx, y[b]);
+            imin = imax = -1;
+        }
+        column = c;
+
+        if (i == end || std::isnan(y[i]))
+            continue;
+
+        if (imin < 0) {
+            imin = imax = i;
+        } else if (y[i] < y[imin]) {
+            imin = i;
+        } else if (y[i] > y[imax]) {
+            imax = i;
+        }
+    }
+}
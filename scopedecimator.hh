@@ -0,0 +1,80 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef SCOPEDECIMATOR_HPP
+#define SCOPEDECIMATOR_HPP
+
+#include <QList>
+#include <QPointF>
+
+/* Reduces a trace to at most one min/max pair of vertices per pixel column
+ *
+ * The points are written in place into the list given to decimate(), its
+ * elements are reused from one call to the next so nothing is allocated
+ * as long as the number of points doesn't grow. A column with fewer than
+ * three samples keeps its samples as they are.
+ */
+
+class ScopeDecimator
+{
+public:
+    ScopeDecimator();
+
+    void setColumns(int columns); // number of pixel columns of the graph
+    int columns() const;
+    void setRange(qreal xmin, qreal xmax); // visible x range, the samples outside are ignored
+
+    // y[i] is at x = x0 + i * dx, the NaN samples are skipped
+    void decimate(const qreal *y, int size, qreal x0, qreal dx, QList<QPointF> *points) const;
+
+private:
+    int _columns;
+    qreal _xmin;
+    qreal _xmax;
+};
+
+// overwrite the points already in the list, append only when it is too short
+class PointWriter
+{
+public:
+    PointWriter(QList<QPointF> *points) : _points(points), _count(0) {}
+    ~PointWriter()
+    {
+        while (_points->size() > _count)
+            _points->removeLast();
+    }
+
+    void put(qreal x, qreal y)
+    {
+        if (_count < _points->size())
+            (*_points)[_count] = QPointF(x, y);
+        else
+            _points->append(QPointF(x, y));
+        _count++;
+    }
+
+private:
+    QList<QPointF> *_points;
+    int _count;
+};
+
+#endif // SCOPEDECIMATOR_HPP
@@ -0,0 +1,218 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+#include "shmpublisher.hh"
+#include <atomic>
+#include <cstring>
+#include <new>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+static quint64 align64(quint64 size)
+{
+    return (size + 63) & ~quint64(63);
+}
+
+ShmPublisher::ShmPublisher() :
+    _header(nullptr), _map(nullptr)
+{
+}
+
+ShmPublisher::~ShmPublisher()
+{
+    close();
+}
+
+QByteArray ShmPublisher::shmName(const QString &name)
+{
+    QByteArray n = name.toLocal8Bit();
+    if (!n.startsWith("/"))
+        n = "/" + n;
+    return n;
+}
+
+bool ShmPublisher::open(const QString &name, qint64 valueBytes, qint64 scopeBytes)
+{
+    close();
+
+#ifdef Q_OS_UNIX
+    _name = shmName(name);
+
+    const quint64 valuesOffset = align64(sizeof(ShmHeader));
+    const quint64 scopeOffset = valuesOffset + align64(valueBytes);
+    const quint64 size = scopeOffset + align64(scopeBytes);
+
+    int fd = shm_open(_name.constData(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        _error = QString("shm_open: %1").arg(strerror(errno));
+        return false;
+    }
+    if (ftruncate(fd, size) != 0) {
+        _error = QString("ftruncate: %1").arg(strerror(errno));
+        ::close(fd);
+        shm_unlink(_name.constData());
+        return false;
+    }
+
+    void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        _error = QString("mmap: %1").arg(strerror(errno));
+        shm_unlink(_name.constData());
+        return false;
+    }
+
+    _map = static_cast<char *>(map);
+
+    // a reader of a previous publisher sees a bad magic until the header is ready
+    memset(_map, 0, sizeof(ShmHeader));
+    _header = new (_map) ShmHeader;
+    _header->version = 1;
+    _header->headerSize = sizeof(ShmHeader);
+    _header->size = size;
+    _header->values.offset = valuesOffset;
+    _header->values.bytes = scopeOffset - valuesOffset;
+    _header->scope.offset = scopeOffset;
+    _header->scope.bytes = size - scopeOffset;
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(_header->magic, "LOCKINSM", 8);
+
+    return true;
+#else
+    Q_UNUSED(name);
+    Q_UNUSED(valueBytes);
+    Q_UNUSED(scopeBytes);
+    _error = "shared memory is not supported on this platform";
+    return false;
+#endif
+}
+
+void ShmPublisher::close()
+{
+#ifdef Q_OS_UNIX
+    if (_map != nullptr) {
+        munmap(_map, _header->size);
+        shm_unlink(_name.constData());
+    }
+#endif
+    _map = nullptr;
+    _header = nullptr;
+}
+
+bool ShmPublisher::isOpen() const
+{
+    return _header != nullptr;
+}
+
+QString ShmPublisher::errorString() const
+{
+    return _error;
+}
+
+void ShmPublisher::configure(int sampleRate, int channelCount, const QVector<int> &channels, const QVector<int> &harmonics)
+{
+    ShmHeader *h = _header;
+
+    // odd : the readers retry
+    h->sequence.fetchAndAddOrdered(1);
+
+    h->generation++;
+    h->sampleRate = sampleRate;
+    h->channelCount = channelCount;
+    h->valueCount = qMin<int>(channels.size(), ShmHeader::MaxValues);
+    for (int k = 0; k < h->valueCount; ++k) {
+        h->valueChannel[k] = channels[k];
+        h->valueHarmonic[k] = harmonics[k];
+    }
+
+    h->values.recordSize = sizeof(double) * (1 + 2 * h->valueCount);
+    h->values.capacity = h->values.bytes / h->values.recordSize;
+    h->values.writing.store(0);
+    h->values.written.store(0);
+
+    h->scope.recordSize = sizeof(double) * (channelCount + 2);
+    h->scope.capacity = h->scope.bytes / h->scope.recordSize;
+    h->scope.writing.store(0);
+    h->scope.written.store(0);
+
+    h->sequence.fetchAndAddRelease(1);
+}
+
+void ShmPublisher::appendValue(const LockinOutput &output)
+{
+    ShmRing &ring = _header->values;
+    const quint64 i = ring.written.load();
+
+    ring.writing.store(i + 1);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    double *record = reinterpret_cast<double *>(_map + ring.offset + (i % ring.capacity) * ring.recordSize);
+    record[0] = output.time;
+    const int count = qMin<int>(output.values.size(), _header->valueCount);
+    for (int k = 0; k < count; ++k) {
+        record[1 + 2 * k] = output.values[k].x;
+        record[2 + 2 * k] = output.values[k].y;
+    }
+
+    ring.written.storeRelease(i + 1);
+}
+
+void ShmPublisher::appendScope(const LockinEngine &engine)
+{
+    ShmRing &ring = _header->scope;
+    const int channels = _header->channelCount;
+    const quint64 frames = engine.blockFrames();
+    const quint64 begin = ring.written.load();
+    const quint64 end = begin + frames;
+
+    ring.writing.store(end);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // only the last capacity frames fit
+    const quint64 first = end - qMin(frames, ring.capacity);
+    const int skip = int(first - begin);
+    const int count = int(end - first);
+
+    // column by column, the engine may work in float
+    _scopeBuffer.resize(2 * count);
+    for (int c = 0; c < channels + 1; ++c) {
+        qreal *in = _scopeBuffer.data();
+        if (c < channels)
+            engine.copyChannel(c, skip, count, in);
+        else
+            engine.copyReference(skip, count, in, in + count);
+
+        for (int j = 0; j < count; ++j) {
+            double *record = reinterpret_cast<double *>(_map + ring.offset + ((first + j) % ring.capacity) * ring.recordSize);
+            record[c] = in[j];
+            if (c == channels)
+                record[c + 1] = in[count + j];
+        }
+    }
+
+    ring.written.storeRelease(end);
+}
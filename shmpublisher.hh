@@ -0,0 +1,112 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+#ifndef SHMPUBLISHER_HPP
+#define SHMPUBLISHER_HPP
+
+#include <QString>
+#include <QVector>
+#include <QAtomicInteger>
+#include "lockin_engine.hh"
+
+/* Layout of the POSIX shared memory written by ShmPublisher, in the byte order of the machine
+ *
+ *   ShmHeader, then the ring of the values and the ring of the scope, at the offsets of their ShmRing
+ *
+ * The layout fields are protected by a seqlock : sequence is odd while the writer changes them
+ * (at the start of an acquisition), a reader copies them and checks that sequence didn't change.
+ * A ring is written record by record : writing is raised first, then the record is written
+ * and written is raised. A record of index i < written is in the slot i % capacity and was
+ * read intact if, after reading it, writing <= i + capacity and sequence didn't change.
+ * So the readers map the memory read only and never make a syscall nor take a lock.
+ *
+ * value record : double time, then x and y of each value (valueChannel, valueHarmonic)
+ * scope record : a frame, channelCount doubles in (-1, 1), then cos and sin of the chopper (NaN if unknown)
+ */
+
+struct ShmRing
+{
+    quint64 offset; // from the begining of the mapping
+    quint64 bytes; // room of the ring
+    quint64 capacity; // records, with the layout
+    quint32 recordSize; // bytes, with the layout
+    quint32 reserved;
+    QAtomicInteger<quint64> writing;
+    QAtomicInteger<quint64> written;
+};
+
+struct ShmHeader
+{
+    enum { MaxValues = 64 };
+
+    char magic[8]; // "LOCKINSM", written last
+    quint32 version;
+    quint32 headerSize;
+    quint64 size; // of the mapping
+
+    QAtomicInteger<quint32> sequence; // seqlock of the layout, odd while it changes
+    quint32 generation; // acquisitions since the creation
+
+    // layout
+    qint32 sampleRate;
+    qint32 channelCount;
+    qint32 valueCount;
+    qint32 reserved;
+    qint32 valueChannel[MaxValues];
+    qint32 valueHarmonic[MaxValues];
+    ShmRing values;
+    ShmRing scope;
+};
+
+/* Publication of the values and of the raw frames into a POSIX shared memory (shm_open)
+ *
+ * Written from the acquisition thread, without lock nor allocation.
+ * See ShmReader for the other side.
+ */
+
+class ShmPublisher
+{
+public:
+    ShmPublisher();
+    ~ShmPublisher();
+
+    // name like "/lockin", the memory is removed by close()
+    bool open(const QString &name, qint64 valueBytes = 1 << 20, qint64 scopeBytes = 16 << 20);
+    void close();
+    bool isOpen() const;
+    QString errorString() const;
+
+    // writer thread
+    void configure(int sampleRate, int channelCount, const QVector<int> &channels, const QVector<int> &harmonics);
+    void appendValue(const LockinOutput &output);
+    void appendScope(const LockinEngine &engine); // the frames of the last block
+
+    static QByteArray shmName(const QString &name); // with the leading /
+
+private:
+    ShmHeader *_header;
+    char *_map;
+    QByteArray _name;
+    QString _error;
+    QVector<qreal> _scopeBuffer; // a channel of the block in double
+};
+
+#endif // SHMPUBLISHER_HPP
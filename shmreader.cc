@@ -0,0 +1,205 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+#include "shmreader.hh"
+#include <atomic>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+ShmReader::ShmReader() :
+    _header(nullptr), _map(nullptr), _size(0)
+{
+    _layout.sequence = 0;
+    _layout.generation = 0;
+    _layout.sampleRate = 0;
+    _layout.channelCount = 0;
+    _layout.valueCapacity = 0;
+    _layout.scopeCapacity = 0;
+}
+
+ShmReader::~ShmReader()
+{
+    close();
+}
+
+bool ShmReader::open(const QString &name)
+{
+    close();
+
+#ifdef Q_OS_UNIX
+    const QByteArray path = ShmPublisher::shmName(name);
+    int fd = shm_open(path.constData(), O_RDONLY, 0);
+    if (fd < 0) {
+        _error = QString("shm_open: %1").arg(strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || quint64(st.st_size) < sizeof(ShmHeader)) {
+        _error = "not a lockin shared memory";
+        ::close(fd);
+        return false;
+    }
+
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        _error = QString("mmap: %1").arg(strerror(errno));
+        return false;
+    }
+
+    _map = static_cast<const char *>(map);
+    _size = st.st_size;
+    _header = reinterpret_cast<const ShmHeader *>(_map);
+
+    if (memcmp(_header->magic, "LOCKINSM", 8) != 0 || _header->version != 1 || _header->size > _size) {
+        _error = "not a lockin shared memory, or not ready";
+        close();
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    return true;
+#else
+    Q_UNUSED(name);
+    _error = "shared memory is not supported on this platform";
+    return false;
+#endif
+}
+
+void ShmReader::close()
+{
+#ifdef Q_OS_UNIX
+    if (_map != nullptr)
+        munmap(const_cast<char *>(_map), _size);
+#endif
+    _map = nullptr;
+    _header = nullptr;
+    _size = 0;
+}
+
+bool ShmReader::isOpen() const
+{
+    return _header != nullptr;
+}
+
+QString ShmReader::errorString() const
+{
+    return _error;
+}
+
+bool ShmReader::updateLayout()
+{
+    const quint32 sequence = _header->sequence.loadAcquire();
+    if ((sequence & 1) || _header->generation == 0)
+        return false;
+
+    Layout layout;
+    layout.sequence = sequence;
+    layout.generation = _header->generation;
+    layout.sampleRate = _header->sampleRate;
+    layout.channelCount = _header->channelCount;
+    const int count = qBound(0, int(_header->valueCount), int(ShmHeader::MaxValues));
+    layout.valueChannel.resize(count);
+    layout.valueHarmonic.resize(count);
+    for (int k = 0; k < count; ++k) {
+        layout.valueChannel[k] = _header->valueChannel[k];
+        layout.valueHarmonic[k] = _header->valueHarmonic[k];
+    }
+    layout.valueCapacity = _header->values.capacity;
+    layout.scopeCapacity = _header->scope.capacity;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (_header->sequence.load() != sequence)
+        return false;
+
+    _layout = layout;
+    return true;
+}
+
+const ShmReader::Layout &ShmReader::layout() const
+{
+    return _layout;
+}
+
+bool ShmReader::isLayoutCurrent() const
+{
+    return _header->sequence.loadAcquire() == _layout.sequence;
+}
+
+quint64 ShmReader::valuesWritten() const
+{
+    return _header->values.written.loadAcquire();
+}
+
+const double *ShmReader::valueRecord(quint64 index) const
+{
+    return record(_header->values, index);
+}
+
+bool ShmReader::isValueValid(quint64 index) const
+{
+    return isValid(_header->values, index);
+}
+
+quint64 ShmReader::framesWritten() const
+{
+    return _header->scope.written.loadAcquire();
+}
+
+const double *ShmReader::frames(quint64 first, quint64 *count) const
+{
+    // up to the end of the ring
+    const quint64 capacity = _layout.scopeCapacity;
+    *count = qMin(*count, capacity - first % capacity);
+    return record(_header->scope, first);
+}
+
+bool ShmReader::isFrameValid(quint64 index) const
+{
+    return isValid(_header->scope, index);
+}
+
+const double *ShmReader::record(const ShmRing &ring, quint64 index) const
+{
+    // the capacity and the record size of the layout, the ring may have changed since
+    const quint64 capacity = &ring == &_header->values ? _layout.valueCapacity : _layout.scopeCapacity;
+    const quint64 recordSize = &ring == &_header->values
+            ? sizeof(double) * (1 + 2 * _layout.valueChannel.size())
+            : sizeof(double) * (_layout.channelCount + 2);
+    return reinterpret_cast<const double *>(_map + ring.offset + (index % qMax<quint64>(1, capacity)) * recordSize);
+}
+
+bool ShmReader::isValid(const ShmRing &ring, quint64 index) const
+{
+    const quint64 capacity = &ring == &_header->values ? _layout.valueCapacity : _layout.scopeCapacity;
+
+    // the reads of the record before the checks
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return ring.writing.load() <= index + capacity && _header->sequence.load() == _layout.sequence;
+}
@@ -0,0 +1,89 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+#ifndef SHMREADER_HPP
+#define SHMREADER_HPP
+
+#include "shmpublisher.hh"
+
+/* Reference reader of the shared memory of ShmPublisher, from any process
+ *
+ * The memory is mapped read only and the records are read in place :
+ *
+ *   reader.updateLayout();
+ *   quint64 end = reader.valuesWritten();
+ *   for (; next < end; ++next) {
+ *       const double *record = reader.valueRecord(next);
+ *       ... use record ...
+ *       if (!reader.isValueValid(next)) ... overwritten while reading, or new layout
+ *   }
+ *
+ * No syscall nor lock after open(), a reader never slows the writer down.
+ */
+
+class ShmReader
+{
+public:
+    struct Layout {
+        quint32 sequence;
+        quint32 generation;
+        int sampleRate;
+        int channelCount;
+        QVector<int> valueChannel;
+        QVector<int> valueHarmonic;
+        quint64 valueCapacity;
+        quint64 scopeCapacity;
+    };
+
+    ShmReader();
+    ~ShmReader();
+
+    bool open(const QString &name);
+    void close();
+    bool isOpen() const;
+    QString errorString() const;
+
+    bool updateLayout(); // false while the writer changes it, or if it never configured
+    const Layout &layout() const;
+    bool isLayoutCurrent() const; // the writer didn't start a new acquisition since updateLayout()
+
+    // time, then x and y of each value
+    quint64 valuesWritten() const;
+    const double *valueRecord(quint64 index) const;
+    bool isValueValid(quint64 index) const; // after reading
+
+    // channelCount samples, then cos and sin of the chopper
+    quint64 framesWritten() const;
+    const double *frames(quint64 first, quint64 *count) const; // contiguous frames from first, at most *count
+    bool isFrameValid(quint64 index) const; // after reading
+
+private:
+    bool isValid(const ShmRing &ring, quint64 index) const;
+    const double *record(const ShmRing &ring, quint64 index) const;
+
+    const ShmHeader *_header;
+    const char *_map;
+    quint64 _size;
+    Layout _layout;
+    QString _error;
+};
+
+#endif // SHMREADER_HPP
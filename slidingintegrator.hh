@@ -0,0 +1,195 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef SLIDINGINTEGRATOR_HPP
+#define SLIDINGINTEGRATOR_HPP
+
+#include <QVector>
+
+/* Sum of the last `window` pushed values
+ *
+ * The values are kept in a preallocated ring, and grouped by block of
+ * `blockSize` frames (aligned on the absolute frame index given to push).
+ * Each block keeps the exact sum of its values, computed once in order.
+ * sum() adds the block sums plus the part of the oldest block still in the window :
+ * O(window / blockSize + blockSize) per call, and no drift because nothing is ever subtracted.
+ *
+ * The result only depends on the values and on their frame index,
+ * not on the way they were pushed.
+ */
+
+template <typename T>
+class SlidingIntegrator
+{
+public:
+    explicit SlidingIntegrator(int blockSize = 1024);
+
+    void reset(int window); // preallocate and clear
+    void clear();
+
+    void push(qint64 frame, const T &value); // frame must not decrease
+
+    int window() const;
+    int size() const; // number of values in the window
+    bool isFull() const;
+    T sum() const;
+
+private:
+    struct Block {
+        qint64 id; // frame / blockSize
+        qint64 begin; // index of the first value
+        int count;
+        T sum;
+    };
+
+    const Block &block(qint64 i) const { return _blocks[int(i & (_blocks.size() - 1))]; }
+    Block &block(qint64 i) { return _blocks[int(i & (_blocks.size() - 1))]; }
+    void growBlocks();
+
+    int _blockSize;
+    int _window;
+
+    QVector<T> _values; // ring of the values, power of two size
+    qint64 _valuesEnd; // monotonic index of the next value
+
+    QVector<Block> _blocks; // ring of the blocks, power of two size
+    qint64 _blocksBegin, _blocksEnd; // monotonic indices
+    qint64 _stored; // number of values in the blocks
+};
+
+template <typename T>
+SlidingIntegrator<T>::SlidingIntegrator(int blockSize) :
+    _blockSize(blockSize), _window(0)
+{
+    reset(0);
+}
+
+template <typename T>
+void SlidingIntegrator<T>::reset(int window)
+{
+    _window = window;
+
+    // the oldest block can stick out of the window by blockSize - 1 values
+    int size = 1;
+    while (size < window + _blockSize)
+        size <<= 1;
+    _values.fill(T(), size);
+
+    int blocks = 4;
+    while (blocks < 2 * (window / _blockSize + 2))
+        blocks <<= 1;
+    _blocks.resize(blocks);
+
+    clear();
+}
+
+template <typename T>
+void SlidingIntegrator<T>::clear()
+{
+    _valuesEnd = 0;
+    _blocksBegin = _blocksEnd = 0;
+    _stored = 0;
+}
+
+template <typename T>
+inline void SlidingIntegrator<T>::push(qint64 frame, const T &value)
+{
+    if (_window <= 0)
+        return;
+
+    qint64 id = frame / _blockSize;
+
+    if (_blocksEnd == _blocksBegin || block(_blocksEnd - 1).id != id) {
+        if (_blocksEnd - _blocksBegin == _blocks.size())
+            growBlocks();
+
+        Block &b = block(_blocksEnd++);
+        b.id = id;
+        b.begin = _valuesEnd;
+        b.count = 0;
+        b.sum = T();
+    }
+
+    Block &b = block(_blocksEnd - 1);
+    b.count++;
+    b.sum += value;
+
+    _values[int(_valuesEnd & (_values.size() - 1))] = value;
+    _valuesEnd++;
+    _stored++;
+
+    // forget the blocks that are entirely out of the window
+    while (_stored - block(_blocksBegin).count >= _window) {
+        _stored -= block(_blocksBegin).count;
+        _blocksBegin++;
+    }
+}
+
+template <typename T>
+int SlidingIntegrator<T>::window() const
+{
+    return _window;
+}
+
+template <typename T>
+int SlidingIntegrator<T>::size() const
+{
+    return int(qMin<qint64>(_stored, _window));
+}
+
+template <typename T>
+bool SlidingIntegrator<T>::isFull() const
+{
+    return _window > 0 && _stored >= _window;
+}
+
+template <typename T>
+T SlidingIntegrator<T>::sum() const
+{
+    if (_blocksEnd == _blocksBegin)
+        return T();
+
+    T x = T();
+
+    // part of the oldest block still in the window
+    const Block &oldest = block(_blocksBegin);
+    qint64 skip = qMax<qint64>(0, _stored - _window);
+    for (qint64 i = oldest.begin + skip; i < oldest.begin + oldest.count; ++i)
+        x += _values[int(i & (_values.size() - 1))];
+
+    for (qint64 i = _blocksBegin + 1; i < _blocksEnd; ++i)
+        x += block(i).sum;
+
+    return x;
+}
+
+template <typename T>
+void SlidingIntegrator<T>::growBlocks()
+{
+    // only happens when blocks are very sparse (mostly NaN)
+    QVector<Block> blocks(2 * _blocks.size());
+    for (qint64 i = _blocksBegin; i < _blocksEnd; ++i)
+        blocks[int(i & (blocks.size() - 1))] = block(i);
+    _blocks.swap(blocks);
+}
+
+#endif // SLIDINGINTEGRATOR_HPP
@@ -0,0 +1,97 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef SPSCQUEUE_HPP
+#define SPSCQUEUE_HPP
+
+#include <QAtomicInteger>
+#include <QVector>
+
+/* Bounded lock-free queue for one producer thread and one consumer thread
+ * push() fails instead of blocking when the queue is full
+ */
+
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(int capacity = 1024);
+
+    bool push(const T &value); // producer
+    bool pop(T *value); // consumer
+
+    int capacity() const;
+    int size() const;
+
+private:
+    QVector<T> _data; // power of two size
+    QAtomicInteger<quint32> _head; // next write
+    QAtomicInteger<quint32> _tail; // next read
+};
+
+template <typename T>
+SpscQueue<T>::SpscQueue(int capacity) :
+    _head(0), _tail(0)
+{
+    int size = 2;
+    while (size < capacity)
+        size <<= 1;
+    _data.resize(size);
+}
+
+template <typename T>
+bool SpscQueue<T>::push(const T &value)
+{
+    quint32 head = _head.loadAcquire();
+    if (head - _tail.loadAcquire() == quint32(_data.size()))
+        return false;
+
+    _data[int(head & (_data.size() - 1))] = value;
+    _head.storeRelease(head + 1);
+    return true;
+}
+
+template <typename T>
+bool SpscQueue<T>::pop(T *value)
+{
+    quint32 tail = _tail.loadAcquire();
+    if (tail == _head.loadAcquire())
+        return false;
+
+    *value = _data[int(tail & (_data.size() - 1))];
+    _tail.storeRelease(tail + 1);
+    return true;
+}
+
+template <typename T>
+int SpscQueue<T>::capacity() const
+{
+    return _data.size();
+}
+
+template <typename T>
+int SpscQueue<T>::size() const
+{
+    return int(_head.loadAcquire() - _tail.loadAcquire());
+}
+
+#endif // SPSCQUEUE_HPP
@@ -0,0 +1,215 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "syntheticsource.hh"
+#include "pcmdecoder.hh"
+#include <QVarLengthArray>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// counter based generator : the noise of a sample only depends on its frame and channel
+inline quint64 mix(quint64 x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// sum of 4 uniforms, close enough to a gaussian for a noise floor, unit variance
+inline qreal gaussian(quint64 key)
+{
+    const quint64 h = mix(key);
+    qreal sum = 0.0;
+    for (int k = 0; k < 4; ++k)
+        sum += qreal((h >> (16 * k)) & 0xffff) / 65536.0;
+    return (sum - 2.0) * std::sqrt(3.0);
+}
+
+} // namespace
+
+SyntheticSource::SyntheticSource(QObject *parent) :
+    QIODevice(parent),
+    _frames(-1), _referenceChannel(1), _frequency(437.0), _amplitude(0.3), _phase(0.5),
+    _noise(0.0), _snr(0.0)
+{
+    QAudioFormat format;
+    format.setCodec("audio/pcm");
+    format.setChannelCount(2);
+    format.setSampleRate(48000);
+    format.setSampleSize(16);
+    format.setSampleType(QAudioFormat::SignedInt);
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    setFormat(format);
+    setFrameCount(60 * format.sampleRate());
+    setSnr(20.0);
+}
+
+bool SyntheticSource::setFormat(const QAudioFormat &format)
+{
+    Q_ASSERT(!isOpen());
+    if (!PcmDecoder<qreal>::isFormatSupported(format))
+        return false;
+    _format = format;
+    return true;
+}
+
+const QAudioFormat &SyntheticSource::format() const
+{
+    return _format;
+}
+
+void SyntheticSource::setFrameCount(qint64 frames)
+{
+    Q_ASSERT(!isOpen());
+    _frames = frames;
+}
+
+qint64 SyntheticSource::frameCount() const
+{
+    return _frames;
+}
+
+void SyntheticSource::setReferenceChannel(int channel)
+{
+    Q_ASSERT(!isOpen());
+    _referenceChannel = channel;
+}
+
+void SyntheticSource::setFrequency(qreal frequency)
+{
+    Q_ASSERT(!isOpen());
+    _frequency = frequency;
+}
+
+void SyntheticSource::setAmplitude(qreal amplitude)
+{
+    Q_ASSERT(!isOpen());
+    _amplitude = amplitude;
+    setSnr(_snr);
+}
+
+void SyntheticSource::setPhase(qreal phase)
+{
+    Q_ASSERT(!isOpen());
+    _phase = phase;
+}
+
+void SyntheticSource::setSnr(qreal decibels)
+{
+    Q_ASSERT(!isOpen());
+    // the power of the sine is amplitude^2 / 2
+    _snr = decibels;
+    _noise = _amplitude / std::sqrt(2.0) * std::pow(10.0, -decibels / 20.0);
+}
+
+void SyntheticSource::generate(qint64 first, int count, char *data) const
+{
+    const int channels = _format.channelCount();
+    const int sampleSize = _format.sampleSize() / 8;
+    // the phase in turns is reduced before the cos, so it stays exact for long sources
+    const qreal turns = _frequency / _format.sampleRate();
+    QVarLengthArray<qreal, 4096> signal(count);
+    QVarLengthArray<bool, 4096> chopper(count);
+    for (int i = 0; i < count; ++i) {
+        const qint64 t = first + i;
+        qreal p = std::fmod(turns * qreal(t), 1.0);
+        signal[i] = _amplitude * std::cos(2.0 * M_PI * p + _phase);
+        chopper[i] = std::sin(2.0 * M_PI * p) >= 0.0;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        const qint64 t = first + i;
+        for (int c = 0; c < channels; ++c) {
+            qreal v;
+            if (c == _referenceChannel)
+                v = chopper[i] ? 0.8 : -0.8;
+            else
+                v = signal[i] + _noise * gaussian(quint64(t) * 64 + quint64(c));
+            encode(v, data + (i * channels + c) * sampleSize);
+        }
+    }
+}
+
+void SyntheticSource::encode(qreal value, char *to) const
+{
+    const int bytes = _format.sampleSize() / 8;
+    quint32 word;
+
+    if (_format.sampleType() == QAudioFormat::Float) {
+        float f = float(value);
+        memcpy(&word, &f, 4);
+    } else {
+        // full scale is 2^(bits - 1), clipped
+        const qreal scale = std::ldexp(1.0, _format.sampleSize() - 1);
+        qint64 v = qint64(std::floor(value * scale + 0.5));
+        v = qBound<qint64>(-qint64(scale), v, qint64(scale) - 1);
+        if (_format.sampleType() == QAudioFormat::UnSignedInt)
+            v += qint64(scale);
+        word = quint32(v);
+    }
+
+    for (int k = 0; k < bytes; ++k) {
+        const int shift = _format.byteOrder() == QAudioFormat::LittleEndian ? 8 * k : 8 * (bytes - 1 - k);
+        to[k] = char(word >> shift);
+    }
+}
+
+bool SyntheticSource::isSequential() const
+{
+    return _frames < 0;
+}
+
+qint64 SyntheticSource::size() const
+{
+    return _frames < 0 ? 0 : _frames * _format.bytesPerFrame();
+}
+
+qint64 SyntheticSource::readData(char *data, qint64 maxSize)
+{
+    const int frameSize = _format.bytesPerFrame();
+    const qint64 first = pos() / frameSize;
+    qint64 frames = maxSize / frameSize;
+    if (_frames >= 0)
+        frames = qMin(frames, _frames - first);
+    if (frames <= 0)
+        return _frames >= 0 && first >= _frames ? -1 : 0;
+
+    // the reads are whole frames, so pos() stays aligned
+    for (qint64 done = 0; done < frames; ) {
+        const int count = int(qMin<qint64>(frames - done, 4096));
+        generate(first + done, count, data + done * frameSize);
+        done += count;
+    }
+    return frames * frameSize;
+}
+
+qint64 SyntheticSource::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
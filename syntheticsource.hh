@@ -0,0 +1,78 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef SYNTHETICSOURCE_HPP
+#define SYNTHETICSOURCE_HPP
+
+#include <QIODevice>
+#include <QAudioFormat>
+
+/* Synthetic recording, for the benchmarks and to try the lockin without a chopper
+ *
+ * The chopper is a square wave of +-0.8 on referenceChannel(), every other channel
+ * holds amplitude * cos(2 pi f t + phase) plus a white gaussian-like noise with
+ * the given SNR (power of the sine over the power of the noise). The samples
+ * only depend on their frame index, so the device can be read from anywhere
+ * and gives the same frames every time. Any format of PcmDecoder.
+ */
+
+class SyntheticSource : public QIODevice
+{
+    Q_OBJECT
+public:
+    explicit SyntheticSource(QObject *parent = 0);
+
+    // only while closed
+    bool setFormat(const QAudioFormat &format); // return false if the format is not supported
+    const QAudioFormat &format() const;
+    void setFrameCount(qint64 frames); // -1 for an endless source, one minute by default
+    qint64 frameCount() const;
+    void setReferenceChannel(int channel); // 1 by default
+    void setFrequency(qreal frequency); // of the chopper and of the signal, 437 Hz by default
+    void setAmplitude(qreal amplitude); // of the signal, 0.3 by default
+    void setPhase(qreal phase); // of the signal against the chopper, in radians, 0.5 by default
+    void setSnr(qreal decibels); // 20 dB by default, infinite for no noise
+
+    // frames of absolute index [first, first + count)
+    void generate(qint64 first, int count, char *data) const;
+
+    bool isSequential() const override;
+    qint64 size() const override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    void encode(qreal value, char *to) const;
+
+    QAudioFormat _format;
+    qint64 _frames;
+    int _referenceChannel;
+    qreal _frequency;
+    qreal _amplitude;
+    qreal _phase;
+    qreal _noise; // standard deviation
+    qreal _snr;
+};
+
+#endif // SYNTHETICSOURCE_HPP
@@ -0,0 +1,146 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+/* The values of LockinEngine don't depend on the size of the blocks
+ *
+ * The same synthetic recording (SyntheticSource) goes through the engine once in
+ * reads of 1 to 5000 random bytes (readBytes(), frames split between two reads)
+ * and once in blocks of one second, for every filter, with and without decimation,
+ * with the chopper and with the internal reference, in both precisions.
+ * The recording has two signals and the chopper on the third channel, and starts at
+ * an absolute frame that is not a multiple of the output period, like a replay.
+ * Returns 1 unless the outputs are bit-identical.
+ */
+
+#include "lockin_engine.hh"
+#include "syntheticsource.hh"
+#include <QTextStream>
+#include <QVector>
+
+static quint32 randomState = 1;
+
+static int randomBytes()
+{
+    randomState = randomState * 1664525u + 1013904223u;
+    return 1 + int((randomState >> 8) % 5000);
+}
+
+struct Settings {
+    LowPassFilter::Type filter;
+    qreal decimatedRate;
+    qreal referenceFrequency;
+    LockinEngine::Precision precision;
+};
+
+static const qint64 firstFrame = 123457;
+
+static QVector<LockinOutput> run(const Settings &settings, const QAudioFormat &format, const QByteArray &data, bool randomReads)
+{
+    LockinEngine engine;
+    engine.setFormat(format);
+    engine.setIntegrationTime(0.5);
+    engine.setFilter(settings.filter);
+    engine.setDecimatedRate(settings.decimatedRate);
+    engine.setHarmonics(QVector<int>() << 1 << 2 << 3);
+    engine.setReferenceChannel(2);
+    engine.setReferenceFrequency(settings.referenceFrequency);
+    engine.setPrecision(settings.precision);
+    engine.setOutputPeriod(format.sampleRate() / 10);
+    engine.reset(firstFrame);
+
+    QVector<LockinOutput> outputs;
+    LockinOutput output;
+    const qint64 second = format.bytesForDuration(1000000);
+
+    for (qint64 position = 0; position < data.size();) {
+        const qint64 size = qMin<qint64>(randomReads ? randomBytes() : second, data.size() - position);
+        engine.readBytes(data.constData() + position, size);
+        engine.parseChopperSignal();
+        engine.demodulate();
+        while (engine.integrate(&output))
+            outputs << output;
+        position += size;
+    }
+    return outputs;
+}
+
+static bool identical(const QVector<LockinOutput> &a, const QVector<LockinOutput> &b)
+{
+    if (a.size() != b.size())
+        return false;
+
+    for (int i = 0; i < a.size(); ++i) {
+        if (a[i].time != b[i].time || a[i].frequency != b[i].frequency || a[i].values.size() != b[i].values.size())
+            return false;
+        for (int k = 0; k < a[i].values.size(); ++k) {
+            const LockinValue &u = a[i].values[k];
+            const LockinValue &v = b[i].values[k];
+            if (u.x != v.x || u.y != v.y || u.r != v.r || u.theta != v.theta)
+                return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    QTextStream out(stdout);
+
+    QAudioFormat format;
+    format.setCodec("audio/pcm");
+    format.setChannelCount(3);
+    format.setSampleRate(48000);
+    format.setSampleSize(24);
+    format.setSampleType(QAudioFormat::SignedInt);
+    format.setByteOrder(QAudioFormat::LittleEndian);
+
+    SyntheticSource source;
+    source.setFormat(format);
+    source.setReferenceChannel(2);
+    const qint64 frames = 10 * format.sampleRate();
+    QByteArray data(frames * format.bytesPerFrame(), Qt::Uninitialized);
+    source.generate(firstFrame, int(frames), data.data());
+
+    bool ok = true;
+    out << "filter\tdecimate\treference\tprecision\toutputs\tidentical\n";
+
+    for (int f = 0; f <= LowPassFilter::Fir; ++f) {
+        for (int d = 0; d < 2; ++d) {
+            for (int r = 0; r < 2; ++r) {
+                for (int p = LockinEngine::Double; p <= LockinEngine::Float; ++p) {
+                    const Settings settings = { LowPassFilter::Type(f), d ? 2000.0 : 0.0, r ? 437.0 : 0.0, LockinEngine::Precision(p) };
+                    const QVector<LockinOutput> blocks = run(settings, format, data, false);
+                    const QVector<LockinOutput> reads = run(settings, format, data, true);
+                    const bool same = !blocks.isEmpty() && identical(blocks, reads);
+                    ok = ok && same;
+
+                    out << LowPassFilter::name(settings.filter) << "\t" << settings.decimatedRate << "\t"
+                        << (r ? "internal" : "chopper") << "\t" << LockinEngine::precisionName(settings.precision) << "\t"
+                        << blocks.size() << "\t" << (same ? "yes" : "NO") << "\n";
+                }
+            }
+        }
+    }
+
+    out << (ok ? "PASS" : "FAIL") << "\n";
+    return ok ? 0 : 1;
+}
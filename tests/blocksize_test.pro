@@ -0,0 +1,15 @@
+QT += multimedia
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+TARGET = blocksize_test
+
+INCLUDEPATH += $$PWD/..
+
+include($$PWD/../lockin_core.pri)
+
+SOURCES += $$PWD/blocksize_test.cc \
+    $$PWD/../syntheticsource.cc
+
+HEADERS += $$PWD/../syntheticsource.hh
@@ -0,0 +1,183 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+/* End to end test of lockin-daemon : LockinServer on a local socket, replay of a recording
+ *
+ * A synthetic recording (SyntheticSource) is processed by LockinEngine and written with
+ * its raw frames by DataLogger. A client connected through QLocalSocket then sends
+ * "configure replay=... realtime=0", "subscribe" and "start" with the same settings
+ * and reads the frames of LockinProtocol until the "finished" event.
+ * Returns 1 unless every reply is ok, the sequence numbers are contiguous from 0
+ * and the values have the count and the times of the recording.
+ */
+
+#include "lockinserver.hh"
+#include "lockinprotocol.hh"
+#include "datalogger.hh"
+#include "logreader.hh"
+#include "syntheticsource.hh"
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QLocalSocket>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QTimer>
+
+static const qreal seconds = 15.0;
+static const qreal period = 0.1;
+static const qreal integration = 0.5;
+static const int timeout = 60000; // ms
+
+// the values that the daemon should push, with the raw frames they come from
+static bool record(const QString &fileName, const QAudioFormat &format, QString *error)
+{
+    SyntheticSource source;
+    source.setFormat(format);
+
+    LockinEngine engine;
+    engine.setFormat(format);
+    engine.setIntegrationTime(integration);
+    engine.setHarmonics(QVector<int>() << 1);
+    engine.setOutputPeriod(qRound64(period * format.sampleRate()));
+    engine.reset();
+
+    DataLogger logger;
+    if (!logger.open(fileName, format, integration, engine.harmonics(), true)) {
+        *error = logger.errorString();
+        return false;
+    }
+
+    const int block = format.sampleRate() / 10;
+    QByteArray data(block * format.bytesPerFrame(), Qt::Uninitialized);
+    LockinOutput output;
+    for (qint64 frame = 0; frame < qint64(seconds * format.sampleRate()); frame += block) {
+        source.generate(frame, block, data.data());
+        logger.appendRaw(frame, data.constData(), data.size());
+        engine.readFrames(data.constData(), block);
+        engine.parseChopperSignal();
+        engine.demodulate();
+        while (engine.integrate(&output))
+            logger.appendValue(output);
+    }
+    logger.close();
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    QAudioFormat format;
+    format.setCodec("audio/pcm");
+    format.setChannelCount(2);
+    format.setSampleRate(48000);
+    format.setSampleSize(16);
+    format.setSampleType(QAudioFormat::SignedInt);
+    format.setByteOrder(QAudioFormat::LittleEndian);
+
+    QTemporaryDir dir;
+    const QString fileName = dir.path() + "/replay.lockin";
+    QString error;
+    if (!dir.isValid() || !record(fileName, format, &error)) {
+        out << "cannot write the recording: " << error << "\nFAIL\n";
+        return 1;
+    }
+
+    LogReader reader;
+    if (!reader.open(fileName)) {
+        out << "cannot read the recording: " << reader.errorString() << "\nFAIL\n";
+        return 1;
+    }
+
+    const QString name = QString("lockin-test-%1").arg(QCoreApplication::applicationPid());
+    LockinServer server;
+    if (!server.listenLocal(name)) {
+        out << name << ": " << server.errorString() << "\nFAIL\n";
+        return 1;
+    }
+
+    QLocalSocket socket;
+    socket.connectToServer(name);
+    if (!socket.waitForConnected()) {
+        out << "cannot connect: " << socket.errorString() << "\nFAIL\n";
+        return 1;
+    }
+
+    const QStringList commands = QStringList()
+            << QString("configure replay=%1 realtime=0 period=%2 integration=%3 filter=boxcar harmonics=1")
+               .arg(fileName).arg(period).arg(integration)
+            << "subscribe"
+            << "start";
+    foreach (const QString &command, commands)
+        socket.write(LockinProtocol::frame(LockinProtocol::Command, command.toUtf8()));
+
+    QEventLoop loop;
+    LockinProtocol::FrameReader frames;
+    int replies = 0;
+    bool ok = true, finished = false;
+    qint64 values = 0;
+    int wrongTimes = 0;
+
+    QObject::connect(&socket, &QLocalSocket::readyRead, [&]() {
+        frames.append(socket.readAll());
+
+        LockinProtocol::FrameType type;
+        QByteArray payload;
+        while (frames.next(&type, &payload)) {
+            if (type == LockinProtocol::Reply) {
+                out << commands.value(replies) << ": " << QString::fromUtf8(payload) << "\n";
+                ok = ok && payload.startsWith("ok");
+                replies++;
+            } else if (type == LockinProtocol::Event) {
+                out << "event: " << QString::fromUtf8(payload) << "\n";
+                if (payload == "finished") {
+                    finished = true;
+                    loop.quit();
+                }
+            } else if (type == LockinProtocol::Values) {
+                quint32 sequence;
+                qreal time;
+                QVector<LockinValue> v;
+                LockinOutput recorded;
+                if (!LockinProtocol::parseValues(payload, &sequence, &time, &v) || sequence != values) {
+                    out << "value " << values << ": sequence " << sequence << "\n";
+                    ok = false;
+                } else if (!reader.value(values, &recorded) || recorded.time != time) {
+                    wrongTimes++;
+                }
+                values++;
+            }
+        }
+    });
+    QTimer::singleShot(timeout, &loop, SLOT(quit()));
+    loop.exec();
+
+    out << "values " << values << " recorded " << reader.valueCount() << " wrong times " << wrongTimes << "\n";
+    if (!finished)
+        out << "no finished event after " << timeout / 1000 << " s\n";
+    ok = ok && finished && replies == commands.size() && values > 0
+            && values == reader.valueCount() && wrongTimes == 0;
+
+    out << (ok ? "PASS" : "FAIL") << "\n";
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,26 @@
+QT += multimedia
+QT += network
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+TARGET = daemon_test
+
+INCLUDEPATH += $$PWD/..
+
+include($$PWD/../lockin_core.pri)
+
+SOURCES += $$PWD/daemon_test.cc \
+    $$PWD/../lockin_worker.cc \
+    $$PWD/../lockin.cc \
+    $$PWD/../lockinprotocol.cc \
+    $$PWD/../lockinserver.cc \
+    $$PWD/../syntheticsource.cc
+
+HEADERS += $$PWD/../triplebuffer.hh \
+    $$PWD/../spscqueue.hh \
+    $$PWD/../lockin_worker.hh \
+    $$PWD/../lockin.hh \
+    $$PWD/../lockinprotocol.hh \
+    $$PWD/../lockinserver.hh \
+    $$PWD/../syntheticsource.hh
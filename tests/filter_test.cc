@@ -0,0 +1,159 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+/* Step responses of LowPassFilter
+ *
+ * Zeros for twice memoryFrames(), then a step x = 1, y = -0.5, pushed in blocks of 7 values
+ * with an output after each block.
+ * Boxcar : the mean of the window, k / window after k values of the step.
+ * Rc6dB ... Rc24dB : n stages of time constant tau, 1 - exp(-t) sum_{k<n} t^k / k! with t in tau,
+ *   within maxDiscreteError (the stages are discrete, tau is 960 values).
+ * Fir : from 0 to 1 without overshoot, 0.5 at the middle of the window (it is symmetric).
+ * After memoryFrames() of the step all the filters must give 1 within maxError, y must
+ * always be -0.5 x, a run of NaN among the zeros must change nothing and isFull() must
+ * not be true before 99 % of a step given from the start.
+ * Returns 1 otherwise.
+ */
+
+#include "lowpassfilter.hh"
+#include <QTextStream>
+#include <QVector>
+#include <cmath>
+
+static const qreal maxError = 1e-9;
+static const qreal maxDiscreteError = 1e-3;
+
+static const qreal sampleRate = 48000.0;
+static const qreal integrationTime = 0.02; // tau of 960 values
+static const int blockSize = 7;
+
+struct Output {
+    qint64 values; // of the step pushed
+    std::complex<qreal> value;
+    bool full;
+};
+
+// zeros before prefix and ones after, NaN in [nanBegin, nanEnd), the outputs after prefix
+static QVector<Output> stepResponse(LowPassFilter::Type type, qint64 prefix, qint64 frames, qint64 nanBegin, qint64 nanEnd)
+{
+    LowPassFilter filter;
+    filter.reset(type, integrationTime, sampleRate);
+
+    QVector<Output> outputs;
+    qreal x[blockSize], y[blockSize];
+    for (qint64 first = 0; first < frames; first += blockSize) {
+        for (int i = 0; i < blockSize; ++i) {
+            const qint64 t = first + i;
+            x[i] = t >= nanBegin && t < nanEnd ? NAN : (t < prefix ? 0.0 : 1.0);
+            y[i] = -0.5 * x[i];
+        }
+        filter.push(first, x, y, blockSize);
+
+        if (first + blockSize > prefix) {
+            const Output output = { first + blockSize - prefix, filter.value(first + blockSize), filter.isFull() };
+            outputs << output;
+        }
+    }
+    return outputs;
+}
+
+// continuous step response of n stages at t in tau
+static qreal cascadeStep(int n, qreal t)
+{
+    qreal term = 1.0, sum = 0.0;
+    for (int k = 0; k < n; ++k) {
+        sum += term;
+        term *= t / (k + 1);
+    }
+    return 1.0 - std::exp(-t) * sum;
+}
+
+int main()
+{
+    QTextStream out(stdout);
+    bool ok = true;
+
+    const qint64 window = qint64(sampleRate * integrationTime);
+    out << "filter\tmemory\tmax error\tfinal error\tNaN change\tfull at\n";
+
+    for (int f = 0; f <= LowPassFilter::Fir; ++f) {
+        const LowPassFilter::Type type = LowPassFilter::Type(f);
+        const int order = LowPassFilter::order(type);
+        const qint64 memory = LowPassFilter::memoryFrames(type, integrationTime, sampleRate);
+        const qint64 prefix = (2 * memory / blockSize + 1) * blockSize;
+        const qint64 frames = prefix + memory + 2 * blockSize;
+
+        const QVector<Output> step = stepResponse(type, prefix, frames, frames, frames);
+        const QVector<Output> nan = stepResponse(type, prefix, frames, memory / 4, memory / 2);
+        const QVector<Output> start = stepResponse(type, 0, memory, memory, memory);
+
+        // the Fir window spans FirTaps sub blocks, the value lags by one sub block
+        const qint64 decimation = memory / (LowPassFilter::FirTaps + 2);
+        const qint64 firMiddle = LowPassFilter::FirTaps * decimation / 2 + decimation;
+
+        qreal error = 0.0, last = 0.0, middle = 0.0;
+        for (int i = 0; i < step.size(); ++i) {
+            const qreal v = step[i].value.real();
+            if (std::abs(step[i].value.imag() + 0.5 * v) > maxError)
+                error = INFINITY;
+
+            if (type == LowPassFilter::Boxcar) {
+                error = qMax(error, std::abs(v - qreal(qMin(step[i].values, window)) / qreal(window)));
+            } else if (order > 0) {
+                const qreal expected = cascadeStep(order, qreal(step[i].values) / (integrationTime * sampleRate));
+                const qreal e = std::abs(v - expected);
+                error = qMax(error, e <= maxDiscreteError ? 0.0 : e);
+            } else {
+                if (v < last - maxError || v > 1.0 + maxError)
+                    error = INFINITY;
+                if (step[i].values <= firMiddle)
+                    middle = v;
+            }
+            last = v;
+        }
+        if (type == LowPassFilter::Fir)
+            error = qMax(error, std::abs(middle - 0.5) <= 0.05 ? 0.0 : std::abs(middle - 0.5));
+
+        const qreal final = std::abs(step.last().value.real() - 1.0);
+
+        qreal nanChange = 0.0;
+        for (int i = 0; i < step.size(); ++i)
+            nanChange = qMax(nanChange, std::abs(nan[i].value - step[i].value));
+
+        qint64 fullAt = -1;
+        for (int i = 0; i < start.size() && fullAt < 0; ++i) {
+            if (start[i].full) {
+                fullAt = start[i].values;
+                if (start[i].value.real() < 0.99)
+                    error = INFINITY;
+            }
+        }
+
+        const bool good = error == 0.0 && final <= maxError && nanChange == 0.0 && fullAt >= 0;
+        ok = ok && good;
+        out << LowPassFilter::name(type) << "\t" << memory << "\t" << error << "\t" << final << "\t"
+            << nanChange << "\t" << fullAt << (good ? "" : "\tFAIL") << "\n";
+    }
+
+    out << (ok ? "PASS" : "FAIL") << "\n";
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,12 @@
+QT += multimedia
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+TARGET = filter_test
+
+INCLUDEPATH += $$PWD/..
+
+include($$PWD/../lockin_core.pri)
+
+SOURCES += $$PWD/filter_test.cc
@@ -0,0 +1,276 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+/* Accuracy of the recursive rotators of ReferenceTracker and ReferenceOscillator
+ * against std::cos/std::sin evaluated directly at every sample
+ *
+ * The tracker follows a frequency modulated sine chopper, its edges and mean period
+ * are recomputed here the same way, then cos/sin of the phase since the last edge.
+ * The oscillator is started far from the frame 0, its exact phase is the
+ * accumulator step times the frame (2^64 is a turn), computed in long double.
+ * Both run in random blocks of 1 to 5000 samples.
+ *
+ * The reference of LockinEngine is also compared to the one of the first version
+ * (Lockin::parseChopperSignal() with std::exp(i angle) for every sample, kept below)
+ * on a recorded 16 bits chopper whose rising edges fall on a sample at a constant
+ * period. The first version puts the angle 0 on the sample after the edge, so its
+ * sample t must equal the sample t - 1 of the engine.
+ * Returns 1 if an error is above maxError (maxFloatError for the float output).
+ */
+
+#include "referencetracker.hh"
+#include "referenceoscillator.hh"
+#include "lockin_engine.hh"
+#include <QTextStream>
+#include <QVector>
+#include <cmath>
+#include <complex>
+
+static const qreal maxError = 1e-9;
+static const qreal maxFloatError = 1e-6;
+
+static quint32 randomState = 1;
+
+static int randomBlock()
+{
+    randomState = randomState * 1664525u + 1013904223u;
+    return 1 + int((randomState >> 8) % 5000);
+}
+
+// chopper of 437 Hz at 48 kHz, +-2 % of frequency modulation at 0.3 Hz
+static qreal chopper(qint64 t)
+{
+    const qreal s = qreal(t) / 48000.0;
+    return 0.8 * std::sin(2.0 * M_PI * 437.0 * s - 0.02 * 437.0 / 0.3 * std::cos(2.0 * M_PI * 0.3 * s));
+}
+
+template <typename Real>
+static qreal trackerError(qint64 frames, int memory)
+{
+    ReferenceTracker tracker(memory);
+    QVector<Real> in, cos, sin;
+
+    // the edges as ReferenceTracker finds them, no glitch to reject on a clean chopper
+    QVector<qreal> edges;
+    qreal last = chopper(0);
+    qreal error = 0.0;
+
+    tracker.reset(0);
+    for (qint64 first = 0; first < frames;) {
+        const int size = int(qMin<qint64>(randomBlock(), frames - first));
+        in.resize(size);
+        cos.resize(size);
+        sin.resize(size);
+        for (int i = 0; i < size; ++i)
+            in[i] = Real(chopper(first + i));
+        tracker.process(in.constData(), size, cos.data(), sin.data());
+
+        for (int i = 0; i < size; ++i) {
+            const qint64 t = first + i;
+            const qreal v = in[i];
+            if (t > 0 && last < 0.0 && v >= 0.0)
+                edges << qreal(t - 1) + last / (last - v);
+            last = v;
+
+            if (edges.size() < 2)
+                continue;
+            const int n = qMin(edges.size(), memory + 1);
+            const qreal edge = edges.last();
+            const qreal period = (edge - edges[edges.size() - n]) / qreal(n - 1);
+            const qreal phase = 2.0 * M_PI * (qreal(t) - edge) / period;
+
+            error = qMax(error, std::fabs(cos[i] - std::cos(phase)));
+            error = qMax(error, std::fabs(sin[i] - std::sin(phase)));
+        }
+        first += size;
+    }
+    return error;
+}
+
+template <typename Real>
+static qreal oscillatorError(qreal frequency, qreal sampleRate, qint64 firstFrame, qint64 frames)
+{
+    ReferenceOscillator oscillator;
+    oscillator.reset(frequency, sampleRate, firstFrame);
+
+    // turns per frame at frequency(), in long double to keep the phase of far frames
+    const long double step = std::ldexp((long double)std::ldexp(oscillator.frequency() / sampleRate, 64), -64);
+    QVector<Real> cos, sin;
+    qreal error = 0.0;
+
+    for (qint64 first = firstFrame; first < firstFrame + frames;) {
+        const int size = int(qMin<qint64>(randomBlock(), firstFrame + frames - first));
+        cos.resize(size);
+        sin.resize(size);
+        oscillator.process(size, cos.data(), sin.data());
+
+        for (int i = 0; i < size; ++i) {
+            const long double turns = step * (long double)(first + i);
+            const qreal phase = qreal(2.0L * M_PI * (turns - std::floor(turns)));
+            error = qMax(error, std::fabs(cos[i] - std::cos(phase)));
+            error = qMax(error, std::fabs(sin[i] - std::sin(phase)));
+        }
+        first += size;
+    }
+    return error;
+}
+
+// Lockin::parseChopperSignal() of the first version on a whole recording, NaN where the phase is unknown
+static QVector<std::complex<qreal>> baselineReference(const QVector<qreal> &chopper)
+{
+    QVector<std::complex<qreal>> complex_exp;
+
+    int i = 0;
+
+    // set the first value as ignored
+    complex_exp << NAN;
+    i++;
+
+    for (; i < chopper.size(); ++i) {
+        if (chopper[i-1] < 0.0 && chopper[i] >= 0.0) {
+            // first rising edge
+            break;
+        }
+        complex_exp << NAN;
+    }
+
+    int periodSize = 0;
+    for (; i < chopper.size(); ++i) {
+        periodSize++;
+        if (chopper[i-1] < 0.0 && chopper[i] >= 0.0) {
+            // rising edge
+
+            for (int j = 0; j < periodSize; ++j) {
+                qreal angle = 2.0 * M_PI * qreal(j) / qreal(periodSize);
+                complex_exp << std::exp(std::complex<qreal>(0.0, 1.0) * angle);
+            }
+
+            periodSize = 0;
+        }
+    }
+
+    for (int j = 0; j < periodSize; ++j) {
+        complex_exp << NAN;
+    }
+
+    return complex_exp;
+}
+
+// LockinEngine against baselineReference() on a recording of a chopper of period samples,
+// *compared is the number of samples where both references are known
+static qreal baselineError(int period, qint64 frames, qint64 *compared)
+{
+    QAudioFormat format;
+    format.setCodec("audio/pcm");
+    format.setChannelCount(2);
+    format.setSampleRate(48000);
+    format.setSampleSize(16);
+    format.setSampleType(QAudioFormat::SignedInt);
+    format.setByteOrder(QAudioFormat::LittleEndian);
+
+    // left : a signal, right : the chopper, 0 on its rising edges
+    QByteArray recording(frames * format.bytesPerFrame(), Qt::Uninitialized);
+    qint16 *samples = reinterpret_cast<qint16 *>(recording.data());
+    QVector<qreal> chopper(frames);
+    for (qint64 t = 0; t < frames; ++t) {
+        const int k = int(t % period);
+        const qint16 right = k == 0 ? 0 : (2 * k < period ? 26000 : -26000);
+        samples[2 * t] = qint16(20000.0 * std::sin(0.01 * qreal(t)));
+        samples[2 * t + 1] = right;
+        chopper[t] = qreal(right) / 32768.0;
+    }
+    const QVector<std::complex<qreal>> baseline = baselineReference(chopper);
+
+    LockinEngine engine;
+    engine.setFormat(format);
+    engine.setReferenceChannel(1);
+    engine.reset();
+
+    QVector<qreal> cos, sin;
+    qreal lastCos = NAN; // sample first - 1 of the engine
+    qreal lastSin = NAN;
+    qreal error = 0.0;
+    *compared = 0;
+
+    for (qint64 first = 0; first < frames;) {
+        const qint64 size = qMin<qint64>(randomBlock(), frames - first);
+        const int read = engine.readBytes(recording.constData() + first * format.bytesPerFrame(), size * format.bytesPerFrame());
+        engine.parseChopperSignal();
+        cos.resize(read);
+        sin.resize(read);
+        engine.copyReference(0, read, cos.data(), sin.data());
+
+        for (int i = 0; i < read; ++i) {
+            const std::complex<qreal> &z = baseline[first + i];
+            const qreal c = i > 0 ? cos[i - 1] : lastCos;
+            const qreal s = i > 0 ? sin[i - 1] : lastSin;
+            if (std::isnan(z.real()) || std::isnan(c))
+                continue;
+            error = qMax(error, std::fabs(c - z.real()));
+            error = qMax(error, std::fabs(s - z.imag()));
+            ++*compared;
+        }
+        if (read > 0) {
+            lastCos = cos[read - 1];
+            lastSin = sin[read - 1];
+        }
+        first += size;
+    }
+    return error;
+}
+
+int main()
+{
+    QTextStream out(stdout);
+    bool ok = true;
+
+    out << "reference\tprecision\tmax error\n";
+
+    const qreal trackerDouble = trackerError<double>(48000 * 60, 8);
+    const qreal trackerFloat = trackerError<float>(48000 * 60, 8);
+    out << "tracker\tdouble\t" << trackerDouble << "\n";
+    out << "tracker\tfloat\t" << trackerFloat << "\n";
+    ok = ok && trackerDouble <= maxError && trackerFloat <= maxFloatError;
+
+    // 0.5 s, then 14 hours of 192 kHz later
+    const qint64 starts[2] = { 0, qint64(14) * 3600 * 192000 };
+    for (int s = 0; s < 2; ++s) {
+        const qreal oscillatorDouble = oscillatorError<double>(437.123, 192000.0, starts[s], 96000);
+        const qreal oscillatorFloat = oscillatorError<float>(437.123, 192000.0, starts[s], 96000);
+        out << "oscillator from " << starts[s] << "\tdouble\t" << oscillatorDouble << "\n";
+        out << "oscillator from " << starts[s] << "\tfloat\t" << oscillatorFloat << "\n";
+        ok = ok && oscillatorDouble <= maxError && oscillatorFloat <= maxFloatError;
+    }
+
+    // the engine needs two edges, the first version one edge and a whole period
+    const int periods[3] = { 96, 109, 1000 };
+    for (int p = 0; p < 3; ++p) {
+        const qint64 frames = 48000 * 20;
+        qint64 compared;
+        const qreal baseline = baselineError(periods[p], frames, &compared);
+        out << "engine against the first version, period " << periods[p] << "\tdouble\t" << baseline << "\n";
+        ok = ok && baseline <= maxError && compared >= frames - 3 * periods[p];
+    }
+
+    out << (ok ? "PASS" : "FAIL") << "\n";
+    return ok ? 0 : 1;
+}
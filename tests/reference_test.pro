@@ -0,0 +1,12 @@
+QT += multimedia
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+TARGET = reference_test
+
+INCLUDEPATH += $$PWD/..
+
+include($$PWD/../lockin_core.pri)
+
+SOURCES += $$PWD/reference_test.cc
@@ -0,0 +1,207 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+/* Round trip of ShmPublisher to ShmReader in the same process
+ *
+ * layout : no layout before configure(), then the one given to configure()
+ * values : three times the capacity of a small ring, read every 10 records, each one
+ *   intact and valid, the records overwritten by the writer no longer valid
+ * scope : the frames of each block of LockinEngine (a synthetic recording), bit-identical
+ *   to copyChannel() and copyReference(), only the last capacity frames of a long block
+ * new layout : a second configure() invalidates the layout and the records read before
+ * closed : the memory is removed by close()
+ * Returns 1 if one of them fails.
+ */
+
+#include "shmpublisher.hh"
+#include "shmreader.hh"
+#include "syntheticsource.hh"
+#include <QTextStream>
+#include <QVector>
+#include <cmath>
+#include <cstring>
+#include <unistd.h>
+
+static const qint64 valueBytes = 4096; // 73 records of 3 values
+static const qint64 scopeBytes = 1 << 18; // 8192 frames of 2 channels
+
+static bool same(double a, double b)
+{
+    return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+int main()
+{
+    QTextStream out(stdout);
+    bool ok = true;
+    out << "part\trecords\terrors\n";
+
+    const QString name = QString("/lockin-test-%1").arg(getpid());
+    ShmPublisher publisher;
+    if (!publisher.open(name, valueBytes, scopeBytes)) {
+        out << name << ": " << publisher.errorString() << "\nFAIL\n";
+        return 1;
+    }
+    ShmReader reader;
+    if (!reader.open(name)) {
+        out << name << ": " << reader.errorString() << "\nFAIL\n";
+        return 1;
+    }
+
+    // layout
+    int errors = reader.updateLayout() ? 1 : 0;
+    const QVector<int> channels = QVector<int>() << 0 << 0 << 0;
+    const QVector<int> harmonics = QVector<int>() << 1 << 2 << 3;
+    publisher.configure(48000, 2, channels, harmonics);
+    if (!reader.updateLayout() || !reader.isLayoutCurrent())
+        errors++;
+    const ShmReader::Layout &layout = reader.layout();
+    if (layout.generation != 1 || layout.sampleRate != 48000 || layout.channelCount != 2
+            || layout.valueChannel != channels || layout.valueHarmonic != harmonics
+            || layout.valueCapacity != quint64(valueBytes / (7 * sizeof(double)))
+            || layout.scopeCapacity != quint64(scopeBytes / (4 * sizeof(double))))
+        errors++;
+    ok = ok && errors == 0;
+    out << "layout\t1\t" << errors << (errors == 0 ? "" : "\tFAIL") << "\n";
+
+    // values
+    const quint64 capacity = layout.valueCapacity;
+    const int count = int(3 * capacity);
+    LockinOutput output;
+    output.values.resize(3);
+    errors = 0;
+    quint64 next = 0;
+    for (int i = 0; i < count; ++i) {
+        output.time = i;
+        for (int k = 0; k < 3; ++k) {
+            output.values[k].x = i + 0.25 * k;
+            output.values[k].y = -i - 0.5 * k;
+        }
+        publisher.appendValue(output);
+
+        if ((i + 1) % 10 == 0 || i + 1 == count) {
+            const quint64 end = reader.valuesWritten();
+            if (end != quint64(i + 1))
+                errors++;
+            for (; next < end; ++next) {
+                const double *record = reader.valueRecord(next);
+                bool intact = record[0] == double(next);
+                for (int k = 0; k < 3; ++k)
+                    intact = intact && record[1 + 2 * k] == next + 0.25 * k && record[2 + 2 * k] == -double(next) - 0.5 * k;
+                if (!intact || !reader.isValueValid(next))
+                    errors++;
+            }
+        }
+    }
+    ok = ok && errors == 0;
+    out << "values\t" << count << "\t" << errors << (errors == 0 ? "" : "\tFAIL") << "\n";
+
+    // overwritten
+    errors = 0;
+    for (quint64 i = 0; i < quint64(count); ++i) {
+        if (reader.isValueValid(i) != (i + capacity >= quint64(count)))
+            errors++;
+    }
+    ok = ok && errors == 0;
+    out << "overwritten\t" << count << "\t" << errors << (errors == 0 ? "" : "\tFAIL") << "\n";
+
+    // scope
+    QAudioFormat format;
+    format.setCodec("audio/pcm");
+    format.setChannelCount(2);
+    format.setSampleRate(48000);
+    format.setSampleSize(24);
+    format.setSampleType(QAudioFormat::SignedInt);
+    format.setByteOrder(QAudioFormat::LittleEndian);
+
+    SyntheticSource source;
+    source.setFormat(format);
+    LockinEngine engine;
+    engine.setFormat(format);
+    engine.reset();
+
+    // blocks shorter and longer than the ring
+    const int blocks[] = { 1000, 3000, 5000, 20000, 700, 8192, 100 };
+    errors = 0;
+    qint64 frame = 0, records = 0;
+    for (int b = 0; b < int(sizeof(blocks) / sizeof(blocks[0])); ++b) {
+        const int size = blocks[b];
+        QByteArray data(size * format.bytesPerFrame(), Qt::Uninitialized);
+        source.generate(frame, size, data.data());
+        frame += size;
+        engine.readFrames(data.constData(), size);
+        engine.parseChopperSignal();
+        publisher.appendScope(engine);
+
+        QVector<qreal> expected(4 * size);
+        engine.copyChannel(0, 0, size, expected.data());
+        engine.copyChannel(1, 0, size, expected.data() + size);
+        engine.copyReference(0, size, expected.data() + 2 * size, expected.data() + 3 * size);
+
+        const quint64 end = reader.framesWritten();
+        if (end != quint64(frame))
+            errors++;
+        const quint64 first = end - qMin<quint64>(size, reader.layout().scopeCapacity);
+        for (quint64 index = first; index < end;) {
+            quint64 n = end - index;
+            const double *f = reader.frames(index, &n);
+            if (n == 0) {
+                errors++;
+                break;
+            }
+            for (quint64 j = 0; j < n; ++j) {
+                const int i = int(index + j - (end - size));
+                for (int c = 0; c < 4; ++c) {
+                    if (!same(f[4 * j + c], expected[c * size + i]))
+                        errors++;
+                }
+                records++;
+            }
+            if (!reader.isFrameValid(index))
+                errors++;
+            index += n;
+        }
+    }
+    ok = ok && errors == 0;
+    out << "scope\t" << records << "\t" << errors << (errors == 0 ? "" : "\tFAIL") << "\n";
+
+    // new layout
+    publisher.configure(48000, 2, QVector<int>() << 0, QVector<int>() << 1);
+    errors = 0;
+    if (reader.isLayoutCurrent() || reader.isValueValid(quint64(count) - 1) || reader.isFrameValid(quint64(frame) - 1))
+        errors++;
+    if (!reader.updateLayout() || reader.layout().generation != 2 || reader.layout().valueChannel.size() != 1
+            || reader.valuesWritten() != 0 || reader.framesWritten() != 0)
+        errors++;
+    ok = ok && errors == 0;
+    out << "new layout\t1\t" << errors << (errors == 0 ? "" : "\tFAIL") << "\n";
+
+    // closed
+    reader.close();
+    publisher.close();
+    errors = reader.open(name) ? 1 : 0;
+    ok = ok && errors == 0;
+    out << "closed\t1\t" << errors << (errors == 0 ? "" : "\tFAIL") << "\n";
+
+    out << (ok ? "PASS" : "FAIL") << "\n";
+    return ok ? 0 : 1;
+}
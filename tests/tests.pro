@@ -0,0 +1,9 @@
+# make check builds and runs every test, each one returns non zero on failure
+TEMPLATE = subdirs
+
+SUBDIRS += reference_test.pro \
+    blocksize_test.pro \
+    daemon_test.pro \
+    precision_test.pro \
+    filter_test.pro \
+    shm_test.pro
@@ -0,0 +1,77 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef TRIPLEBUFFER_HPP
+#define TRIPLEBUFFER_HPP
+
+#include <QAtomicInt>
+
+/* Lock-free exchange of the latest version of an object between two threads
+ *
+ * The writer fills back() and calls publish(), the reader calls update()
+ * and reads front(). Neither side ever waits : a version published while
+ * the reader still holds the previous one simply replaces it.
+ */
+
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : _middle(1), _back(0), _front(2) {}
+
+    // writer side
+    T &back() { return _buffers[_back]; }
+    bool publish(); // return false if the previous version was never read
+
+    // reader side
+    bool update(); // return true if a new version is available in front()
+    const T &front() const { return _buffers[_front]; }
+
+private:
+    enum { Fresh = 4 };
+
+    T _buffers[3];
+    QAtomicInt _middle; // index of the middle buffer, | Fresh when not read yet
+    int _back;
+    int _front;
+};
+
+template <typename T>
+bool TripleBuffer<T>::publish()
+{
+    int old = _middle.fetchAndStoreOrdered(_back | Fresh);
+    _back = old & 3;
+    return !(old & Fresh);
+}
+
+template <typename T>
+bool TripleBuffer<T>::update()
+{
+    if (!(_middle.loadAcquire() & Fresh))
+        return false;
+
+    int old = _middle.fetchAndStoreOrdered(_front);
+    _front = old & 3;
+    return true;
+}
+
+#endif // TRIPLEBUFFER_HPP
@@ -0,0 +1,150 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "workstealingpool.hh"
+#include <QThread>
+#include <QString>
+
+class WorkStealingThread : public QThread
+{
+public:
+    WorkStealingThread(WorkStealingPool *pool, int index) : _pool(pool), _index(index) {}
+
+protected:
+    void run() override { _pool->workLoop(_index); }
+
+private:
+    WorkStealingPool *_pool;
+    int _index;
+};
+
+WorkStealingPool::WorkStealingPool(int threads) :
+    _next(0), _queued(0), _quit(false)
+{
+    if (threads <= 0)
+        threads = QThread::idealThreadCount();
+    threads = qMax(1, threads);
+
+    for (int i = 0; i < threads; ++i)
+        _queues << new Queue;
+    for (int i = 0; i < threads; ++i) {
+        _threads << new WorkStealingThread(this, i);
+        // the sound cards wait for the processing
+        _threads[i]->start(QThread::TimeCriticalPriority);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        QMutexLocker locker(&_sleepMutex);
+        _quit = true;
+        _wake.wakeAll();
+    }
+    foreach (QThread *thread, _threads) {
+        thread->wait();
+        delete thread;
+    }
+    qDeleteAll(_queues);
+}
+
+void WorkStealingPool::start(QRunnable *task, Priority priority)
+{
+    int index = currentIndex();
+    if (index < 0)
+        index = int(quint32(_next.fetchAndAddRelaxed(1)) % quint32(_queues.size()));
+
+    {
+        QMutexLocker locker(&_queues[index]->mutex);
+        _queues[index]->tasks[priority].append(task);
+    }
+
+    // counted before the wake up, a thread that goes to sleep checks it under _sleepMutex
+    _queued.fetchAndAddOrdered(1);
+    QMutexLocker locker(&_sleepMutex);
+    _wake.wakeOne();
+}
+
+int WorkStealingPool::threadCount() const
+{
+    return _threads.size();
+}
+
+QString WorkStealingPool::priorityName(Priority priority)
+{
+    switch (priority) {
+    case High: return "high";
+    case Normal: return "normal";
+    case Low: return "low";
+    case PriorityCount: break;
+    }
+    return QString();
+}
+
+int WorkStealingPool::currentIndex() const
+{
+    QThread *current = QThread::currentThread();
+    for (int i = 0; i < _threads.size(); ++i) {
+        if (_threads[i] == current)
+            return i;
+    }
+    return -1;
+}
+
+QRunnable *WorkStealingPool::take(int index)
+{
+    const int n = _queues.size();
+
+    for (int p = 0; p < PriorityCount; ++p) {
+        // its own queue first, then the next ones
+        for (int i = 0; i < n; ++i) {
+            Queue *queue = _queues[(index + i) % n];
+            QMutexLocker locker(&queue->mutex);
+            if (!queue->tasks[p].isEmpty()) {
+                _queued.fetchAndSubRelaxed(1);
+                return queue->tasks[p].takeFirst();
+            }
+        }
+    }
+    return nullptr;
+}
+
+void WorkStealingPool::workLoop(int index)
+{
+    forever {
+        QRunnable *task = take(index);
+        if (task != nullptr) {
+            const bool autoDelete = task->autoDelete();
+            task->run();
+            if (autoDelete)
+                delete task;
+            continue;
+        }
+
+        QMutexLocker locker(&_sleepMutex);
+        if (_queued.loadAcquire() > 0)
+            continue;
+        if (_quit)
+            return;
+        _wake.wait(&_sleepMutex);
+    }
+}
@@ -0,0 +1,78 @@
+/****************************************************************************
+**
+**  Copyright (C) 2015 Mario Geiger
+**  Contact: geiger.mario@gmail.com
+**
+**  This file is part of lockin2.
+**
+**  lockin2 is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU Lesser General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  lockin2 is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public License
+**  along with lockin2.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef WORKSTEALINGPOOL_HPP
+#define WORKSTEALINGPOOL_HPP
+
+#include <QAtomicInt>
+#include <QList>
+#include <QMutex>
+#include <QRunnable>
+#include <QString>
+#include <QVector>
+#include <QWaitCondition>
+
+class QThread;
+
+/* Fixed number of threads, each one with its own queue of tasks per priority
+ *
+ * A task started from one of the threads goes into its own queue, otherwise into the
+ * queues in turn. A thread takes the oldest task of the highest priority from its own
+ * queue, or steals it from the others, before it looks at a lower priority.
+ * The tasks are QRunnable, deleted after run() when autoDelete() is set.
+ */
+
+class WorkStealingPool
+{
+public:
+    enum Priority { High, Normal, Low, PriorityCount };
+
+    explicit WorkStealingPool(int threads = 0); // 0 : QThread::idealThreadCount()
+    ~WorkStealingPool(); // runs the tasks already started, then joins the threads
+
+    void start(QRunnable *task, Priority priority = Normal); // from any thread
+    int threadCount() const;
+
+    static QString priorityName(Priority priority);
+
+private:
+    struct Queue {
+        QMutex mutex;
+        QList<QRunnable *> tasks[PriorityCount];
+    };
+
+    friend class WorkStealingThread;
+    void workLoop(int index);
+    QRunnable *take(int index);
+    int currentIndex() const; // of the calling thread, -1 outside the pool
+
+    QVector<Queue *> _queues; // one per thread
+    QVector<QThread *> _threads;
+    QAtomicInt _next; // queue of the next task started from outside
+    QAtomicInt _queued; // tasks in all the queues
+
+    QMutex _sleepMutex;
+    QWaitCondition _wake;
+    bool _quit;
+};
+
+#endif // WORKSTEALINGPOOL_HPP